@@ -0,0 +1,145 @@
+#include "deadlock_detector.h"
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * 锁竞争测试：
+ * threads 个线程各做 ops 次“随机取 mutexes 把锁中的 depth 把，按下标从小到大上锁、计数加1、按相反顺序解锁”，
+ * 输出每次操作的平均耗时和总吞吐。加锁顺序一致，不会死锁，也不应报告反序。
+ * raw 直接调用 libc 的 pthread_mutex_lock/unlock（不经过检测），detect 打开死锁检测，order 另外检查加锁顺序。
+ * 编译：gcc -O2 deadlock_bench.c deadlock_detector.c -ldl -lpthread -o deadlock_bench
+ * 运行：./deadlock_bench <raw|detect|order> [threads] [mutexes] [ops per thread] [depth]
+ */
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_MUTEXES 64
+#define DEFAULT_OPS     (1000 * 1000)
+#define MAX_DEPTH       4
+
+typedef int (*mutex_func)(pthread_mutex_t* mutex);
+
+struct slot
+{
+    pthread_mutex_t mutex;
+    long count;
+} __attribute__((aligned(64)));     // 每把锁独占一个 cache line，只测锁本身的竞争
+
+static struct slot* slots;
+static long mutexes;
+static long ops;
+static int depth;
+static mutex_func lock_func;
+static mutex_func unlock_func;
+
+/******************************************
+*name：		worker
+*brief:		测试线程
+*input:		arg：线程序号，作为随机数种子
+*output:	无
+*return:	无
+******************************************/
+static void* worker(void* arg)
+{
+    uint64_t rng = 88172645463325252ULL + (uintptr_t)arg * 0x9E3779B97F4A7C15ULL;
+    long i, idx[MAX_DEPTH];
+    int j, k;
+    for(i = 0; i < ops; i++)
+    {
+	//1、取 depth 把不同的锁，按下标排序
+        for(j = 0; j < depth; j++)
+        {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            long x = rng % mutexes;
+            for(k = j; k > 0 && idx[k - 1] > x; k--)
+                idx[k] = idx[k - 1];
+            if(k > 0 && idx[k - 1] == x)
+            {   // 重复的锁，退回重取
+                for(; k < j; k++)
+                    idx[k] = idx[k + 1];
+                j--;
+                continue;
+            }
+            idx[k] = x;
+        }
+
+	//2、上锁、计数、解锁
+        for(j = 0; j < depth; j++)
+            lock_func(&slots[idx[j]].mutex);
+        slots[idx[0]].count++;
+        for(j = depth - 1; j >= 0; j--)
+            unlock_func(&slots[idx[j]].mutex);
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        printf("Usage: %s <raw|detect|order> [threads] [mutexes] [ops per thread] [depth]\n", argv[0]);
+        return 0;
+    }
+
+    long threads = argc > 2 ? atol(argv[2]) : DEFAULT_THREADS;
+    mutexes = argc > 3 ? atol(argv[3]) : DEFAULT_MUTEXES;
+    ops = argc > 4 ? atol(argv[4]) : DEFAULT_OPS;
+    if(threads <= 0)
+        threads = DEFAULT_THREADS;
+    if(mutexes <= 0)
+        mutexes = DEFAULT_MUTEXES;
+    if(ops <= 0)
+        ops = DEFAULT_OPS;
+    depth = argc > 5 ? atoi(argv[5]) : 1;
+    if(depth < 1 || depth > MAX_DEPTH || depth > mutexes)
+        depth = 1;
+
+    if(strcmp(argv[1], "raw") == 0)
+    {
+        lock_func = (mutex_func)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+        unlock_func = (mutex_func)dlsym(RTLD_NEXT, "pthread_mutex_unlock");
+    }
+    else
+    {
+        init_detector_ex(strcmp(argv[1], "order") == 0 ? DD_MODE_CYCLE | DD_MODE_ORDER : DD_MODE_CYCLE);
+        lock_func = pthread_mutex_lock;
+        unlock_func = pthread_mutex_unlock;
+    }
+
+    long i;
+    slots = aligned_alloc(64, mutexes * sizeof(struct slot));
+    pthread_t* tids = malloc(threads * sizeof(pthread_t));
+    if(slots == NULL || tids == NULL || lock_func == NULL || unlock_func == NULL)
+        return -1;
+    for(i = 0; i < mutexes; i++)
+    {
+        pthread_mutex_init(&slots[i].mutex, NULL);
+        slots[i].count = 0;
+    }
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for(i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, worker, (void*)(uintptr_t)i);
+    for(i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = end.tv_sec - begin.tv_sec + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+	//每次加锁都在锁内计数，总数不对说明锁失效了
+    long total = 0;
+    for(i = 0; i < mutexes; i++)
+        total += slots[i].count;
+    printf("mode:%s threads:%ld mutexes:%ld depth:%d  %.1f ns/op per thread  %.2f Mops/s%s\n",
+        argv[1], threads, mutexes, depth, elapsed * 1e9 / ops, threads * ops / elapsed / 1e6,
+        total == threads * ops ? "" : "  COUNT MISMATCH");
+
+    free(tids);
+    free(slots);
+    return total == threads * ops ? 0 : 1;
+}
@@ -2,12 +2,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <string.h>
 
 
 pthread_mutex_t mutex1 = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex2 = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex3 = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex4 = PTHREAD_MUTEX_INITIALIZER;
+pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
 
 /******************************************
 *name：		thread1
@@ -93,9 +95,97 @@ void* thread4(void* arg)
     return NULL;
 }
 
+/******************************************
+*name：		order_ab/order_ba
+*brief:		分别按 mutex1->mutex2 和 mutex2->mutex1 的顺序上锁各100次，先后运行不会死锁，
+*           DD_MODE_ORDER 在第二个线程第一次反序上锁时报告
+*input:		无
+*output:	无
+*return:	无
+******************************************/
+void* order_ab(void* arg)
+{
+    int i;
+    pthread_setname_np(pthread_self(), "order_ab");
+    for(i = 0; i < 100; i++)
+    {
+        pthread_mutex_lock(&mutex1);
+        pthread_mutex_lock(&mutex2);
+        pthread_mutex_unlock(&mutex2);
+        pthread_mutex_unlock(&mutex1);
+    }
+    return NULL;
+}
+
+void* order_ba(void* arg)
+{
+    int i;
+    pthread_setname_np(pthread_self(), "order_ba");
+    for(i = 0; i < 100; i++)
+    {
+        pthread_mutex_lock(&mutex2);
+        pthread_mutex_lock(&mutex1);
+        pthread_mutex_unlock(&mutex1);
+        pthread_mutex_unlock(&mutex2);
+    }
+    return NULL;
+}
+
+/******************************************
+*name：		reader/writer
+*brief:		reader 先加读锁，睡眠1秒后请求mutex1；writer 先获取mutex1，睡眠1秒后请求写锁。
+*           reader 等 writer 释放 mutex1，writer 等 reader 释放读锁，构成环
+*input:		无
+*output:	无
+*return:	无
+******************************************/
+void* reader(void* arg)
+{
+    pthread_setname_np(pthread_self(), "reader");
+    pthread_rwlock_rdlock(&rwlock);
+    sleep(1);
+    pthread_mutex_lock(&mutex1);
 
-int main() 
+    pthread_mutex_unlock(&mutex1);
+    pthread_rwlock_unlock(&rwlock);
+    return NULL;
+}
+
+void* writer(void* arg)
 {
+    pthread_setname_np(pthread_self(), "writer");
+    pthread_mutex_lock(&mutex1);
+    sleep(1);
+    pthread_rwlock_wrlock(&rwlock);
+
+    pthread_rwlock_unlock(&rwlock);
+    pthread_mutex_unlock(&mutex1);
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc > 1 && strcmp(argv[1], "order") == 0)
+    {
+        init_detector_ex(DD_MODE_ORDER);    // 只检查加锁顺序
+        pthread_t tid;
+        pthread_create(&tid, NULL, order_ab, NULL);
+        pthread_join(tid, NULL);
+        pthread_create(&tid, NULL, order_ba, NULL);
+        pthread_join(tid, NULL);
+        return 0;
+    }
+    if(argc > 1 && strcmp(argv[1], "rwlock") == 0)
+    {
+        init_detector();
+        pthread_t tid1, tid2;
+        pthread_create(&tid1, NULL, reader, NULL);
+        pthread_create(&tid2, NULL, writer, NULL);
+        pthread_join(tid1, NULL);
+        pthread_join(tid2, NULL);
+        return 0;
+    }
+
     init_detector();    // 初始化检测组件
 
     pthread_t tid1, tid2, tid3, tid4;
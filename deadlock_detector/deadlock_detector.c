@@ -3,61 +3,226 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <assert.h>
 #include "deadlock_detector.h"
 
+/*
+ * 劫持 pthread_mutex_xxx、pthread_rwlock_xxx（含 try/timed/clock 版本）和 pthread_cond_xxx，
+ * std::mutex、std::shared_mutex、std::condition_variable 最终也调用这些函数。
+ *
+ * 上锁/解锁的快路径不加全局锁：
+ * 线程顶点放在线程局部变量中，锁资源放在分片的哈希表里（查找无锁，只有插入新锁时加所在分片的锁）。
+ * 每个线程记录自己持有的锁（vertex.held，共享/独占）和正在等待的锁（vertex.waitting），只由本线程写。
+ * 等待图的边：线程 W 等待锁 L 时，指向所有以冲突方式持有 L 的线程（W 要独占时为全部持有者，要共享时为独占的持有者），
+ * 读写锁上的读者、写者互相等待也能构成环。
+ * 检测线程读到的是各线程并发更新中的快照，找到环后隔一段时间再核对一遍，边都没变才报告。
+ *
+ * DD_MODE_ORDER（类似内核的 lockdep）：每个线程记录已持有的锁，上锁前对每把已持有的锁 A 和要上的锁 B 记一条顺序边 A->B，
+ * 新边使顺序图出现环（之前有线程按 B ... A 的顺序上过锁）时立即报告两边的调用位置，不需要真的发生死锁。
+ * 已检查过的“持有的锁 + 要上的锁”组合按链哈希缓存，重复的加锁顺序只查一次缓存；
+ * 组合太多缓存不下时，再按已记录的顺序边（两把锁一对）缓存，都记录过就不需要加锁遍历顺序图。
+ * 锁按地址区分，锁销毁后地址被另一把锁复用时，旧的顺序边仍然算在新锁上。
+ */
+
+#define DD_SHARD_BITS 6                         // 锁资源哈希表分 64 个分片
+#define DD_SHARD_NUM (1 << DD_SHARD_BITS)
+#define DD_BUCKET_BITS 8                        // 每个分片 256 个桶
+#define DD_BUCKET_NUM (1 << DD_BUCKET_BITS)
+#define DD_CONFIRM_USEC (100 * 1000)            // 找到环后隔多久核对
+#define DD_CACHE_LINE 64
+#define DD_HELD_MAX 32                          // 每个线程最多记录的持有锁数，超过的不参与顺序检查
+#define DD_ORDER_CACHE_BITS 16                  // 已检查的加锁组合缓存 64K 项
+#define DD_ORDER_CACHE_SIZE (1 << DD_ORDER_CACHE_BITS)
+#define DD_ORDER_CACHE_PROBE 8                  // 缓存线性探测的长度，探测不到空位就不缓存
+#define DD_ORDER_PATH_MAX 16                    // 报告中最多打印的已有顺序边数
+
+#define DD_HELD_EXCL 0          // 独占持有：mutex、写锁
+#define DD_HELD_SHARED 1        // 共享持有：读锁
+
 struct resource_lock;
 
-//线程顶点
-struct vertex 
+//线程持有的一把锁
+struct held_lock
+{
+    struct resource_lock* lock;
+    int mode;           // DD_HELD_xxx
+    void* site;         // 上锁的调用位置
+    uint64_t chain;     // 从栈底到这把锁的链哈希
+};
+
+//线程顶点，线程退出后留在链表中给新线程复用
+struct vertex
 {
     struct vertex* next;
     pthread_t tid;        // 每个线程是一个节点 vertex，因此用线程 id 作为节点的 id
-    struct resource_lock* waitting;  // waitting 不为 NULL时，指向当前正在等待释放的锁资源，通过 resource_lock 可以获取到 holder 从而构建图
-    int visited;    // 遍历时用于标记是否访问过
+    struct resource_lock* waitting;  // waitting 不为 NULL时，指向当前正在等待释放的锁资源，持有该锁的其他顶点即等待的顶点
+    int wait_mode;  // 等待的方式，DD_HELD_xxx
+    int alive;      // 是否有线程在用
+    struct held_lock held[DD_HELD_MAX];     // 按上锁顺序持有的锁，同一把递归锁每次上锁一项；超过的不记录
+    int held_num;
 };
 
-//锁资源
+//顺序边：持有 from 时上锁 to
+struct order_edge
+{
+    struct order_edge* next;
+    struct resource_lock* to;
+    void* from_site;    // from 的上锁位置
+    void* to_site;      // to 的上锁位置
+    char thread[16];    // 第一次按这个顺序上锁的线程名
+};
+
+//锁资源，加入哈希表后不再删除，锁的地址被复用时继续使用。持有者记录在各线程的 vertex.held 中
 struct resource_lock
 {
     struct resource_lock* next;
-    struct vertex* holder;  // 持有当前锁的 vertex
-    pthread_mutex_t* lock; // 该锁资源的 mutx 地址
-    int used;       // 有多少线程当前在持有该资源或等待该资源
+    void* lock;     // 该锁资源的 mutex/rwlock 地址
+    struct order_edge* after;   // 顺序图中的出边，只在 order_mutex 下读写
+    unsigned long order_visited;    // 顺序图遍历标记
 };
 
+//锁资源哈希表的分片，mutex 只在插入时使用
+struct lock_shard
+{
+    pthread_mutex_t mutex;
+    struct resource_lock* buckets[DD_BUCKET_NUM];
+} __attribute__((aligned(DD_CACHE_LINE)));
+
 //有向图
 struct task_graph
 {
-    struct vertex vertex_list;  // 辅助节点，实际第一个节点是vertex_list.next
-    struct resource_lock lock_list;// 辅助节点，实际第一个节点是lock_list.next
-    pthread_mutex_t mutex;
+    struct vertex* vertex_list;     // 所有线程顶点，只在表头插入
+    struct lock_shard shards[DD_SHARD_NUM];
+    pthread_key_t key;              // 线程退出时归还顶点
+    int mode;                       // DD_MODE_xxx
+    pthread_mutex_t order_mutex;    // 顺序图的修改和遍历
+    unsigned long order_search;     // 顺序图遍历编号
+    struct order_edge* order_path[DD_ORDER_PATH_MAX];  // 找到的已有顺序
+    int order_path_len;
+    uint64_t order_cache[DD_ORDER_CACHE_SIZE];  // 检查过的链哈希，0为空位
+    uint64_t order_pairs[DD_ORDER_CACHE_SIZE];  // 检查过的顺序边，同上
 };
 
 typedef int (*pthread_mutex_lock_ptr)(pthread_mutex_t* mutex);
-pthread_mutex_lock_ptr __pthread_mutex_lock;
+static pthread_mutex_lock_ptr __pthread_mutex_lock;
 
 typedef int (*pthread_mutex_unlock_ptr)(pthread_mutex_t* mutex);
-pthread_mutex_unlock_ptr __pthread_mutex_unlock;
+static pthread_mutex_unlock_ptr __pthread_mutex_unlock;
+
+typedef int (*pthread_mutex_trylock_ptr)(pthread_mutex_t* mutex);
+static pthread_mutex_trylock_ptr __pthread_mutex_trylock;
+
+typedef int (*pthread_mutex_timedlock_ptr)(pthread_mutex_t* mutex, const struct timespec* abstime);
+static pthread_mutex_timedlock_ptr __pthread_mutex_timedlock;
+
+typedef int (*pthread_mutex_clocklock_ptr)(pthread_mutex_t* mutex, clockid_t clockid, const struct timespec* abstime);
+static pthread_mutex_clocklock_ptr __pthread_mutex_clocklock;
+
+typedef int (*pthread_rwlock_lock_ptr)(pthread_rwlock_t* rwlock);     // rdlock/wrlock/tryrdlock/trywrlock/unlock
+static pthread_rwlock_lock_ptr __pthread_rwlock_rdlock;
+static pthread_rwlock_lock_ptr __pthread_rwlock_wrlock;
+static pthread_rwlock_lock_ptr __pthread_rwlock_tryrdlock;
+static pthread_rwlock_lock_ptr __pthread_rwlock_trywrlock;
+static pthread_rwlock_lock_ptr __pthread_rwlock_unlock;
+
+typedef int (*pthread_rwlock_timedlock_ptr)(pthread_rwlock_t* rwlock, const struct timespec* abstime);
+static pthread_rwlock_timedlock_ptr __pthread_rwlock_timedrdlock;
+static pthread_rwlock_timedlock_ptr __pthread_rwlock_timedwrlock;
+
+typedef int (*pthread_rwlock_clocklock_ptr)(pthread_rwlock_t* rwlock, clockid_t clockid, const struct timespec* abstime);
+static pthread_rwlock_clocklock_ptr __pthread_rwlock_clockrdlock;
+static pthread_rwlock_clocklock_ptr __pthread_rwlock_clockwrlock;
+
+typedef int (*pthread_cond_wait_ptr)(pthread_cond_t* cond, pthread_mutex_t* mutex);
+static pthread_cond_wait_ptr __pthread_cond_wait;
+
+typedef int (*pthread_cond_timedwait_ptr)(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime);
+static pthread_cond_timedwait_ptr __pthread_cond_timedwait;
+
+typedef int (*pthread_cond_clockwait_ptr)(pthread_cond_t* cond, pthread_mutex_t* mutex, clockid_t clockid, const struct timespec* abstime);
+static pthread_cond_clockwait_ptr __pthread_cond_clockwait;
 
 static struct task_graph graph;
+static __thread struct vertex* self_vertex;     // 当前线程的顶点
 
 
 /******************************************
 *name：		add_vertex
-*brief:		新增线程顶点
-*input:		tid：线程的ID
+*brief:		新增线程顶点，先复用已退出线程留下的顶点，没有再新建并加入有向图
+*input:		g：有向图；tid：线程的ID
 *output:	无
 *return:	顶点地址
 ******************************************/
-static struct vertex* add_vertex(pthread_t tid)
+static struct vertex* add_vertex(struct task_graph* g, pthread_t tid)
 {
-    struct vertex* v = (struct vertex*)malloc(sizeof(struct vertex));
+    struct vertex* v;
+    int idle = 0;
+
+	//1、复用
+    for(v = __atomic_load_n(&g->vertex_list, __ATOMIC_ACQUIRE); v; v = v->next)
+    {
+        if(!__atomic_load_n(&v->alive, __ATOMIC_RELAXED)
+            && __atomic_compare_exchange_n(&v->alive, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            v->tid = tid;
+            return v;
+        }
+        idle = 0;
+    }
+
+	//2、新建，无锁插入表头
+    v = (struct vertex*)malloc(sizeof(struct vertex));
     if(v != NULL)
 	{
         memset(v, 0, sizeof(struct vertex));
         v->tid = tid;
+        v->alive = 1;
+        v->next = __atomic_load_n(&g->vertex_list, __ATOMIC_RELAXED);
+        while(!__atomic_compare_exchange_n(&g->vertex_list, &v->next, v, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+    return v;
+}
+
+/******************************************
+*name：		release_vertex
+*brief:		线程退出时归还顶点（pthread_key 的析构函数）
+*input:		arg：顶点
+*output:	无
+*return:	无
+******************************************/
+static void release_vertex(void* arg)
+{
+    struct vertex* v = (struct vertex*)arg;
+    __atomic_store_n(&v->waitting, NULL, __ATOMIC_RELAXED);
+    v->held_num = 0;
+    self_vertex = NULL;
+    __atomic_store_n(&v->alive, 0, __ATOMIC_RELEASE);
+}
+
+/******************************************
+*name：		get_self_vertex
+*brief:		取当前线程的顶点，第一次上锁时创建
+*input:		无
+*output:	无
+*return:	顶点地址
+******************************************/
+static inline struct vertex* get_self_vertex(void)
+{
+    struct vertex* v = self_vertex;
+    if(v == NULL)
+    {
+        v = add_vertex(&graph, pthread_self());
+        if(v == NULL)
+        {
+            printf("add_vertex error...\n");
+            assert(0);
+        }
+        self_vertex = v;
+        pthread_setspecific(graph.key, v);
     }
     return v;
 }
@@ -69,7 +234,7 @@ static struct vertex* add_vertex(pthread_t tid)
 *output:	无
 *return:	锁资源地址
 ******************************************/
-static struct resource_lock* add_lock(pthread_mutex_t* mtx)
+static struct resource_lock* add_lock(void* mtx)
 {
     struct resource_lock* r = (struct resource_lock*)malloc(sizeof(struct resource_lock));
     if(r != NULL)
@@ -81,276 +246,448 @@ static struct resource_lock* add_lock(pthread_mutex_t* mtx)
 }
 
 /******************************************
-*name：		add_relation_before_lock
-*brief:		获取到锁之前，记录线程顶点请求的锁资源（即线程到锁的边）
-*input:		vtx：线程顶点；lock：锁资源
-*output:	无
-*return:	无
+*name：		lock_bucket
+*brief:		锁的地址散列到分片和桶
+*input:		g：有向图；mtx：锁ID
+*output:	shard：所在分片
+*return:	桶
 ******************************************/
-static inline void add_relation_before_lock(struct vertex* vtx, struct resource_lock* lock)
+static inline struct resource_lock** lock_bucket(struct task_graph* g, void* mtx, struct lock_shard** shard)
 {
-    vtx->waitting = lock;   // 边
-    lock->used++;
+    uint64_t h = ((uintptr_t)mtx >> 3) * 0x9E3779B97F4A7C15ULL;
+    *shard = &g->shards[h >> (64 - DD_SHARD_BITS)];
+    return &(*shard)->buckets[(h >> (64 - DD_SHARD_BITS - DD_BUCKET_BITS)) & (DD_BUCKET_NUM - 1)];
 }
 
 /******************************************
-*name：		become_holder_after_lock
-*brief:		获取到锁后，记录锁资源的拥有者，并删除边
-*input:		vtx：线程顶点；lock：锁资源
+*name：		search_bucket
+*brief:		在桶中查找锁资源，不加锁（锁资源插入后不删除）
+*input:		bucket：桶；mtx：锁ID
 *output:	无
-*return:	无
+*return:	返回该锁资源，未找到返回NULL
 ******************************************/
-static inline void become_holder_after_lock(struct vertex* vtx, struct resource_lock* lock)
+static inline struct resource_lock* search_bucket(struct resource_lock** bucket, void* mtx)
 {
-    lock->holder = vtx;     // 成为其持有者
-    vtx->waitting = NULL;
+    struct resource_lock* l = __atomic_load_n(bucket, __ATOMIC_ACQUIRE);
+    while(l)
+	{
+        if(mtx == l->lock)
+		{
+            return l;
+        }
+        l = l->next;
+    }
+
+    return NULL;
 }
 
 /******************************************
-*name：		dereference_after_unlock
-*brief:		释放锁后，删除锁资源的拥有者
-*input:		lock：锁资源
+*name：		search_lock
+*brief:		查找有向图中是否已有该锁的资源
+*input:		g：有向图；mtx：锁ID
 *output:	无
-*return:	无
+*return:	返回该锁资源，未找到返回NULL
 ******************************************/
-static inline void dereference_after_unlock(struct resource_lock* lock)
+static inline struct resource_lock* search_lock(struct task_graph* g, void* mtx)
 {
-    lock->used--;
-    lock->holder = NULL;
+    struct lock_shard* shard;
+    return search_bucket(lock_bucket(g, mtx, &shard), mtx);
 }
 
 /******************************************
-*name：		get_wait_vertex
-*brief:		获取某顶点正在等待的锁资源的拥有者（即某顶点正在等待的顶点）
-*input:		vtx：线程顶点
+*name：		get_lock
+*brief:		查找锁资源，没有则加所在分片的锁后新建并加入有向图
+*input:		g：有向图；mtx：锁ID
 *output:	无
-*return:	顶点地址，没有则返回NULL
+*return:	锁资源
 ******************************************/
-static inline struct vertex* get_wait_vertex(struct vertex* vtx)
+static struct resource_lock* get_lock(struct task_graph* g, void* mtx)
 {
-    return vtx->waitting ? vtx->waitting->holder : NULL;
+    struct lock_shard* shard;
+    struct resource_lock** bucket = lock_bucket(g, mtx, &shard);
+    struct resource_lock* lock = search_bucket(bucket, mtx);
+    if(lock)
+        return lock;
+
+    __pthread_mutex_lock(&shard->mutex);
+    lock = search_bucket(bucket, mtx);      // 加锁前可能已被其他线程插入
+    if(lock == NULL)
+    {
+        lock = add_lock(mtx);
+        if(lock == NULL)
+        {
+            printf("add_lock error...\n");
+            assert(0);
+        }
+        lock->next = *bucket;
+        __atomic_store_n(bucket, lock, __ATOMIC_RELEASE);
+    }
+    __pthread_mutex_unlock(&shard->mutex);
+    return lock;
 }
 
 /******************************************
-*name：		search_vertex
-*brief:		查找有向图中是否已有该线程的顶点
-*input:		g：有向图；tid：线程ID
+*name：		chain_hash
+*brief:		持有锁的链哈希：前面所有持有锁的链哈希再加上这把锁
+*input:		prev：前一把持有锁的链哈希，栈底为0；lock：锁资源
 *output:	无
-*return:	返回该线程顶点，未找到返回NULL
+*return:	链哈希，不为0
 ******************************************/
-static struct vertex* search_vertex(struct task_graph* g, pthread_t tid) 
+static inline uint64_t chain_hash(uint64_t prev, struct resource_lock* lock)
 {
-    struct vertex* v = g->vertex_list.next;
-    while(v)
-	{
-        if(tid == v->tid)
-		{
-            return v;
-        }
-        v = v->next;
-    }
-
-    return NULL;
+    uint64_t h = (prev ^ (uintptr_t)lock) * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+    return h ? h : 1;
 }
 
 /******************************************
-*name：		search_lock
-*brief:		查找有向图中是否已有该锁的资源
-*input:		g：有向图；mtx：锁ID
+*name：		order_cache_find/order_cache_add
+*brief:		查找/加入检查过的加锁组合或顺序边，无锁的开放寻址表
+*input:		cache：g->order_cache 或 g->order_pairs；key：链哈希
 *output:	无
-*return:	返回该锁资源，未找到返回NULL
+*return:	order_cache_find：1 已检查过
 ******************************************/
-static struct resource_lock* search_lock(struct task_graph* g, pthread_mutex_t* mtx) 
+static inline int order_cache_find(uint64_t* cache, uint64_t key)
 {
-    struct resource_lock* l = g->lock_list.next;
-    while(l)
-	{
-        if(mtx == l->lock)
-		{
-            return l;
-        }
-        l = l->next;
+    int i;
+    for(i = 0; i < DD_ORDER_CACHE_PROBE; i++)
+    {
+        uint64_t slot = __atomic_load_n(&cache[(key + i) & (DD_ORDER_CACHE_SIZE - 1)], __ATOMIC_ACQUIRE);
+        if(slot == key)
+            return 1;
+        if(slot == 0)
+            return 0;
     }
+    return 0;
+}
 
-    return NULL;
+static void order_cache_add(uint64_t* cache, uint64_t key)
+{
+    int i;
+    for(i = 0; i < DD_ORDER_CACHE_PROBE; i++)
+    {
+        uint64_t slot = 0;
+        if(__atomic_compare_exchange_n(&cache[(key + i) & (DD_ORDER_CACHE_SIZE - 1)], &slot, key,
+            0, __ATOMIC_RELEASE, __ATOMIC_RELAXED) || slot == key)
+            return;
+    }
 }
 
 /******************************************
-*name：		add_vertex_to_graph
-*brief:		将线程顶点加入有向图
-*input:		g：有向图；vtx：线程顶点
+*name：		print_site
+*brief:		打印调用位置，能找到符号时打印 函数+偏移（可执行文件中的函数需要 -rdynamic 编译）
+*input:		site：返回地址
 *output:	无
 *return:	无
 ******************************************/
-static void add_vertex_to_graph(struct task_graph* g, struct vertex* vtx)
+static void print_site(void* site)
 {
-    struct vertex* node = g->vertex_list.next;
-    struct vertex* prev = &g->vertex_list;
+    Dl_info info;
+    if(dladdr(site, &info) && info.dli_sname)
+        printf("%s+0x%lx", info.dli_sname, (unsigned long)((char*)site - (char*)info.dli_saddr));
+    else if(dladdr(site, &info) && info.dli_fname)
+        printf("%s+0x%lx", info.dli_fname, (unsigned long)((char*)site - (char*)info.dli_fbase));
+    else
+        printf("%p", site);
+}
 
-	while(node)
-	{
-        if(node == vtx)
-		{
-            return; // 避免重复添加
+/******************************************
+*name：		order_reach
+*brief:		在顺序图中深度优先查找 from 能否到达 to，找到时把路径上的边记到 g->order_path
+*input:		g：有向图；from：起点；to：终点；depth：当前深度
+*output:	无
+*return:	1 能到达，0 不能
+******************************************/
+static int order_reach(struct task_graph* g, struct resource_lock* from, struct resource_lock* to, int depth)
+{
+    struct order_edge* e;
+    if(from == to)
+    {
+        g->order_path_len = depth < DD_ORDER_PATH_MAX ? depth : DD_ORDER_PATH_MAX;
+        return 1;
+    }
+    if(from->order_visited == g->order_search)
+        return 0;
+    from->order_visited = g->order_search;
+
+    for(e = from->after; e; e = e->next)
+    {
+        if(order_reach(g, e->to, to, depth + 1))
+        {
+            if(depth < DD_ORDER_PATH_MAX)
+                g->order_path[depth] = e;
+            return 1;
         }
-        node = node->next;
-        prev = prev->next;
     }
-    prev->next = vtx;
+    return 0;
 }
 
 /******************************************
-*name：		add_lock_to_graph
-*brief:		将锁资源加入有向图
-*input:		g：有向图；lock：锁资源
+*name：		report_inversion
+*brief:		报告反序：持有 held 时上锁 lock，而顺序图中已有 lock ... held->lock 的路径（在 g->order_path 中）
+*input:		g：有向图；vtx：当前线程；held：持有的锁；lock：要上的锁；site：上锁位置
 *output:	无
 *return:	无
 ******************************************/
-static void add_lock_to_graph(struct task_graph* g, struct resource_lock* lock)
+static void report_inversion(struct task_graph* g, struct vertex* vtx, struct held_lock* held, struct resource_lock* lock, void* site)
 {
-    struct resource_lock* node = g->lock_list.next;
-    struct resource_lock* prev = &g->lock_list;
+    char buf[32];
+    int i;
+    struct resource_lock* from = lock;
 
-	while(node)
-	{
-        if(node == lock)
-		{
-            return; // 避免重复添加
-        }
-        node = node->next;
-        prev = prev->next;
+    pthread_getname_np(vtx->tid, buf, 32);
+    printf("possible deadlock: lock order inversion\n");
+    printf("  %s locks %p at ", buf, (void*)lock->lock);
+    print_site(site);
+    printf("\n    while holding %p locked at ", (void*)held->lock->lock);
+    print_site(held->site);
+    printf("\n  existing order:\n");
+    for(i = 0; i < g->order_path_len; i++)
+    {
+        struct order_edge* e = g->order_path[i];
+        printf("    %p -> %p by %s: ", (void*)from->lock, (void*)e->to->lock, e->thread);
+        print_site(e->from_site);
+        printf(" then ");
+        print_site(e->to_site);
+        printf("\n");
+        from = e->to;
     }
-    prev->next = lock;
 }
 
 /******************************************
-*name：		before_lock
-*brief:		实际上锁前，在有向图中建立对应顶点和资源的边
-*input:		g：有向图；tid：请求线程的ID；mtx：请求锁的ID
+*name：		order_check
+*brief:		上锁前检查加锁顺序：对每把持有的锁 A 记一条 A->lock 的顺序边，顺序图中已有 lock 到 A 的路径时报告，
+*           反序的边不加入顺序图，同一对锁只报告一次
+*input:		g：有向图；vtx：当前线程；lock：要上的锁；site：上锁位置
 *output:	无
 *return:	无
 ******************************************/
-static void before_lock(struct task_graph* g, pthread_t tid, pthread_mutex_t* mtx) {
+static void order_check(struct task_graph* g, struct vertex* vtx, struct resource_lock* lock, void* site)
+{
+    if(vtx->held_num == 0)
+        return;
 
-    struct vertex* vtx;
-    struct resource_lock* lock;
+	//1、持有的锁和要上的锁的组合检查过，直接返回
+    uint64_t key = chain_hash(vtx->held[vtx->held_num - 1].chain, lock);
+    if(order_cache_find(g->order_cache, key))
+        return;
 
-    __pthread_mutex_lock(&g->mutex);
+	//2、每对锁都检查过，不需要加锁
+    int i, locked = 0;
+    for(i = 0; i < vtx->held_num; i++)
+    {
+        struct resource_lock* a = vtx->held[i].lock;
+        struct order_edge* e;
+        uint64_t pair = chain_hash(chain_hash(0, a), lock);
+        if(a == lock || order_cache_find(g->order_pairs, pair))
+            continue;   // 递归锁，或者检查过
 
-	//1、查找该线程顶点，没有则新建
-    if((vtx = search_vertex(g, tid)) == NULL) 
-	{
-        vtx = add_vertex(tid);
-        if(vtx) {
-            add_vertex_to_graph(g, vtx);
+	//3、检查、记录顺序边
+        if(!locked)
+        {
+            __pthread_mutex_lock(&g->order_mutex);
+            locked = 1;
         }
-        else {
-            printf("add_vertex error...\n");
-            assert(0);
-        }
-    }
-
-	//2、查找该锁资源，没有则新建
-    if((lock = search_lock(g, mtx)) == NULL) 
-	{
-        lock = add_lock(mtx);
-        if(lock) {
-            add_lock_to_graph(g, lock);
+        for(e = a->after; e; e = e->next)
+        {
+            if(e->to == lock)
+                break;
         }
-        else {
-            printf("add_lock error...\n");
-            assert(0);
+        if(e == NULL)
+        {
+            g->order_search++;
+            if(order_reach(g, lock, a, 0))
+            {
+                report_inversion(g, vtx, &vtx->held[i], lock, site);
+            }
+            else if((e = (struct order_edge*)malloc(sizeof(struct order_edge))) != NULL)
+            {
+                e->to = lock;
+                e->from_site = vtx->held[i].site;
+                e->to_site = site;
+                pthread_getname_np(vtx->tid, e->thread, sizeof(e->thread));
+                e->next = a->after;
+                a->after = e;
+            }
+            else
+            {
+                continue;   // 没有记录下来，下次再检查
+            }
         }
+        order_cache_add(g->order_pairs, pair);
     }
+    if(locked)
+        __pthread_mutex_unlock(&g->order_mutex);
 
-	//3、建立请求关系（即图的边）
-    add_relation_before_lock(vtx, lock);
-
-    __pthread_mutex_unlock(&g->mutex);
+	//4、记入缓存
+    order_cache_add(g->order_cache, key);
 }
 
 /******************************************
-*name：		after_lock
-*brief:		实际上锁成功后，删除请求边，更新锁资源的拥有者
-*input:		g：有向图；tid：请求线程的ID；mtx：请求锁的ID
+*name：		held_push/held_pop
+*brief:		上锁成功后把锁记入线程持有的锁；释放时从后往前找到这把锁取出，后面的锁前移并重算链哈希
+*input:		vtx：当前线程；lock：锁资源；mode：DD_HELD_xxx；site：上锁位置
 *output:	无
-*return:	无
+*return:	held_pop：取出的锁的上锁位置，没有记录返回NULL
 ******************************************/
-static void after_lock(struct task_graph* g, pthread_t tid, pthread_mutex_t* mtx)
+static inline void held_push(struct vertex* vtx, struct resource_lock* lock, int mode, void* site)
 {
-    struct vertex* vtx;
-    struct resource_lock* lock;
-
-    __pthread_mutex_lock(&g->mutex);
+    int n = vtx->held_num;
+    if(n == DD_HELD_MAX)
+        return;
+    vtx->held[n].lock = lock;
+    vtx->held[n].mode = mode;
+    vtx->held[n].site = site;
+    vtx->held[n].chain = chain_hash(n ? vtx->held[n - 1].chain : 0, lock);
+    __atomic_store_n(&vtx->held_num, n + 1, __ATOMIC_RELEASE);     // 检测线程看到数量时内容已写好
+}
 
-    vtx = search_vertex(g, tid);
-    lock = search_lock(g, mtx);
+static void* held_pop(struct vertex* vtx, struct resource_lock* lock)
+{
+    int i;
+    for(i = vtx->held_num - 1; i >= 0; i--)
+    {
+        if(vtx->held[i].lock == lock)
+            break;
+    }
+    if(i < 0)
+        return NULL;    // 超过 DD_HELD_MAX 没有记录，或者不是本线程上的锁
 
-    if(vtx == NULL || lock == NULL) {
-        printf("ERROR: vtx == NULL || lock == NULL in after_lock...\n");
-        assert(0);
+    void* site = vtx->held[i].site;
+    int n = vtx->held_num - 1;
+    __atomic_store_n(&vtx->held_num, n, __ATOMIC_RELEASE);
+    for(; i < n; i++)
+    {
+        vtx->held[i] = vtx->held[i + 1];
+        vtx->held[i].chain = chain_hash(i ? vtx->held[i - 1].chain : 0, vtx->held[i].lock);
     }
-	
-    //正式拥有当前的锁资源
-    become_holder_after_lock(vtx, lock);
+    return site;
+}
+
+/******************************************
+*name：		lock_enter
+*brief:		上锁前：取线程顶点和锁资源，会阻塞的上锁检查加锁顺序（DD_MODE_ORDER），try 版本不会死锁，不检查
+*input:		addr：锁的地址；site：上锁位置；block：是否会阻塞
+*output:	vtx：当前线程顶点
+*return:	锁资源
+******************************************/
+static inline struct resource_lock* lock_enter(void* addr, void* site, int block, struct vertex** vtx)
+{
+    struct resource_lock* lock = get_lock(&graph, addr);
+    *vtx = get_self_vertex();
+    if(block && (graph.mode & DD_MODE_ORDER))
+        order_check(&graph, *vtx, lock, site);
+    return lock;
+}
+
+/******************************************
+*name：		add_relation_before_lock
+*brief:		直接获取失败、要阻塞等待前，记录线程顶点请求的锁资源（即线程到锁的边）
+*input:		vtx：线程顶点；lock：锁资源；mode：DD_HELD_xxx
+*output:	无
+*return:	无
+******************************************/
+static inline void add_relation_before_lock(struct vertex* vtx, struct resource_lock* lock, int mode)
+{
+    vtx->wait_mode = mode;
+    __atomic_store_n(&vtx->waitting, lock, __ATOMIC_RELEASE);   // 边
+}
 
-    __pthread_mutex_unlock(&g->mutex);
+/******************************************
+*name：		become_holder_after_lock
+*brief:		上锁返回后，删除边，成功时记入持有的锁。健壮锁的 EOWNERDEAD 也已获得锁
+*input:		vtx：线程顶点；lock：锁资源；mode：DD_HELD_xxx；site：上锁位置；ret：上锁的返回值
+*output:	无
+*return:	ret
+******************************************/
+static inline int become_holder_after_lock(struct vertex* vtx, struct resource_lock* lock, int mode, void* site, int ret)
+{
+    if(vtx->waitting)
+        __atomic_store_n(&vtx->waitting, NULL, __ATOMIC_RELEASE);
+    if(ret == 0 || ret == EOWNERDEAD)
+        held_push(vtx, lock, mode, site);     // 成为其持有者
+    return ret;
 }
 
 /******************************************
-*name：		after_unlock
-*brief:		释放锁后，删除锁资源的拥有者。锁资源无人使用时删除
-*input:		g：有向图；mtx：请求释放锁的ID
+*name：		dereference_before_unlock
+*brief:		释放锁前，从本线程持有的锁中删除。放在释放之后，检测线程可能同时看到新旧两个持有者
+*input:		addr：锁的地址
 *output:	无
 *return:	无
 ******************************************/
-static void after_unlock(struct task_graph* g, pthread_mutex_t* mtx) {
+static inline void dereference_before_unlock(void* addr)
+{
+    struct resource_lock* lock = search_lock(&graph, addr);
+    if(lock)    // 检测初始化前上的锁没有记录
+        held_pop(get_self_vertex(), lock);
+}
 
-    __pthread_mutex_lock(&g->mutex);
+/******************************************
+*name：		pthread_mutex_lock/pthread_mutex_timedlock/pthread_mutex_clocklock
+*brief:		封装后的上锁过程：先检查加锁顺序（DD_MODE_ORDER），再尝试直接获取，不用等待时不需要建立边
+*input:		mutex：需要上锁的ID；clockid、abstime：同原函数
+*output:	无
+*return:	同原函数
+******************************************/
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    void* site = __builtin_return_address(0);
+    struct vertex* vtx;
+    struct resource_lock* lock = lock_enter(mutex, site, 1, &vtx);
 
-    struct resource_lock* lock = search_lock(g, mtx);
-    if(lock == NULL){
-        printf("ERROR: lock NULL in after_unlock...\n");
-        assert(0);
+    int ret = __pthread_mutex_trylock(mutex);
+    if(ret == EBUSY)
+    {
+        add_relation_before_lock(vtx, lock, DD_HELD_EXCL);
+        ret = __pthread_mutex_lock(mutex);
     }
+    return become_holder_after_lock(vtx, lock, DD_HELD_EXCL, site, ret);   //正式拥有当前的锁资源
+}
 
-    dereference_after_unlock(lock);
-    if(lock->used == 0)   // lock 没有使用者就将其释放
-	{
-        struct resource_lock* node = g->lock_list.next;
-        struct resource_lock* prev = &g->lock_list;
-
-		while(node != NULL)
-		{
-            if(node == lock)
-			{
-                prev->next = node->next;
-                free(lock);
-                break;
-            }
+int pthread_mutex_timedlock(pthread_mutex_t* mutex, const struct timespec* abstime)
+{
+    void* site = __builtin_return_address(0);
+    struct vertex* vtx;
+    struct resource_lock* lock = lock_enter(mutex, site, 1, &vtx);
 
-            node = node->next;
-            prev = prev->next;
-        }
+    int ret = __pthread_mutex_trylock(mutex);
+    if(ret == EBUSY)
+    {
+        add_relation_before_lock(vtx, lock, DD_HELD_EXCL);
+        ret = __pthread_mutex_timedlock(mutex, abstime);
     }
+    return become_holder_after_lock(vtx, lock, DD_HELD_EXCL, site, ret);
+}
+
+int pthread_mutex_clocklock(pthread_mutex_t* mutex, clockid_t clockid, const struct timespec* abstime)
+{
+    void* site = __builtin_return_address(0);
+    struct vertex* vtx;
+    struct resource_lock* lock = lock_enter(mutex, site, 1, &vtx);
 
-    __pthread_mutex_unlock(&g->mutex);
+    int ret = __pthread_mutex_trylock(mutex);
+    if(ret == EBUSY)
+    {
+        add_relation_before_lock(vtx, lock, DD_HELD_EXCL);
+        ret = __pthread_mutex_clocklock(mutex, clockid, abstime);
+    }
+    return become_holder_after_lock(vtx, lock, DD_HELD_EXCL, site, ret);
 }
 
 /******************************************
-*name：		pthread_mutex_lock
-*brief:		封装后的上锁过程
+*name：		pthread_mutex_trylock
+*brief:		封装后的尝试上锁：不会阻塞，不建立边、不检查加锁顺序，成功时记入持有的锁
 *input:		mutex：需要上锁的ID
 *output:	无
-*return:	无
+*return:	同原函数
 ******************************************/
-int pthread_mutex_lock(pthread_mutex_t* mutex)
+int pthread_mutex_trylock(pthread_mutex_t* mutex)
 {
-    pthread_t tid = pthread_self();
-    before_lock(&graph, tid, mutex);
-    int ret = __pthread_mutex_lock(mutex);
-    after_lock(&graph, tid, mutex);
-    return ret;
+    void* site = __builtin_return_address(0);
+    struct vertex* vtx;
+    struct resource_lock* lock = lock_enter(mutex, site, 0, &vtx);
+    return become_holder_after_lock(vtx, lock, DD_HELD_EXCL, site, __pthread_mutex_trylock(mutex));
 }
 
 /******************************************
@@ -362,108 +699,336 @@ int pthread_mutex_lock(pthread_mutex_t* mutex)
 ******************************************/
 int pthread_mutex_unlock(pthread_mutex_t* mutex)
 {
-    int ret = __pthread_mutex_unlock(mutex);
-    after_unlock(&graph, mutex);
+    dereference_before_unlock(mutex);
+    return __pthread_mutex_unlock(mutex);
+}
 
-    return ret;
+/******************************************
+*name：		rwlock_lock
+*brief:		读写锁上锁的公共过程，同 pthread_mutex_lock
+*input:		rwlock：读写锁；mode：DD_HELD_SHARED 读锁，DD_HELD_EXCL 写锁；site：上锁位置；
+*           clockid、abstime：timed/clock 版本的参数，abstime 为 NULL 时一直等待
+*output:	无
+*return:	同原函数
+******************************************/
+static int rwlock_lock(pthread_rwlock_t* rwlock, int mode, void* site, int clock, clockid_t clockid, const struct timespec* abstime)
+{
+    struct vertex* vtx;
+    struct resource_lock* lock = lock_enter(rwlock, site, 1, &vtx);
+
+    int ret = mode == DD_HELD_SHARED ? __pthread_rwlock_tryrdlock(rwlock) : __pthread_rwlock_trywrlock(rwlock);
+    if(ret == EBUSY)
+    {
+        add_relation_before_lock(vtx, lock, mode);
+        if(abstime == NULL)
+            ret = mode == DD_HELD_SHARED ? __pthread_rwlock_rdlock(rwlock) : __pthread_rwlock_wrlock(rwlock);
+        else if(clock)
+            ret = mode == DD_HELD_SHARED ? __pthread_rwlock_clockrdlock(rwlock, clockid, abstime) : __pthread_rwlock_clockwrlock(rwlock, clockid, abstime);
+        else
+            ret = mode == DD_HELD_SHARED ? __pthread_rwlock_timedrdlock(rwlock, abstime) : __pthread_rwlock_timedwrlock(rwlock, abstime);
+    }
+    return become_holder_after_lock(vtx, lock, mode, site, ret);
+}
+
+/******************************************
+*name：		pthread_rwlock_rdlock/wrlock/timedrdlock/timedwrlock/clockrdlock/clockwrlock
+*brief:		封装后的读写锁上锁过程
+*input:		rwlock：读写锁；clockid、abstime：同原函数
+*output:	无
+*return:	同原函数
+******************************************/
+int pthread_rwlock_rdlock(pthread_rwlock_t* rwlock)
+{
+    return rwlock_lock(rwlock, DD_HELD_SHARED, __builtin_return_address(0), 0, 0, NULL);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t* rwlock)
+{
+    return rwlock_lock(rwlock, DD_HELD_EXCL, __builtin_return_address(0), 0, 0, NULL);
+}
+
+int pthread_rwlock_timedrdlock(pthread_rwlock_t* rwlock, const struct timespec* abstime)
+{
+    return rwlock_lock(rwlock, DD_HELD_SHARED, __builtin_return_address(0), 0, 0, abstime);
+}
+
+int pthread_rwlock_timedwrlock(pthread_rwlock_t* rwlock, const struct timespec* abstime)
+{
+    return rwlock_lock(rwlock, DD_HELD_EXCL, __builtin_return_address(0), 0, 0, abstime);
+}
+
+int pthread_rwlock_clockrdlock(pthread_rwlock_t* rwlock, clockid_t clockid, const struct timespec* abstime)
+{
+    return rwlock_lock(rwlock, DD_HELD_SHARED, __builtin_return_address(0), 1, clockid, abstime);
+}
+
+int pthread_rwlock_clockwrlock(pthread_rwlock_t* rwlock, clockid_t clockid, const struct timespec* abstime)
+{
+    return rwlock_lock(rwlock, DD_HELD_EXCL, __builtin_return_address(0), 1, clockid, abstime);
+}
+
+/******************************************
+*name：		pthread_rwlock_tryrdlock/trywrlock
+*brief:		封装后的读写锁尝试上锁，同 pthread_mutex_trylock
+*input:		rwlock：读写锁
+*output:	无
+*return:	同原函数
+******************************************/
+int pthread_rwlock_tryrdlock(pthread_rwlock_t* rwlock)
+{
+    void* site = __builtin_return_address(0);
+    struct vertex* vtx;
+    struct resource_lock* lock = lock_enter(rwlock, site, 0, &vtx);
+    return become_holder_after_lock(vtx, lock, DD_HELD_SHARED, site, __pthread_rwlock_tryrdlock(rwlock));
+}
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t* rwlock)
+{
+    void* site = __builtin_return_address(0);
+    struct vertex* vtx;
+    struct resource_lock* lock = lock_enter(rwlock, site, 0, &vtx);
+    return become_holder_after_lock(vtx, lock, DD_HELD_EXCL, site, __pthread_rwlock_trywrlock(rwlock));
 }
 
 /******************************************
-*name：		all_vertex_unvisited
-*brief:		清空所有顶点访问标识
-*input:		vtx：顶点头结点
+*name：		pthread_rwlock_unlock
+*brief:		封装后的读写锁释放过程
+*input:		rwlock：读写锁
 *output:	无
+*return:	同原函数
+******************************************/
+int pthread_rwlock_unlock(pthread_rwlock_t* rwlock)
+{
+    dereference_before_unlock(rwlock);
+    return __pthread_rwlock_unlock(rwlock);
+}
+
+/******************************************
+*name：		pthread_cond_wait/pthread_cond_timedwait/pthread_cond_clockwait
+*brief:		封装后的条件变量等待：等待期间 mutex 已释放，从持有的锁中取出，返回时已重新获得，再记入。
+*           等待通知不是等待锁，不建立边
+*input:		cond：条件变量；mutex：关联的锁；clockid、abstime：同原函数
+*output:	无
+*return:	同原函数
+******************************************/
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    struct resource_lock* lock = search_lock(&graph, mutex);
+    struct vertex* vtx = get_self_vertex();
+    void* site = lock ? held_pop(vtx, lock) : NULL;
+    int ret = __pthread_cond_wait(cond, mutex);
+    if(site)
+        held_push(vtx, lock, DD_HELD_EXCL, site);
+    return ret;
+}
+
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime)
+{
+    struct resource_lock* lock = search_lock(&graph, mutex);
+    struct vertex* vtx = get_self_vertex();
+    void* site = lock ? held_pop(vtx, lock) : NULL;
+    int ret = __pthread_cond_timedwait(cond, mutex, abstime);
+    if(site)
+        held_push(vtx, lock, DD_HELD_EXCL, site);
+    return ret;
+}
+
+int pthread_cond_clockwait(pthread_cond_t* cond, pthread_mutex_t* mutex, clockid_t clockid, const struct timespec* abstime)
+{
+    struct resource_lock* lock = search_lock(&graph, mutex);
+    struct vertex* vtx = get_self_vertex();
+    void* site = lock ? held_pop(vtx, lock) : NULL;
+    int ret = __pthread_cond_clockwait(cond, mutex, clockid, abstime);
+    if(site)
+        held_push(vtx, lock, DD_HELD_EXCL, site);
+    return ret;
+}
+
+//检测线程对一个顶点的快照
+struct vertex_snap
+{
+    struct vertex* vtx;
+    struct resource_lock* wait;
+    int wait_mode;
+    int held_num;
+    struct resource_lock* held[DD_HELD_MAX];
+    int held_mode[DD_HELD_MAX];
+    int state;      // 遍历状态：0 未访问，1 在当前路径上，2 已访问完
+};
+
+/******************************************
+*name：		take_snap
+*brief:		读取一个顶点当前等待和持有的锁
+*input:		vtx：顶点
+*output:	snap：快照
 *return:	无
 ******************************************/
-static void all_vertex_unvisited(struct vertex* vtx)
+static void take_snap(struct vertex* vtx, struct vertex_snap* snap)
 {
-    while(vtx)
-	{
-        vtx->visited = 0;
-        vtx = vtx->next;
+    int i, n = __atomic_load_n(&vtx->held_num, __ATOMIC_ACQUIRE);
+    snap->vtx = vtx;
+    snap->wait = __atomic_load_n(&vtx->waitting, __ATOMIC_ACQUIRE);
+    snap->wait_mode = __atomic_load_n(&vtx->wait_mode, __ATOMIC_RELAXED);
+    snap->held_num = n;
+    for(i = 0; i < n; i++)
+    {
+        snap->held[i] = __atomic_load_n(&vtx->held[i].lock, __ATOMIC_RELAXED);
+        snap->held_mode[i] = __atomic_load_n(&vtx->held[i].mode, __ATOMIC_RELAXED);
     }
+    snap->state = 0;
 }
 
 /******************************************
-*name：		search_cross
-*brief:		判断有向图中某顶点是否有环
-*input:		vtx：起始顶点
+*name：		waits_for
+*brief:		判断 a 是否在等待 b：a 等待的锁被 b 以冲突的方式持有（有一方独占）
+*input:		a、b：顶点快照
 *output:	无
-*return:	起始顶点
+*return:	1 是，0 否
+******************************************/
+static int waits_for(struct vertex_snap* a, struct vertex_snap* b)
+{
+    int i;
+    if(a->wait == NULL)
+        return 0;
+    for(i = 0; i < b->held_num; i++)
+    {
+        if(b->held[i] == a->wait && (a->wait_mode == DD_HELD_EXCL || b->held_mode[i] == DD_HELD_EXCL))
+            return 1;
+    }
+    return 0;
+}
+
+/******************************************
+*name：		search_cross
+*brief:		从某顶点深度优先查找环，当前路径记在 path 中
+*input:		snaps：所有顶点的快照；num：顶点数；cur：当前顶点下标；path：当前路径；depth：路径长度
+*output:	path：找到环时为环上的顶点下标
+*return:	环的长度，没有环返回0
 ******************************************/
-static struct vertex* search_cross(struct vertex* vtx)
+static int search_cross(struct vertex_snap* snaps, int num, int cur, int* path, int depth)
 {
-    do
+    int j, k;
+    snaps[cur].state = 1;
+    path[depth] = cur;
+    for(j = 0; j < num; j++)
     {
-        if(vtx->visited == 1)
-		{  // 重新回到了已访问过的节点，存在环
-            return vtx;
+        if(!waits_for(&snaps[cur], &snaps[j]))
+            continue;
+        if(snaps[j].state == 1)
+        {   // 回到了当前路径上的节点，存在环，把环移到 path 开头
+            for(k = depth; path[k] != j; k--)
+                ;
+            memmove(path, path + k, (depth - k + 1) * sizeof(int));
+            return depth - k + 1;
+        }
+        if(snaps[j].state == 0)
+        {
+            int len = search_cross(snaps, num, j, path, depth + 1);
+            if(len)
+                return len;
         }
-		
-        vtx->visited = 1;
-        vtx = get_wait_vertex(vtx);
-    } while(vtx);
+    }
+    snaps[cur].state = 2;
+    return 0;
+}
 
-    return NULL;    
+/******************************************
+*name：		cycle_stable
+*brief:		重新读取环上的顶点，核对等待关系是否还在，排除各线程并发更新时拼出来的假环
+*input:		snaps：快照；path：环上的顶点下标；len：环的长度
+*output:	无
+*return:	1 环仍然存在，0 已经变化
+******************************************/
+static int cycle_stable(struct vertex_snap* snaps, int* path, int len)
+{
+    struct vertex_snap cur, next;
+    int i;
+    take_snap(snaps[path[0]].vtx, &cur);
+    for(i = 0; i < len; i++)
+    {
+        take_snap(snaps[path[(i + 1) % len]].vtx, &next);
+        if(cur.wait != snaps[path[i]].wait || !waits_for(&cur, &next))
+            return 0;
+        cur = next;
+    }
+    return 1;
 }
 
 /******************************************
 *name：		print_cycle
 *brief:		打印当前有向图中的环
-*input:		cross：环起点
+*input:		snaps：快照；path：环上的顶点下标；len：环的长度
 *output:	无
 *return:	无
 ******************************************/
-static void print_cycle(struct vertex* cross) {
-    struct vertex* vtx = cross;
+static void print_cycle(struct vertex_snap* snaps, int* path, int len) {
     char buf[32];
+    int i;
 
-    do 
+    for(i = 0; i < len; i++)
 	{
-        pthread_getname_np(vtx->tid, buf, 32);
-        printf("%s ---> ", buf);
-        vtx = get_wait_vertex(vtx);
-    } while(vtx && vtx != cross);
-	
-    pthread_getname_np(vtx->tid, buf, 32);
+        pthread_getname_np(snaps[path[i]].vtx->tid, buf, 32);
+        printf("%s%s ---> ", buf, snaps[path[i]].wait_mode == DD_HELD_SHARED ? "(r)" : "");
+    }
+
+    pthread_getname_np(snaps[path[0]].vtx->tid, buf, 32);
     printf("%s\n", buf);
 }
 
 /******************************************
 *name：		detector_routine
-*brief:		循环检查有向图中是否有环（即是否存在死锁）
+*brief:		循环检查有向图中是否有环（即是否存在死锁）。先读取所有在用顶点的快照，再在快照上查找
 *input:		无
 *output:	无
 *return:	无
 ******************************************/
-static void* detector_routine(void* arg) 
+static void* detector_routine(void* arg)
 {
-    struct vertex* vtx;
-    while(1) 
+    struct vertex_snap* snaps = NULL;
+    int* path = NULL;
+    int cap = 0;
+    while(1)
 	{
-        __pthread_mutex_lock(&graph.mutex);
+        struct vertex* vtx;
+        int num = 0, i;
+
+	//1、读取快照，顶点数超过数组大小时扩大
+        for(vtx = __atomic_load_n(&graph.vertex_list, __ATOMIC_ACQUIRE); vtx; vtx = vtx->next)
+        {
+            if(!__atomic_load_n(&vtx->alive, __ATOMIC_ACQUIRE))
+                continue;
+            if(num == cap)
+            {
+                int n = cap ? cap * 2 : 64;
+                struct vertex_snap* s = (struct vertex_snap*)realloc(snaps, n * sizeof(struct vertex_snap));
+                int* p = (int*)realloc(path, n * sizeof(int));
+                if(s)
+                    snaps = s;
+                if(p)
+                    path = p;
+                if(s == NULL || p == NULL)
+                    break;
+                cap = n;
+            }
+            take_snap(vtx, &snaps[num++]);
+        }
 
-        vtx = graph.vertex_list.next;
-        while(vtx) 
+	//2、查找环，隔一段时间边都没变才是死锁
+        for(i = 0; i < num; i++)
 		{
-            all_vertex_unvisited(graph.vertex_list.next);	//重置访问记录
-            struct vertex* cross = search_cross(vtx);	//检查某顶点是否有环
+            if(snaps[i].state)
+                continue;   // 当前已经访问过的节点不需要重新查找
 
-			//1、存在环
-			if(cross) 
+            int len = search_cross(snaps, num, i, path, 0);
+			if(len)
 			{
-                print_cycle(cross);
-                break;
-            }
-
-			//2、不存在环检查下一个顶点。当前已经被标记为 visited 的节点不需要重新查找
-            while(vtx && vtx->visited) 
-			{    
-                vtx = vtx->next;
+                usleep(DD_CONFIRM_USEC);
+                if(cycle_stable(snaps, path, len))
+                    print_cycle(snaps, path, len);
+                break;      // 没有核对上时路径上的节点状态不完整，下一轮再查
             }
         }
-        
-        __pthread_mutex_unlock(&graph.mutex);
+
         sleep(5);
     }
 
@@ -471,33 +1036,75 @@ static void* detector_routine(void* arg)
 }
 
 /******************************************
-*name：		init_detector
-*brief:		初始化死锁检测，创建检测线程
-*input:		无
+*name：		real_function
+*brief:		取被劫持的函数在动态库中的入口
+*input:		name：函数名；version：符号版本，NULL表示默认版本
+*output:	无
+*return:	函数地址，失败返回NULL（glibc 较旧时 clock 版本的函数不存在，程序也不会调用）
+******************************************/
+static void* real_function(const char* name, const char* version)
+{
+    void* func = version ? dlvsym(RTLD_NEXT, name, version) : NULL;
+    if(func == NULL)
+        func = dlsym(RTLD_NEXT, name);
+    if(func == NULL)
+    {
+        printf("dlsym %s error\n", name);
+    }
+    return func;
+}
+
+/******************************************
+*name：		init_detector_ex
+*brief:		按模式初始化死锁检测，DD_MODE_CYCLE 时创建检测线程
+*input:		mode：DD_MODE_xxx 的组合
 *output:	无
 *return:	无
 ******************************************/
-void init_detector() {
+void init_detector_ex(int mode) {
 
-    //劫持动态库中函数的入口
-    __pthread_mutex_lock = dlsym(RTLD_NEXT, "pthread_mutex_lock");
-	if(__pthread_mutex_lock == NULL)
-	{
-		printf("dlsym pthread_mutex_lock error\n");
-	}
-	
-    __pthread_mutex_unlock = dlsym(RTLD_NEXT, "pthread_mutex_unlock");
-	if(__pthread_mutex_lock == NULL)
-	{
-		printf("dlsym pthread_mutex_unlock error\n");
-	}
+    //劫持动态库中函数的入口。条件变量要取新版本（GLIBC_2.3.2），dlsym 取到的是兼容旧程序的版本
+    __pthread_mutex_lock = (pthread_mutex_lock_ptr)real_function("pthread_mutex_lock", NULL);
+    __pthread_mutex_unlock = (pthread_mutex_unlock_ptr)real_function("pthread_mutex_unlock", NULL);
+    __pthread_mutex_trylock = (pthread_mutex_trylock_ptr)real_function("pthread_mutex_trylock", NULL);
+    __pthread_mutex_timedlock = (pthread_mutex_timedlock_ptr)real_function("pthread_mutex_timedlock", NULL);
+    __pthread_mutex_clocklock = (pthread_mutex_clocklock_ptr)real_function("pthread_mutex_clocklock", NULL);
+    __pthread_rwlock_rdlock = (pthread_rwlock_lock_ptr)real_function("pthread_rwlock_rdlock", NULL);
+    __pthread_rwlock_wrlock = (pthread_rwlock_lock_ptr)real_function("pthread_rwlock_wrlock", NULL);
+    __pthread_rwlock_tryrdlock = (pthread_rwlock_lock_ptr)real_function("pthread_rwlock_tryrdlock", NULL);
+    __pthread_rwlock_trywrlock = (pthread_rwlock_lock_ptr)real_function("pthread_rwlock_trywrlock", NULL);
+    __pthread_rwlock_unlock = (pthread_rwlock_lock_ptr)real_function("pthread_rwlock_unlock", NULL);
+    __pthread_rwlock_timedrdlock = (pthread_rwlock_timedlock_ptr)real_function("pthread_rwlock_timedrdlock", NULL);
+    __pthread_rwlock_timedwrlock = (pthread_rwlock_timedlock_ptr)real_function("pthread_rwlock_timedwrlock", NULL);
+    __pthread_rwlock_clockrdlock = (pthread_rwlock_clocklock_ptr)real_function("pthread_rwlock_clockrdlock", NULL);
+    __pthread_rwlock_clockwrlock = (pthread_rwlock_clocklock_ptr)real_function("pthread_rwlock_clockwrlock", NULL);
+    __pthread_cond_wait = (pthread_cond_wait_ptr)real_function("pthread_cond_wait", "GLIBC_2.3.2");
+    __pthread_cond_timedwait = (pthread_cond_timedwait_ptr)real_function("pthread_cond_timedwait", "GLIBC_2.3.2");
+    __pthread_cond_clockwait = (pthread_cond_clockwait_ptr)real_function("pthread_cond_clockwait", NULL);
 
+    int i;
     memset(&graph, 0, sizeof(struct task_graph));
-    pthread_mutex_init(&graph.mutex, NULL);
-
-    pthread_t tid;
-    pthread_create(&tid, NULL, detector_routine, NULL);
-    pthread_detach(tid);
+    for(i = 0; i < DD_SHARD_NUM; i++)
+        pthread_mutex_init(&graph.shards[i].mutex, NULL);
+    pthread_mutex_init(&graph.order_mutex, NULL);
+    pthread_key_create(&graph.key, release_vertex);
+    graph.mode = mode;
 
+    if(mode & DD_MODE_CYCLE)
+    {
+        pthread_t tid;
+        pthread_create(&tid, NULL, detector_routine, NULL);
+        pthread_detach(tid);
+    }
 }
 
+/******************************************
+*name：		init_detector
+*brief:		初始化死锁检测，创建检测线程
+*input:		无
+*output:	无
+*return:	无
+******************************************/
+void init_detector() {
+    init_detector_ex(DD_MODE_CYCLE);
+}
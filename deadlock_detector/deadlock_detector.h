@@ -1,9 +1,28 @@
 #ifndef __DEADLOCK_DET_H__
 #define __DEADLOCK_DET_H__
+#ifndef _GNU_SOURCE
 #define _GNU_SOURCE
+#endif
 #include <pthread.h>
 
-int pthread_mutex_lock(pthread_mutex_t* mutex);
-int pthread_mutex_unlock(pthread_mutex_t* mutex);
+/*
+ * 劫持（在本文件中重新定义）的函数，声明见 pthread.h：
+ * pthread_mutex_lock/trylock/timedlock/clocklock/unlock
+ * pthread_rwlock_rdlock/wrlock/tryrdlock/trywrlock/timedrdlock/timedwrlock/clockrdlock/clockwrlock/unlock
+ * pthread_cond_wait/timedwait/clockwait
+ */
+
+#define DD_MODE_CYCLE 1     // 检测线程定期查找等待图中的环（已经发生的死锁）
+#define DD_MODE_ORDER 2     // 记录加锁顺序，第一次出现反序时报告（可能的死锁）
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void init_detector();
+void init_detector_ex(int mode);
+
+#ifdef __cplusplus
+}
+#endif
 #endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "MemPool.h"
 #include <stdio.h>
 #include <errno.h>
+#include <sys/mman.h>
 
 /******************************************
 *name：		init_a_new_block
@@ -16,6 +17,12 @@ static inline void init_a_new_block(MP_POOL* pool, MP_BLOCK* newblock)
     newblock->failed_time = 0;
     newblock->start_of_rest = (ADDR)newblock + sizeof(MP_BLOCK);
     newblock->end_of_block = newblock->start_of_rest + pool->block_size;
+    newblock->free_list = NULL;
+    newblock->class_prev = NULL;
+    newblock->class_next = NULL;
+    newblock->size_class = -1;
+    newblock->piece_size = 0;
+    newblock->undo = -1;
 }
 
 /******************************************
@@ -30,6 +37,266 @@ static inline size_t rest_block_space(MP_BLOCK* block)
     return block->end_of_block - block->start_of_rest;
 }
 
+/******************************************
+*name：		space_unlink
+*brief:		bump模式下把 block 移出所在的剩余空间档
+*input:		pool：池对象；block：block
+*output:	无
+*return:	无
+******************************************/
+static inline void space_unlink(MP_POOL* pool, MP_BLOCK* block)
+{
+    int k = block->size_class;
+    if(k < 0)
+        return;
+
+    if(block->class_prev)
+        block->class_prev->class_next = block->class_next;
+    else
+        pool->space_lists[k] = block->class_next;
+    if(block->class_next)
+        block->class_next->class_prev = block->class_prev;
+    if(pool->space_lists[k] == NULL)
+        pool->space_bitmap &= ~(1u << k);
+    block->class_prev = block->class_next = NULL;
+    block->size_class = -1;
+}
+
+/******************************************
+*name：		space_index
+*brief:		bump模式下按 block 当前剩余空间把它放到对应的档：剩余 [2^k, 2^(k+1)) 的在第 k 档，
+*           放不下最小一片的不进任何档
+*input:		pool：池对象；block：block
+*output:	无
+*return:	无
+******************************************/
+static void space_index(MP_POOL* pool, MP_BLOCK* block)
+{
+    size_t rest = rest_block_space(block);
+    int k = rest >= sizeof(MP_PIECE) + sizeof(void*) ? 63 - __builtin_clzl(rest) : -1;
+    if(k == block->size_class)
+        return;
+
+    space_unlink(pool, block);
+    if(k < 0)
+        return;
+
+    block->class_prev = NULL;
+    block->class_next = pool->space_lists[k];
+    if(block->class_next)
+        block->class_next->class_prev = block;
+    pool->space_lists[k] = block;
+    pool->space_bitmap |= 1u << k;
+    block->size_class = k;
+}
+
+/******************************************
+*name：		space_find
+*brief:		bump模式下找一个剩余空间够 size 的 block：先试 size 所在档的第一个 block，
+*           不够再从位图中取第一个更高的非空档，那一档的任何 block 都够用
+*input:		pool：池对象；size：片的实际大小
+*output:	无
+*return:	block，没有返回NULL
+******************************************/
+static MP_BLOCK* space_find(MP_POOL* pool, size_t size)
+{
+    int k = 63 - __builtin_clzl(size);
+    MP_BLOCK* block;
+
+    if(k >= MP_SPACE_CLASS_NUM)
+        return NULL;
+
+    block = pool->space_lists[k];
+    if(block)
+    {
+        if(rest_block_space(block) >= size)
+            return block;
+        block->failed_time++;
+        pool->stats.failed_fits++;
+    }
+
+    uint32_t bits = pool->space_bitmap & ~((2u << k) - 1);     // 高于第 k 档的非空档
+    if(bits == 0)
+        return NULL;
+    return pool->space_lists[__builtin_ctz(bits)];
+}
+
+
+/******************************************
+*name：		region_map
+*brief:		映射一块新区域：按配置先试 MAP_HUGETLB，失败则普通映射并按大页对齐，再 madvise(MADV_HUGEPAGE)
+*input:		pool：池对象
+*output:	无
+*return:	区域，失败返回NULL
+******************************************/
+static MP_REGION* region_map(MP_POOL* pool)
+{
+    MP_REGION* region = malloc(sizeof(MP_REGION));
+    size_t size = pool->region_size;
+    ADDR base = MAP_FAILED;
+    int huge = pool->huge_page;
+
+    if(region == NULL)
+        return NULL;
+
+    if(huge == MP_HUGE_TLB)
+    {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(base == MAP_FAILED)
+            huge = MP_HUGE_MADVISE;     // 系统没有预留大页，退回透明大页
+    }
+
+    if(base == MAP_FAILED)
+    {
+        //多映射一个大页的长度，截掉首尾使区域按大页对齐，透明大页才能整页映射
+        size_t len = size + MP_HUGE_PAGE_SIZE;
+        ADDR raw = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(raw == MAP_FAILED)
+        {
+            free(region);
+            log("[%d]mmap error[%d].\n", __LINE__, errno);
+            return NULL;
+        }
+        base = (ADDR)(((uintptr_t)raw + MP_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(MP_HUGE_PAGE_SIZE - 1));
+        if(base > raw)
+            munmap(raw, base - raw);
+        if(raw + len > base + size)
+            munmap(base + size, raw + len - (base + size));
+        if(huge == MP_HUGE_MADVISE && madvise(base, size, MADV_HUGEPAGE))
+            huge = MP_HUGE_NONE;        // 内核不支持透明大页
+    }
+
+    region->base = base;
+    region->size = size;
+    region->carve = base;
+    region->busy = 0;
+    region->huge = huge;
+    region->next = pool->regions;
+    pool->regions = region;
+    pool->region_maps++;
+    return region;
+}
+
+/******************************************
+*name：		region_carve
+*brief:		从当前区域切出一个 block，当前区域用完则复用一块空闲区域或映射新区域
+*input:		pool：池对象
+*output:	无
+*return:	block（未初始化），失败返回NULL
+******************************************/
+static MP_BLOCK* region_carve(MP_POOL* pool)
+{
+    size_t stride = (sizeof(MP_BLOCK) + pool->block_size + MP_MEM_ALIGN - 1) & ~(size_t)(MP_MEM_ALIGN - 1);
+    MP_REGION* region = pool->carve_region;
+
+    if(region == NULL || region->carve + stride > region->base + region->size)
+    {
+        for(region = pool->regions; region; region = region->next)
+        {
+            if(region->carve == region->base)
+                break;
+        }
+        if(region == NULL)
+            region = region_map(pool);
+        if(region == NULL)
+            return NULL;
+        pool->carve_region = region;
+    }
+
+    MP_BLOCK* block = (MP_BLOCK*)region->carve;
+    region->carve += stride;
+    block->region = region;
+    return block;
+}
+
+/******************************************
+*name：		region_release
+*brief:		区域中的 block 全部空闲：从 block 链表中摘掉这些 block，MADV_DONTNEED 归还物理内存，区域留待复用
+*input:		pool：池对象；region：区域
+*output:	无
+*return:	无
+******************************************/
+static void region_release(MP_POOL* pool, MP_REGION* region)
+{
+    if(region == pool->carve_region)
+        return;     // 正在切分的区域保留，避免一片内存反复申请释放时反复映射
+    if(pool->mark_depth)
+        return;     // 检查点期间 block 的撤销记录还要用，回到最外层时再归还
+
+	//1、摘掉 block 链表中属于这个区域的 block，第一个 block 跟在池描述符后，不会属于任何区域
+    MP_BLOCK* prev = pool->first_block;
+    MP_BLOCK* block = prev->next;
+    while(block)
+    {
+        if(block->region == region)
+        {
+            prev->next = block->next;
+            if(pool->mode == MP_MODE_BUMP)
+                space_unlink(pool, block);
+            pool->stats.block_num--;
+            pool->stats.block_bytes -= pool->block_size;
+            pool->stats.empty_block_num--;      // 区域空闲时其中的 block 都已清空
+        }
+        else
+        {
+            prev = block;
+        }
+        block = block->next;
+    }
+    pool->current_block = prev;
+
+    MP_BLOCK** pp = &pool->empty_blocks;
+    while(*pp)
+    {
+        if((*pp)->region == region)
+            *pp = (*pp)->class_next;
+        else
+            pp = &(*pp)->class_next;
+    }
+
+	//2、归还物理内存，虚拟地址保留，下次切 block 时缺页再分配（清零的）物理页
+    madvise(region->base, region->size, MADV_DONTNEED);
+    region->carve = region->base;
+    pool->region_releases++;
+}
+
+/******************************************
+*name：		block_ref/block_unref
+*brief:		增减 block 引用，同时维护所在区域中在用的 block 数
+*input:		block：block
+*output:	无
+*return:	block_unref：1 表示所在区域的 block 全部空闲了
+******************************************/
+static inline void block_ref(MP_BLOCK* block)
+{
+    if(block->ref_counter++ == 0 && block->region)
+        block->region->busy++;
+}
+
+static inline int block_unref(MP_BLOCK* block)
+{
+    return --block->ref_counter == 0 && block->region && --block->region->busy == 0;
+}
+
+/******************************************
+*name：		piece_head/piece_block
+*brief:		片头的大小（header_free 的池为0）；片所在的 block，header_free 的池由数据区地址去掉低位得到。
+*           没有片头时 MP_PIECE* 只是“数据区地址减去片头大小”，不能访问 piece->block
+*input:		pool：池对象；piece：片
+*output:	无
+*return:	片头大小 / block
+******************************************/
+static inline size_t piece_head(MP_POOL* pool)
+{
+    return pool->block_mask ? 0 : sizeof(MP_PIECE);
+}
+
+static inline MP_BLOCK* piece_block(MP_POOL* pool, MP_PIECE* piece)
+{
+    if(pool->block_mask)
+        return (MP_BLOCK*)((uintptr_t)piece->data & ~pool->block_mask);
+    return piece->block;
+}
 
 /******************************************
 *name：		malloc_a_block
@@ -41,22 +308,83 @@ static inline size_t rest_block_space(MP_BLOCK* block)
 static MP_BLOCK* malloc_a_block(MP_POOL* pool)
 {
     MP_BLOCK* newblock;
-    int ret = posix_memalign((void**)&newblock, MP_MEM_ALIGN, pool->block_size + sizeof(MP_BLOCK));
-    if(ret)
+    if(pool->backing == MP_BACKING_MMAP)
     {
-        log("[%d]posix_memalign error[%d].\n", __LINE__, errno);
-        return NULL;
+        newblock = region_carve(pool);
+        if(newblock == NULL)
+            return NULL;
+    }
+    else
+    {
+        size_t align = pool->block_mask ? pool->block_mask + 1 : MP_MEM_ALIGN;
+        int ret = posix_memalign((void**)&newblock, align, pool->block_size + sizeof(MP_BLOCK));
+        if(ret)
+        {
+            log("[%d]posix_memalign error[%d].\n", __LINE__, errno);
+            return NULL;
+        }
+        newblock->region = NULL;
     }
     init_a_new_block(pool, newblock);
 
 	//新block加入到pool的block链表末尾
-    MP_BLOCK* block = pool->current_block;  // 从 current_block 开始找链表尾部就行
-    while(block->next) block = block->next;
-    block->next = newblock;     
+    pool->current_block->next = newblock;
+    pool->current_block = newblock;
+    pool->stats.block_num++;
+    pool->stats.empty_block_num++;
+    pool->stats.block_bytes += pool->block_size;
+    pool->stats.new_blocks++;
     
     return newblock;
 }
 
+/******************************************
+*name：		mark_touch
+*brief:		检查点之后第一次从 block 切片，记下它当前的状态
+*input:		pool：池对象；block：block
+*output:	无
+*return:	0 成功，-1 记录空间申请失败
+******************************************/
+static int mark_touch(MP_POOL* pool, MP_BLOCK* block)
+{
+    if(pool->undo_num == pool->undo_cap)
+    {
+        int cap = pool->undo_cap ? pool->undo_cap * 2 : 64;
+        MP_UNDO* undo = realloc(pool->undo, cap * sizeof(MP_UNDO));
+        if(undo == NULL)
+        {
+            log("[%d]realloc error[%d].\n", __LINE__, errno);
+            return -1;
+        }
+        pool->undo = undo;
+        pool->undo_cap = cap;
+    }
+
+    MP_UNDO* u = &pool->undo[pool->undo_num];
+    u->block = block;
+    u->start_of_rest = block->start_of_rest;
+    u->ref_counter = block->ref_counter;
+    u->pre_freed = 0;
+    u->prev = block->undo;
+    block->undo = pool->undo_num++;
+    return 0;
+}
+
+/******************************************
+*name：		mark_note_free
+*brief:		检查点期间释放有撤销记录的 block 中的片：片在哪些检查点之前切出，就在那些记录上计数。
+*           外层记录的 start_of_rest 不大于内层（有记录的 block 不会被清空），从内往外找到第一个不满足的即可停
+*input:		pool：池对象；block：片所在 block；addr：片的数据区地址（检查点之后切出的片数据区不低于记录的 start_of_rest）
+*output:	无
+*return:	无
+******************************************/
+static void mark_note_free(MP_POOL* pool, MP_BLOCK* block, ADDR addr)
+{
+    int i;
+    for(i = block->undo; i >= 0 && addr < pool->undo[i].start_of_rest; i = pool->undo[i].prev)
+        pool->undo[i].pre_freed++;
+}
+
 /******************************************
 *name：		malloc_a_piece
 *brief:		从池中某block分配一片内存
@@ -66,118 +394,199 @@ static MP_BLOCK* malloc_a_block(MP_POOL* pool)
 ******************************************/
 static ADDR malloc_a_piece(MP_POOL* pool, size_t size)
 {
-    MP_BLOCK* block = pool->current_block;
-    size_t real_piece_size = size + sizeof(MP_PIECE);
+    // 片按指针大小对齐，片头和其中的描述符（bucket描述符也是一片）地址最低位都为0，MP_BUCKET_TAG 才能区分
+    size_t head = piece_head(pool);
+    size_t real_piece_size = (size + head + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
 
-	//1、尝试找到一个剩余空间足够的block
-    while(block)
+	//1、从剩余空间索引中找一个够用的 block（按对齐最多要补 align - 8 字节），没有就新建一个
+    MP_BLOCK* block = space_find(pool, real_piece_size + pool->align - MP_MIN_ALIGN);
+    if(block == NULL)
     {
-    	//找到了
-        if(rest_block_space(block) >= real_piece_size)
-        {   
-            MP_PIECE* piece = (MP_PIECE*)block->start_of_rest;
-            block->start_of_rest += real_piece_size;
-            block->ref_counter++;
-            piece->block = block;
-            return (ADDR)piece->data;
-        }
-
-        // 对于申请失败的 block，增加其失败次数
-        block->failed_time++;
-        if(block->failed_time >= MP_MAX_BLOCK_FAIL_TIME)
-            pool->current_block = block->next;    // 如果当前这个 block的失败次数太多了，就放弃这个 block，下一次从其后面开始遍历
-        
-        block = block->next;
+        block = malloc_a_block(pool);
+        if(block == NULL)
+            return NULL;
     }
-	
-    //2、没找到，那就新建一个 block
-    block = malloc_a_block(pool);
+
+	//2、检查点之后第一次从这个 block 切片，先记下它的状态
+    if(pool->mark_depth && block->undo < pool->marks[pool->mark_depth - 1].undo_base && mark_touch(pool, block))
+        return NULL;
+
+	//3、切一片，数据区按池的对齐，前面补的空间跟着这一片，block 的剩余空间变小，重新归档
+    ADDR data = (ADDR)(((uintptr_t)block->start_of_rest + head + pool->align - 1) & ~(uintptr_t)(pool->align - 1));
+    if(block->start_of_rest == (ADDR)block + sizeof(MP_BLOCK))
+        pool->stats.empty_block_num--;
+    pool->stats.used_bytes += data - head + real_piece_size - block->start_of_rest;
+    pool->stats.piece_num++;
+    block->start_of_rest = data - head + real_piece_size;
+    block_ref(block);
+    if(head)
+        ((MP_PIECE*)(data - head))->block = block;
+    space_index(pool, block);
+    return data;
+}
+
+/******************************************
+*name：		slab_link/slab_unlink
+*brief:		把 block 加入/移出所属 class 的 partial 链表
+*input:		c：size class；block：block
+*output:	无
+*return:	无
+******************************************/
+static inline void slab_link(MP_SLAB_CLASS* c, MP_BLOCK* block)
+{
+    block->class_prev = NULL;
+    block->class_next = c->partial;
+    if(c->partial)
+        c->partial->class_prev = block;
+    c->partial = block;
+}
+
+static inline void slab_unlink(MP_SLAB_CLASS* c, MP_BLOCK* block)
+{
+    if(block->class_prev)
+        block->class_prev->class_next = block->class_next;
+    else
+        c->partial = block->class_next;
+    if(block->class_next)
+        block->class_next->class_prev = block->class_prev;
+    block->class_prev = block->class_next = NULL;
+}
+
+/******************************************
+*name：		slab_block_full
+*brief:		block 是否已经没有可分配的片（此时它不在 partial 链表中）
+*input:		block：block
+*output:	无
+*return:	1 已满；0 未满
+******************************************/
+static inline int slab_block_full(MP_BLOCK* block)
+{
+    return block->free_list == NULL && rest_block_space(block) < (size_t)block->piece_size;
+}
+
+/******************************************
+*name：		slab_release_block
+*brief:		block 中的片全部释放了，重置后挂到空闲 block 链表，任何 class 都可以再用
+*input:		pool：池对象；block：block
+*output:	无
+*return:	无
+******************************************/
+static void slab_release_block(MP_POOL* pool, MP_BLOCK* block)
+{
+    MP_BLOCK* next = block->next;
+    init_a_new_block(pool, block);
+    block->next = next;
+    block->class_next = pool->empty_blocks;
+    pool->empty_blocks = block;
+    pool->stats.empty_block_num++;
+}
+
+/******************************************
+*name：		slab_get_block
+*brief:		为某个 class 取一个 block：优先用空闲 block，没有则新建，然后挂到该 class 的 partial 链表
+*input:		pool：池对象；cls：class 下标
+*output:	无
+*return:	block，失败返回NULL
+******************************************/
+static MP_BLOCK* slab_get_block(MP_POOL* pool, int cls)
+{
+    MP_BLOCK* block = pool->empty_blocks;
     if(block)
     {
-        MP_PIECE* piece = (MP_PIECE*)block->start_of_rest;
-        block->start_of_rest += real_piece_size;
-        block->ref_counter++;
-        piece->block = block;
-        return (ADDR)piece->data;
+        pool->empty_blocks = block->class_next;
     }
-    else 
-        return NULL;
+    else
+    {
+        block = malloc_a_block(pool);
+        if(block == NULL)
+            return NULL;
+    }
+    pool->stats.empty_block_num--;
+
+	//片大小取整到池的对齐，第一片的数据区对齐，之后每片就都是对齐的
+    block->size_class = cls;
+    size_t head = piece_head(pool);
+    block->piece_size = (pool->classes[cls].size + head + pool->align - 1) & ~(pool->align - 1);
+    block->start_of_rest = (ADDR)(((uintptr_t)block->start_of_rest + head + pool->align - 1) & ~(uintptr_t)(pool->align - 1)) - head;
+    block->free_list = NULL;
+    slab_link(&pool->classes[cls], block);
+    return block;
 }
 
 /******************************************
-*name：		malloc_a_bucket
-*brief:		需要分配的内存大于block最大值，另外申请
-*input:		pool：池对象；size：分配大小
+*name：		slab_malloc
+*brief:		slab模式下分配一片：先用 block 中释放过的片，再从 block 剩余空间顺序切
+*input:		pool：池对象；size：分配大小，不超过 MP_SLAB_MAX_SIZE
 *output:	无
 *return:	分配完成的内存的起始地址
 ******************************************/
-static ADDR malloc_a_bucket(MP_POOL* pool, size_t size)
+static ADDR slab_malloc(MP_POOL* pool, size_t size)
 {
-    MP_BUCKET* bucket = pool->first_bucket; 
-    MP_BUCKET* prev_bucket = bucket;
+    int cls = mp_slab_class_of(size);
+    MP_SLAB_CLASS* c = &pool->classes[cls];
+    MP_BLOCK* block = c->partial;
+    MP_PIECE* piece;
 
-	//1、当前所有bucket中尝试找一个可用描述符
-    while(bucket) 
-    {    
-        prev_bucket = bucket;
-        if(bucket->start_of_bucket == NULL)
-            break;  // bucket 描述符是可以复用的，因此找到一个已经被释放掉的 bucket就可以直接用它的描述符
-        bucket = bucket->next;
+    if(block == NULL)
+    {
+        block = slab_get_block(pool, cls);
+        if(block == NULL)
+            return NULL;
     }
 
-	//2、如果所有 bucket描述符当前都在使用，那就再从 block中申请一个新的 bucket 描述符
-    if(bucket == NULL)
-    {   
-        bucket = (MP_BUCKET*)malloc_a_piece(pool, sizeof(MP_BUCKET));  
-        if(bucket == NULL)
-        {
-            return NULL;
-        }
-		
-        //该bucket所在的 block引用由 malloc_a_piece增加，此处不需要处理
-        bucket->still_in_use = 0;
-        if(prev_bucket) // 将新 bucket插到链表末尾
-            prev_bucket->next = bucket;
-        else            // prev_bucket 为 NULL说明这是链表的第一个节点
-            pool->first_bucket = bucket;
+    if(block->free_list)
+    {
+        piece = block->free_list;
+        block->free_list = *(void**)piece->data;    // piece->block 在释放时保持不变
     }
     else
-    {   // 如果是复用之前的 bucket 描述符，则将其所在的 block 引用增加
-        MP_PIECE *piece = (MP_PIECE *)((ADDR)bucket - sizeof(MP_PIECE));
-        piece->block->ref_counter++;
-    }
-
-	//3、bucket描述符绑定新分配好的内存
-    int ret = posix_memalign((void**)&bucket->start_of_bucket, MP_MEM_ALIGN, size);
-    if(ret)
     {
-        MP_PIECE *piece = (MP_PIECE *)((ADDR)bucket - sizeof(MP_PIECE));
-        piece->block->ref_counter--;   // 出错则不能增加 block引用
-        log("[%d]posix_memalign error[%d].\n", __LINE__, errno);
-        return NULL;
+        size_t head = piece_head(pool);
+        piece = (MP_PIECE*)(block->start_of_rest + head - sizeof(MP_PIECE));
+        block->start_of_rest += block->piece_size;
+        if(head)
+            piece->block = block;
     }
 
-    bucket->still_in_use = 1;
-    return bucket->start_of_bucket;
+    block_ref(block);
+    pool->stats.used_bytes += block->piece_size;
+    pool->stats.piece_num++;
+    if(slab_block_full(block))
+        slab_unlink(c, block);
+    return (ADDR)piece->data;
 }
 
 /******************************************
-*name：		find_bucket_with_addr
-*brief:		根据bucket内存起始地址，查找该bucket描述符
-*input:		pool：池对象；addr：bucket内存起始地址
+*name：		slab_free
+*brief:		slab模式下释放一片，挂回所在 block 的空闲链表
+*input:		pool：池对象；piece：片
 *output:	无
-*return:	bucket*
+*return:	无
 ******************************************/
-static MP_BUCKET* find_bucket_with_addr(MP_POOL* pool, ADDR addr)
+static void slab_free(MP_POOL* pool, MP_PIECE* piece)
 {
-    MP_BUCKET* bucket = pool->first_bucket;
-    while(bucket)
+    MP_BLOCK* block = piece_block(pool, piece);
+    MP_SLAB_CLASS* c = &pool->classes[block->size_class];
+    int was_full = slab_block_full(block);
+
+    *(void**)piece->data = block->free_list;
+    block->free_list = piece;
+    int idle = block_unref(block);
+    pool->stats.used_bytes -= block->piece_size;
+    pool->stats.piece_num--;
+
+    if(block->ref_counter == 0 && pool->auto_clear)
     {
-        if(bucket->start_of_bucket == addr)
-            return bucket;
-        bucket = bucket->next;
+        if(!was_full)
+            slab_unlink(c, block);
+        slab_release_block(pool, block);
+        if(idle)
+            region_release(pool, block->region);
+    }
+    else if(was_full)
+    {
+        slab_link(c, block);
     }
-    return NULL;
 }
 
 /******************************************
@@ -213,62 +622,306 @@ static void clear_block(MP_POOL* pool, MP_BLOCK* block)
     if(block->ref_counter > 0)
         return;
 
-    //2、清空 block前先确保其中bucket描述符的内存都释放了
-    MP_BUCKET* bucket = pool->first_bucket;
-    MP_BUCKET* prev_bucket = bucket;
-    while(bucket)
+    //2、恢复 block 参数。block 中的 bucket 描述符都已随 bucket 释放，引用归零时不会再有在用的描述符
+    ADDR begin = (ADDR)block + sizeof(MP_BLOCK);
+    if(block->start_of_rest != begin)
     {
-        MP_PIECE *piece = (MP_PIECE *)((ADDR)bucket - sizeof(MP_PIECE));
-        if(piece->block == block)   // 找出属于这个 block的 bucket确保其独立内存释放掉
-        {
-            if(bucket->start_of_bucket)
-            {
-                free(bucket->start_of_bucket);
-                bucket->start_of_bucket = NULL;
-            }
-            //删除 bucket 要注意相应的调整 bucket 链表
-            if(bucket == pool->first_bucket)
-            {
-                pool->first_bucket = bucket->next;
-                prev_bucket = pool->first_bucket;
-            }
-            else
-            {
-                prev_bucket->next = bucket->next;
-            }
-        }
-        else
+        pool->stats.used_bytes -= block->start_of_rest - begin;
+        pool->stats.empty_block_num++;
+    }
+    block->ref_counter = 0;
+    block->failed_time = 0;
+    block->start_of_rest = begin;
+    space_index(pool, block);   // 整块可用，回到最高的档
+}
+
+/******************************************
+*name：		mark_settle
+*brief:		撤销记录弹出后补做检查点期间跳过的清理：没有记录的空 block 清空，回到最外层时归还空闲的区域
+*input:		pool：池对象；from/to：弹出的记录下标范围 [from, to)
+*output:	无
+*return:	无
+******************************************/
+static void mark_settle(MP_POOL* pool, int from, int to)
+{
+    int i;
+    if(!pool->auto_clear)
+        return;
+
+    for(i = from; i < to; i++)
+    {
+        if(pool->undo[i].block->undo < 0)
+            clear_block(pool, pool->undo[i].block);
+    }
+
+    if(pool->mark_depth)
+        return;
+    for(i = from; i < to; i++)
+    {
+        MP_REGION* region = pool->undo[i].block->region;
+        if(region && region->busy == 0 && region->carve != region->base)     // 已归还的区域 carve 回到 base
+            region_release(pool, region);
+    }
+}
+
+/******************************************
+*name：		free_a_piece
+*brief:		释放一片：slab模式挂回 block 空闲链表，bump模式减少 block 引用，自动清理时引用归零则清空 block
+*input:		pool：池对象；piece：片
+*output:	无
+*return:	无
+******************************************/
+static void free_a_piece(MP_POOL* pool, MP_PIECE* piece)
+{
+    if(pool->mode == MP_MODE_SLAB)
+    {
+        slab_free(pool, piece);
+        return;
+    }
+
+    MP_BLOCK* block = piece_block(pool, piece);
+    int idle = block_unref(block);
+    pool->stats.piece_num--;
+    if(block->undo >= 0)
+    {
+        mark_note_free(pool, block, piece->data);   // 有撤销记录的 block 不清空，切片位置要留给回滚
+        return;
+    }
+    if(pool->auto_clear)
+    {
+        clear_block(pool, block);
+        if(idle)
+            region_release(pool, block->region);
+    }
+}
+
+/******************************************
+*name：		bucket_cache_class_of
+*brief:		计算 bucket 内存（含头部）所属的缓存档：不超过4KB为第0档，之后每个2的幂区间分4档
+*input:		size：内存大小，不超过 MP_BUCKET_CACHE_MAX_SIZE
+*output:	无
+*return:	档下标
+******************************************/
+static inline int bucket_cache_class_of(size_t size)
+{
+    if(size <= MP_PAGE_SIZE)
+        return 0;
+
+    int shift = 63 - __builtin_clzl(size - 1);  // size 落在 (2^shift, 2^(shift+1)]
+    return (shift - 12) * 4 + (int)((size - 1) >> (shift - 2)) - 4 + 1;
+}
+
+/******************************************
+*name：		bucket_cache_class_size
+*brief:		bucket_cache_class_of 的反函数，计算档的内存大小
+*input:		cls：档下标
+*output:	无
+*return:	该档的内存大小
+******************************************/
+static inline size_t bucket_cache_class_size(int cls)
+{
+    if(cls == 0)
+        return MP_PAGE_SIZE;
+    return (size_t)(4 + (cls - 1) % 4 + 1) << (10 + (cls - 1) / 4);
+}
+
+/******************************************
+*name：		bucket_mem_get
+*brief:		申请 bucket 的独立内存：可缓存的大小向上取到档的大小，优先从该档的缓存中取
+*input:		pool：池对象；size：内存大小（含头部）
+*output:	cls：内存所属的缓存档，-1表示不缓存
+*return:	内存地址，失败返回NULL
+******************************************/
+static ADDR bucket_mem_get(MP_POOL* pool, size_t size, int* cls)
+{
+    ADDR mem;
+
+	//1、关闭缓存或者太大，直接申请
+    *cls = -1;
+    if(pool->bucket_cache_max && size <= MP_BUCKET_CACHE_MAX_SIZE)
+    {
+        *cls = bucket_cache_class_of(size);
+        size = bucket_cache_class_size(*cls);
+
+	//2、命中缓存
+        mem = pool->bucket_cache[*cls];
+        if(mem)
         {
-            prev_bucket = bucket;
+            pool->bucket_cache[*cls] = *(void**)mem;
+            if(pool->bucket_cache[*cls] == NULL)
+                pool->bucket_cache_bitmap &= ~(1ULL << *cls);
+            pool->bucket_cache_bytes -= size;
+            pool->bucket_cache_hits++;
+            return mem;
         }
-        bucket = bucket->next;
+        pool->bucket_cache_misses++;
     }
 
-    //3、恢复 block 参数
-    block->ref_counter = 0;
-    block->failed_time = 0;
-    block->start_of_rest = (ADDR)block + sizeof(MP_BLOCK);
-    pool->current_block = pool->first_block;    // 一定要将 current_block 也复位，否则可能导致后面一直不会用到这个 block
+	//3、向系统申请
+    int ret = posix_memalign((void**)&mem, pool->block_mask ? pool->block_mask + 1 : MP_MAX_ALIGN, size);
+    if(ret)
+    {
+        log("[%d]posix_memalign error[%d].\n", __LINE__, ret);
+        return NULL;
+    }
+    return mem;
 }
 
 /******************************************
-*name：		mp_create_pool
-*brief:		创建线程池
-*input:		size：指定池内存块大小；auto_clear：是否自动清理内存
+*name：		bucket_mem_put
+*brief:		归还 bucket 的独立内存：放进所属档的缓存，缓存总量超过上限时从大档开始释放
+*input:		pool：池对象；mem：内存地址；cls：所属缓存档，-1直接释放
 *output:	无
-*return:	返回线程池对象
+*return:	无
 ******************************************/
-MP_POOL* mp_create_pool(size_t size, int auto_clear)
+static void bucket_mem_put(MP_POOL* pool, ADDR mem, int cls)
+{
+    if(cls < 0)
+    {
+        free(mem);
+        return;
+    }
+
+    *(void**)mem = pool->bucket_cache[cls];
+    pool->bucket_cache[cls] = mem;
+    pool->bucket_cache_bitmap |= 1ULL << cls;
+    pool->bucket_cache_bytes += bucket_cache_class_size(cls);
+    if(pool->bucket_cache_bytes > pool->bucket_cache_max)
+        mp_trim_bucket_cache(pool, pool->bucket_cache_max);
+}
+
+/******************************************
+*name：		bucket_mem_size
+*brief:		bucket 实际占用的独立内存大小（含头部，可缓存的按档取整）
+*input:		bucket：bucket描述符
+*output:	无
+*return:	大小
+******************************************/
+static inline size_t bucket_mem_size(MP_BUCKET* bucket)
+{
+    return bucket->cache_class >= 0 ? bucket_cache_class_size(bucket->cache_class) : bucket->size + MP_BUCKET_HEAD;
+}
+
+/******************************************
+*name：		malloc_a_bucket
+*brief:		需要分配的内存大于block最大值，另外申请
+*input:		pool：池对象；size：分配大小
+*output:	无
+*return:	分配完成的内存的起始地址
+******************************************/
+static ADDR malloc_a_bucket(MP_POOL* pool, size_t size)
 {
-    if(size < MP_MIN_BLK_SZIE) 
-	{
-		return NULL;
+	//1、从 block 中申请 bucket 描述符，描述符随 bucket 一起释放（所在 block 的引用也由它增减）
+    MP_BUCKET* bucket;
+    if(pool->mode == MP_MODE_SLAB)
+        bucket = (MP_BUCKET*)slab_malloc(pool, sizeof(MP_BUCKET));
+    else
+        bucket = (MP_BUCKET*)malloc_a_piece(pool, sizeof(MP_BUCKET));
+    if(bucket == NULL)
+        return NULL;
+
+	//2、分配独立内存，数据区前预留 MP_BUCKET_HEAD 字节，紧挨数据区的一个字记录描述符地址并置 MP_BUCKET_TAG
+    ADDR mem = bucket_mem_get(pool, size + MP_BUCKET_HEAD, &bucket->cache_class);
+    if(mem == NULL)
+    {
+        free_a_piece(pool, (MP_PIECE *)((ADDR)bucket - sizeof(MP_PIECE)));
+        return NULL;
     }
+    bucket->start_of_bucket = mem + MP_BUCKET_HEAD;
+    *(uintptr_t*)(bucket->start_of_bucket - sizeof(uintptr_t)) = (uintptr_t)bucket | MP_BUCKET_TAG;
+    bucket->still_in_use = 1;
+    bucket->seq = pool->bucket_seq++;
+    bucket->size = size;
+    pool->stats.bucket_num++;
+    pool->stats.bucket_bytes += size;
+    pool->stats.bucket_mem_bytes += bucket_mem_size(bucket);
 
-	//1、分配空间
+	//3、插到 bucket 链表头部
+    bucket->prev = NULL;
+    bucket->next = pool->first_bucket;
+    if(pool->first_bucket)
+        pool->first_bucket->prev = bucket;
+    pool->first_bucket = bucket;
+
+    return bucket->start_of_bucket;
+}
+
+/******************************************
+*name：		free_a_bucket
+*brief:		归还 bucket 的独立内存（进缓存或直接释放），描述符移出链表并作为一片释放
+*input:		pool：池对象；bucket：bucket描述符
+*output:	无
+*return:	无
+******************************************/
+static void free_a_bucket(MP_POOL* pool, MP_BUCKET* bucket)
+{
+    if(bucket->prev)
+        bucket->prev->next = bucket->next;
+    else
+        pool->first_bucket = bucket->next;
+    if(bucket->next)
+        bucket->next->prev = bucket->prev;
+
+    pool->stats.bucket_num--;
+    pool->stats.bucket_bytes -= bucket->size;
+    pool->stats.bucket_mem_bytes -= bucket_mem_size(bucket);
+    bucket_mem_put(pool, bucket->start_of_bucket - MP_BUCKET_HEAD, bucket->cache_class);
+    bucket->start_of_bucket = NULL;
+    bucket->still_in_use = 0;
+    free_a_piece(pool, (MP_PIECE *)((ADDR)bucket - sizeof(MP_PIECE)));
+}
+
+/******************************************
+*name：		mp_config_init
+*brief:		填充默认配置：bump模式，block大小 MP_PAGE_SIZE，自动清理，block 用 posix_memalign 申请
+*input:		cfg：配置
+*output:	cfg：默认配置
+*return:	无
+******************************************/
+void mp_config_init(MP_CONFIG* cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->block_size = MP_PAGE_SIZE;
+    cfg->auto_clear = 1;
+    cfg->mode = MP_MODE_BUMP;
+    cfg->backing = MP_BACKING_MALLOC;
+    cfg->huge_page = MP_HUGE_NONE;
+    cfg->region_size = MP_REGION_SIZE;
+    cfg->bucket_cache_max = MP_BUCKET_CACHE_DEFAULT;
+    cfg->align = MP_MIN_ALIGN;
+}
+
+/******************************************
+*name：		mp_create_pool_ex
+*brief:		按配置创建内存池
+*input:		cfg：配置
+*output:	无
+*return:	返回内存池对象
+******************************************/
+MP_POOL* mp_create_pool_ex(const MP_CONFIG* cfg)
+{
+    size_t block_size;
+    int i;
+
+    if(cfg->mode == MP_MODE_SLAB)
+        block_size = cfg->block_size > MP_SLAB_BLOCK_SIZE ? cfg->block_size : MP_SLAB_BLOCK_SIZE;
+    else if(cfg->mode == MP_MODE_BUMP && cfg->block_size >= MP_MIN_BLK_SZIE)
+        block_size = cfg->block_size;
+    else
+        return NULL;
+    if(block_size > MP_MAX_BLOCK_SIZE)
+        block_size = MP_MAX_BLOCK_SIZE;
+    if(cfg->align < MP_MIN_ALIGN || cfg->align > MP_MAX_ALIGN || (cfg->align & (cfg->align - 1)))
+        return NULL;
+    if(cfg->header_free && (block_size & (block_size - 1)))
+        return NULL;    // 没有片头时靠地址掩码找 block，block（连同描述符）必须是2的幂大小并按大小对齐
+
+	//1、分配空间，第一个 block 的描述符和可分配内存都跟在池描述符后；没有片头时它不按大小对齐，只留描述符
     MP_POOL* pool;
-    size_t block_size = size < MP_PAGE_SIZE ? size : MP_PAGE_SIZE;
-	size_t real_size = sizeof(MP_POOL) + block_size;
+    uintptr_t block_mask = cfg->header_free ? block_size - 1 : 0;
+    if(block_mask)
+        block_size -= sizeof(MP_BLOCK);
+    size_t real_size = sizeof(MP_POOL) + sizeof(MP_BLOCK) + (block_mask ? 0 : block_size);
     int ret = posix_memalign((void**)&pool, MP_MEM_ALIGN, real_size);
     if(ret)
     {
@@ -278,15 +931,74 @@ MP_POOL* mp_create_pool(size_t size, int auto_clear)
 
 	//2、初始化池
     pool->block_size = block_size;
-    pool->auto_clear = auto_clear;
+    pool->auto_clear = cfg->auto_clear;
+    pool->mode = cfg->mode;
+    pool->align = cfg->align;
+    pool->block_mask = block_mask;
     pool->first_bucket = NULL;
     pool->current_block = pool->first_block;  // first_block是柔性数组，不需要赋值，实际已经指向正确的位置
+    pool->empty_blocks = NULL;
+    for(i = 0; i < MP_SLAB_CLASS_NUM; i++)
+    {
+        pool->classes[i].size = mp_slab_class_size(i);
+        pool->classes[i].partial = NULL;
+    }
+    for(i = 0; i < MP_SPACE_CLASS_NUM; i++)
+        pool->space_lists[i] = NULL;
+    pool->space_bitmap = 0;
+    pool->backing = cfg->backing;
+    pool->huge_page = cfg->huge_page;
+    pool->region_size = cfg->region_size > block_size + sizeof(MP_BLOCK) + MP_MEM_ALIGN ? cfg->region_size : block_size + sizeof(MP_BLOCK) + MP_MEM_ALIGN;
+    pool->region_size = (pool->region_size + MP_HUGE_PAGE_SIZE - 1) & ~(size_t)(MP_HUGE_PAGE_SIZE - 1);
+    pool->regions = NULL;
+    pool->carve_region = NULL;
+    pool->region_maps = 0;
+    pool->region_releases = 0;
+    pool->bucket_cache_max = cfg->bucket_cache_max;
+    pool->bucket_cache_bytes = 0;
+    for(i = 0; i < MP_BUCKET_CACHE_CLASS_NUM; i++)
+        pool->bucket_cache[i] = NULL;
+    pool->bucket_cache_bitmap = 0;
+    pool->bucket_cache_hits = 0;
+    pool->bucket_cache_misses = 0;
+    pool->bucket_seq = 0;
+    pool->mark_depth = 0;
+    pool->undo = NULL;
+    pool->undo_num = 0;
+    pool->undo_cap = 0;
+    memset(&pool->stats, 0, sizeof(pool->stats));
+    pool->stats.block_num = 1;
+    pool->stats.empty_block_num = block_mask ? 0 : 1;
+    pool->stats.block_bytes = block_mask ? 0 : block_size;
 
-	//3、初始化第一个块
+	//3、初始化第一个块，slab模式下它先作为空闲 block；没有片头时它没有可分配的空间，只作为链表头
     init_a_new_block(pool, pool->first_block);
+    pool->first_block->region = NULL;
+    if(block_mask)
+        pool->first_block->end_of_block = pool->first_block->start_of_rest;
+    else if(pool->mode == MP_MODE_SLAB)
+        pool->empty_blocks = pool->first_block;
+    else
+        space_index(pool, pool->first_block);
     return pool;
 }
 
+/******************************************
+*name：		mp_create_pool
+*brief:		创建bump模式的内存池
+*input:		size：指定池内存块大小；auto_clear：是否自动清理内存
+*output:	无
+*return:	返回内存池对象
+******************************************/
+MP_POOL* mp_create_pool(size_t size, int auto_clear)
+{
+    MP_CONFIG cfg;
+    mp_config_init(&cfg);
+    cfg.block_size = size < MP_PAGE_SIZE ? size : MP_PAGE_SIZE;
+    cfg.auto_clear = auto_clear;
+    return mp_create_pool_ex(&cfg);
+}
+
 /******************************************
 *name：		mp_destroy_pool
 *brief:		释放整个池空间
@@ -297,17 +1009,41 @@ MP_POOL* mp_create_pool(size_t size, int auto_clear)
 void mp_destroy_pool(MP_POOL* pool)
 {
     mp_reset_pool(pool);
+    mp_trim_bucket_cache(pool, 0);
+    free(pool->undo);
     MP_BLOCK* block = pool->first_block->next;  // 从第二个 block 开始释放内存！ 第一个比较特殊
     MP_BLOCK* prev_block = block;
     while (block)
     {
         prev_block = block;
         block = block->next;
-        free(prev_block);
+        if(prev_block->region == NULL)  // 区域中的 block 随区域一起解除映射
+            free(prev_block);
+    }
+    while(pool->regions)
+    {
+        MP_REGION* region = pool->regions;
+        pool->regions = region->next;
+        munmap(region->base, region->size);
+        free(region);
     }
     free(pool); // 释放池的描述符空间以及第一个初始 block
 }
 
+/******************************************
+*name：		use_bucket
+*brief:		分配是否要用 bucket：slab模式超过最大的 class，bump模式加上片头和对齐补齐放不进一个 block
+*input:		pool：池对象；size：分配大小
+*output:	无
+*return:	1 用 bucket；0 从 block 分配
+******************************************/
+static inline int use_bucket(MP_POOL* pool, size_t size)
+{
+    if(pool->mode == MP_MODE_SLAB)
+        return size > MP_SLAB_MAX_SIZE;
+    return size > pool->block_size - piece_head(pool) - (pool->align - MP_MIN_ALIGN);
+}
+
 /******************************************
 *name：		mp_malloc
 *brief:		从内存池中分配内存
@@ -319,15 +1055,40 @@ void* mp_malloc(MP_POOL* pool, size_t size)
 {
     if(size <= 0 || pool == NULL) return NULL;
 
-	//若小于等于block大小，从block分配
-    if(size <= pool->block_size)
-    {
-        return malloc_a_piece(pool, size);
-    }
-    else 	//需要使用bucket
-    {
+    int k = size <= 16 ? 0 : 64 - __builtin_clzl(size - 1) - 4;
+    pool->stats.size_hist[k < MP_STATS_HIST_NUM ? k : MP_STATS_HIST_NUM - 1]++;
+    pool->stats.malloc_count++;
+
+    if(use_bucket(pool, size))     //需要使用bucket
         return malloc_a_bucket(pool, size);
-    }
+    return pool->mode == MP_MODE_SLAB ? slab_malloc(pool, size) : malloc_a_piece(pool, size);
+}
+
+/******************************************
+*name：		mp_malloc_aligned
+*brief:		按指定对齐分配。不超过池的对齐直接 mp_malloc；否则多申请 align - 8 字节，在片内取对齐的地址，
+*           它前面的一个字记录片原来的地址并置 MP_ALIGN_TAG，mp_free 据此找回原来的片。
+*           header_free 的池用 bucket，最大 MP_MAX_ALIGN
+*input:		pool：池对象；size：分配大小；align：对齐，2的幂
+*output:	无
+*return:	分配完成的内存的起始地址，align 不是2的幂（或 header_free 的池超过 MP_MAX_ALIGN）返回NULL
+******************************************/
+void* mp_malloc_aligned(MP_POOL* pool, size_t size, size_t align)
+{
+    if(pool == NULL || align == 0 || (align & (align - 1)))
+        return NULL;
+    if(align <= pool->align || (align <= MP_MAX_ALIGN && use_bucket(pool, size)))
+        return mp_malloc(pool, size);     // 池的对齐已经够了，或者走 bucket（按 MP_MAX_ALIGN 对齐）
+    if(pool->block_mask)
+        return align <= MP_MAX_ALIGN ? malloc_a_bucket(pool, size) : NULL;  // 没有片头就放不下 MP_ALIGN_TAG
+
+	//片至少按 MP_MIN_ALIGN 对齐，没对齐时到下一个对齐地址至少差8字节，放得下标记
+    ADDR mem = mp_malloc(pool, size + align - MP_MIN_ALIGN);
+    if(mem == NULL || ((uintptr_t)mem & (align - 1)) == 0)
+        return mem;
+    ADDR data = (ADDR)(((uintptr_t)mem + align - 1) & ~(uintptr_t)(align - 1));
+    *(uintptr_t*)(data - sizeof(uintptr_t)) = (uintptr_t)mem | MP_ALIGN_TAG;
+    return data;
 }
 
 /******************************************
@@ -342,35 +1103,28 @@ void mp_free(MP_POOL* pool, void* addr)
     if(pool == NULL || addr == NULL)
         return ;
 
-    MP_BLOCK* block = NULL;
-    MP_BUCKET* bucket = find_bucket_with_addr(pool, addr);
+    pool->stats.free_count++;
 
-	//1、先看一下这个地址是不是一个 bucket
-    if(bucket)  // 这个地址是 bucket
+	//没有片头的池：地址低位不落在 block 描述符上的是片，bucket 的数据区在描述符范围内
+    _Static_assert(MP_BUCKET_HEAD < sizeof(MP_BLOCK), "bucket data must fall inside MP_BLOCK");
+    if(pool->block_mask && ((uintptr_t)addr & pool->block_mask) >= sizeof(MP_BLOCK))
     {
-        #ifdef MP_ALLWAYS_FREE_BUCKET   // 每次清理 bucket时都将其独立内存空间释放，这里可能可以做优化
-        free(bucket->start_of_bucket);
-        bucket->start_of_bucket = NULL;
-        #endif
-        bucket->still_in_use = 0;
-        MP_PIECE *piece = (MP_PIECE *)((ADDR)bucket - sizeof(MP_PIECE));
-        block = piece->block;
+        free_a_piece(pool, (MP_PIECE *)((ADDR)addr - sizeof(MP_PIECE)));
+        return;
     }
-    else    // 如果这个地址不是 bucket， 则什么都不需要处理, 找出它所在的 block就行了
+
+	//分配地址前一个字：片为所在 block 的地址，bucket 为描述符地址并置 MP_BUCKET_TAG，不需要查找；
+	//mp_malloc_aligned 在片内对齐的为原来的地址并置 MP_ALIGN_TAG，先换回原来的地址
+    uintptr_t tag = *(uintptr_t*)((ADDR)addr - sizeof(uintptr_t));
+    if(tag & MP_ALIGN_TAG)
     {
-        MP_PIECE *piece = (MP_PIECE *)(addr - sizeof(MP_PIECE));
-        block = piece->block;
+        addr = (void*)(tag & ~(uintptr_t)MP_ALIGN_TAG);
+        tag = *(uintptr_t*)((ADDR)addr - sizeof(uintptr_t));
     }
-
-	//2、减少block引用计数
-    if(block)
-        block->ref_counter--; 
+    if(tag & MP_BUCKET_TAG)
+        free_a_bucket(pool, (MP_BUCKET*)(tag & ~(uintptr_t)MP_BUCKET_TAG));
     else
-        return ; // 这个地址没有对应的内存块
-
-    // 如果启用了自动清理内存池，则在适当的条件下执行清理操作
-    if(pool->auto_clear)
-        clear_block(pool, block);
+        free_a_piece(pool, (MP_PIECE *)((ADDR)addr - sizeof(MP_PIECE)));
 }
 
 /******************************************
@@ -385,31 +1139,241 @@ void mp_reset_pool(MP_POOL* pool)
     if(pool == NULL)
         return;
     
-    //1、释放掉所有 bucket 的空间
+    //1、归还所有 bucket 的空间
     MP_BUCKET* bucket = pool->first_bucket;
     while(bucket)
     {
-        if(bucket->start_of_bucket)
-        {
-            free(bucket->start_of_bucket);
-            bucket->start_of_bucket = NULL;
-        }
-        
+        bucket_mem_put(pool, bucket->start_of_bucket - MP_BUCKET_HEAD, bucket->cache_class);
+        bucket->start_of_bucket = NULL;
         bucket = bucket->next;
     }
     pool->first_bucket = NULL;
+    pool->stats.bucket_num = 0;
+    pool->stats.bucket_bytes = 0;
+    pool->stats.bucket_mem_bytes = 0;
 
-	//2、重置各block
+	//2、重置各block，slab模式下全部回到空闲 block 链表
     MP_BLOCK* block = pool->first_block;
+    MP_BLOCK* last = block;
+    MP_REGION* region;
+    int i;
+    for(region = pool->regions; region; region = region->next)
+        region->busy = 0;
+    pool->empty_blocks = NULL;
+    for(i = 0; i < MP_SLAB_CLASS_NUM; i++)
+        pool->classes[i].partial = NULL;
+    for(i = 0; i < MP_SPACE_CLASS_NUM; i++)
+        pool->space_lists[i] = NULL;
+    pool->space_bitmap = 0;
     while(block)
     {
-        block->ref_counter = 0;
-        block->failed_time = 0;
-        block->start_of_rest = (ADDR)block + sizeof(MP_BLOCK);
-        block = block->next;
+        MP_BLOCK* next = block->next;
+        if(pool->block_mask && block == pool->first_block)
+        {
+            ;   // 没有片头时第一个块没有可分配的空间
+        }
+        else if(pool->mode == MP_MODE_SLAB)
+        {
+            slab_release_block(pool, block);
+        }
+        else
+        {
+            block->ref_counter = 0;
+            block->failed_time = 0;
+            block->start_of_rest = (ADDR)block + sizeof(MP_BLOCK);
+            block->class_prev = block->class_next = NULL;
+            block->size_class = -1;
+            block->undo = -1;
+            space_index(pool, block);
+        }
+        last = block;
+        block = next;
+    }
+
+    pool->current_block = last;
+    pool->mark_depth = 0;
+    pool->undo_num = 0;
+    pool->stats.empty_block_num = pool->stats.block_num - (pool->block_mask ? 1 : 0);
+    pool->stats.used_bytes = 0;
+    pool->stats.piece_num = 0;
+}
+
+/******************************************
+*name：		mp_get_stats
+*brief:		读取池的统计，计数都是增量维护的，这里只计算派生的字段，O(1)
+*input:		pool：池对象
+*output:	stats：统计
+*return:	无
+******************************************/
+void mp_get_stats(MP_POOL* pool, MP_STATS* stats)
+{
+    if(pool == NULL || stats == NULL)
+        return;
+
+    *stats = pool->stats;
+    stats->bucket_cache_bytes = pool->bucket_cache_bytes;
+    stats->footprint = sizeof(MP_POOL) + stats->block_num * (sizeof(MP_BLOCK) + pool->block_size)
+        + stats->bucket_mem_bytes + stats->bucket_cache_bytes - (pool->block_mask ? pool->block_size : 0);
+    stats->free_bytes = stats->block_bytes - stats->used_bytes;
+    stats->fragmentation = stats->free_bytes ? 1.0 - (double)stats->empty_block_num * pool->block_size / stats->free_bytes : 0;
+}
+
+/******************************************
+*name：		mp_stats_json
+*brief:		把统计格式化为一行 JSON，用法同 snprintf
+*input:		stats：mp_get_stats 读出的统计；buf/size：输出缓冲区
+*output:	buf：JSON 字符串
+*return:	完整输出需要的长度（不含结尾的0），不小于 size 表示被截断
+******************************************/
+int mp_stats_json(const MP_STATS* stats, char* buf, size_t size)
+{
+    int len = snprintf(buf, size,
+        "{\"footprint\":%lu,\"block_num\":%ld,\"empty_block_num\":%ld,\"block_bytes\":%lu,"
+        "\"used_bytes\":%lu,\"free_bytes\":%lu,\"tail_bytes_per_block\":%lu,\"fragmentation\":%.4f,"
+        "\"piece_num\":%ld,\"bucket_num\":%ld,\"bucket_bytes\":%lu,\"bucket_mem_bytes\":%lu,\"bucket_cache_bytes\":%lu,"
+        "\"malloc_count\":%ld,\"free_count\":%ld,\"failed_fits\":%ld,\"new_blocks\":%ld,\"size_hist\":[",
+        stats->footprint, stats->block_num, stats->empty_block_num, stats->block_bytes,
+        stats->used_bytes, stats->free_bytes, stats->block_num ? stats->free_bytes / stats->block_num : 0, stats->fragmentation,
+        stats->piece_num, stats->bucket_num, stats->bucket_bytes, stats->bucket_mem_bytes, stats->bucket_cache_bytes,
+        stats->malloc_count, stats->free_count, stats->failed_fits, stats->new_blocks);
+    int i;
+    for(i = 0; i < MP_STATS_HIST_NUM; i++)
+        len += snprintf(buf + (len < (int)size ? len : (int)size), len < (int)size ? size - len : 0,
+            i ? ",%ld" : "%ld", stats->size_hist[i]);
+    len += snprintf(buf + (len < (int)size ? len : (int)size), len < (int)size ? size - len : 0, "]}");
+    return len;
+}
+
+/******************************************
+*name：		mp_mark
+*brief:		bump模式下设置一个检查点，之后的分配可以用 mp_rollback 一次撤销，检查点可以嵌套
+*input:		pool：池对象
+*output:	无
+*return:	检查点（从1开始的层数），slab模式或嵌套太深返回-1
+******************************************/
+int mp_mark(MP_POOL* pool)
+{
+    if(pool == NULL || pool->mode != MP_MODE_BUMP || pool->mark_depth == MP_MARK_MAX_DEPTH)
+        return -1;
+
+    pool->marks[pool->mark_depth].undo_base = pool->undo_num;
+    pool->marks[pool->mark_depth].bucket_seq = pool->bucket_seq;
+    return ++pool->mark_depth;
+}
+
+/******************************************
+*name：		mp_rollback
+*brief:		回滚到检查点：释放之后申请的 bucket，之后切过片的 block 恢复到检查点时的位置，
+*           检查点和它里面嵌套的检查点都被移除。耗时只和检查点之后用到的 block、bucket 数有关。
+*           检查点之后申请的内存回滚后都不能再使用；之前申请的片在检查点期间可以正常释放。
+*           检查点之后新增的 block 留在链表中复用
+*input:		pool：池对象；mark：mp_mark 的返回值
+*output:	无
+*return:	无
+******************************************/
+void mp_rollback(MP_POOL* pool, int mark)
+{
+    if(pool == NULL || mark < 1 || mark > pool->mark_depth)
+        return;
+
+	//1、释放检查点之后的 bucket，bucket 插在链表头，序号从头往后递减
+    long seq = pool->marks[mark - 1].bucket_seq;
+    while(pool->first_bucket && pool->first_bucket->seq >= seq)
+        free_a_bucket(pool, pool->first_bucket);
+
+	//2、倒序弹出撤销记录，恢复 block 的切片位置和引用
+    int base = pool->marks[mark - 1].undo_base;
+    int end = pool->undo_num;
+    int i;
+    for(i = end - 1; i >= base; i--)
+    {
+        MP_UNDO* u = &pool->undo[i];
+        MP_BLOCK* block = u->block;
+        int ref = u->ref_counter - u->pre_freed;
+        if(block->ref_counter > 0 && ref == 0 && block->region)
+            block->region->busy--;
+        if(u->start_of_rest == (ADDR)block + sizeof(MP_BLOCK) && block->start_of_rest != u->start_of_rest)
+            pool->stats.empty_block_num++;
+        pool->stats.used_bytes -= block->start_of_rest - u->start_of_rest;
+        pool->stats.piece_num -= block->ref_counter - ref;
+        block->ref_counter = ref;
+        block->start_of_rest = u->start_of_rest;
+        block->undo = u->prev;
+        space_index(pool, block);
     }
+    pool->undo_num = base;
+    pool->mark_depth = mark - 1;
 
-    pool->current_block = pool->first_block;
+	//3、补做检查点期间跳过的清理
+    mark_settle(pool, base, end);
+}
+
+/******************************************
+*name：		mp_unmark
+*brief:		移除检查点（和它里面嵌套的检查点）但保留之后的分配，撤销记录并入外层检查点
+*input:		pool：池对象；mark：mp_mark 的返回值
+*output:	无
+*return:	无
+******************************************/
+void mp_unmark(MP_POOL* pool, int mark)
+{
+    if(pool == NULL || mark < 1 || mark > pool->mark_depth)
+        return;
+
+    int base = pool->marks[mark - 1].undo_base;
+    int end = pool->undo_num;
+    int i, j;
+    pool->mark_depth = mark - 1;
+
+	//1、已是最外层：记录全部丢弃，补做清理
+    if(pool->mark_depth == 0)
+    {
+        for(i = base; i < end; i++)
+            pool->undo[i].block->undo = -1;
+        pool->undo_num = 0;
+        mark_settle(pool, base, end);
+        return;
+    }
+
+	//2、外层检查点已有记录的 block 丢掉这一条（外层记录的释放计数一直在累加），否则把记录移到外层
+    int outer = pool->marks[mark - 2].undo_base;
+    for(i = j = base; i < end; i++)
+    {
+        MP_UNDO* u = &pool->undo[i];
+        if(u->prev >= outer)
+        {
+            if(u->prev < base)
+                u->block->undo = u->prev;   // prev 在 [base, end) 中时 block->undo 已经指向移动后的记录
+            continue;
+        }
+        pool->undo[j] = *u;
+        u->block->undo = j++;
+    }
+    pool->undo_num = j;
+}
+
+/******************************************
+*name：		mp_trim_bucket_cache
+*brief:		释放缓存的 bucket 内存，从最大的档开始，直到缓存总量不超过 keep
+*input:		pool：池对象；keep：保留的缓存总量，0表示全部释放
+*output:	无
+*return:	无
+******************************************/
+void mp_trim_bucket_cache(MP_POOL* pool, size_t keep)
+{
+    if(pool == NULL)
+        return;
+
+    while(pool->bucket_cache_bytes > keep)
+    {
+        int cls = 63 - __builtin_clzll(pool->bucket_cache_bitmap);
+        void* mem = pool->bucket_cache[cls];
+        pool->bucket_cache[cls] = *(void**)mem;
+        if(pool->bucket_cache[cls] == NULL)
+            pool->bucket_cache_bitmap &= ~(1ULL << cls);
+        pool->bucket_cache_bytes -= bucket_cache_class_size(cls);
+        free(mem);
+    }
 }
 
 /******************************************
@@ -435,9 +1399,34 @@ void mp_pool_statistic(MP_POOL* pool)
     }
 
 	printf("###################################################\n");
+	printf("# mode: %s\n", pool->mode == MP_MODE_SLAB ? "slab" : "bump");
 	printf("# block size: %lu\n", pool->block_size);
     printf("# block(s) num: %d\n", bnum);
     printf("# block current: %d\n", currnum);
+    if(pool->backing == MP_BACKING_MMAP)
+    {
+        int rnum = 0, rbusy = 0, rhuge = 0;
+        MP_REGION* region;
+        for(region = pool->regions; region; region = region->next)
+        {
+            rnum++;
+            if(region->busy)
+                rbusy++;
+            if(region->huge != MP_HUGE_NONE)
+                rhuge++;
+        }
+        printf("# region(s) num: %d, busy: %d, huge page: %d, size: %lu\n", rnum, rbusy, rhuge, pool->region_size);
+        printf("# region maps: %ld, releases: %ld\n", pool->region_maps, pool->region_releases);
+    }
+    MP_STATS stats;
+    mp_get_stats(pool, &stats);
+    printf("# used: %lu, free: %lu, fragmentation: %.2f, pieces: %ld, buckets: %ld (%lu bytes)\n", stats.used_bytes,
+        stats.free_bytes, stats.fragmentation, stats.piece_num, stats.bucket_num, stats.bucket_bytes);
+    if(pool->bucket_cache_max)
+    {
+        printf("# bucket cache: %lu/%lu bytes, hits: %ld, misses: %ld\n", pool->bucket_cache_bytes,
+            pool->bucket_cache_max, pool->bucket_cache_hits, pool->bucket_cache_misses);
+    }
 	printf("-------------------------------\n");
 
     block = pool->first_block;
@@ -450,6 +1439,9 @@ void mp_pool_statistic(MP_POOL* pool)
             printf(" *\n");
         else
             printf("\n");
+        if(pool->mode == MP_MODE_SLAB)
+            printf("size class: %d (%d)\n", block->size_class,
+                block->size_class >= 0 ? (int)pool->classes[block->size_class].size : 0);
         printf("space used: %ld\n", block->start_of_rest - ((ADDR)block + sizeof(MP_BLOCK)));
         printf("space free: %lu\n", rest_block_space(block));
 
@@ -459,7 +1451,7 @@ void mp_pool_statistic(MP_POOL* pool)
         while(bucket)
         {
             MP_PIECE *piece = (MP_PIECE *)((ADDR)bucket - sizeof(MP_PIECE));
-            if(piece->block == block)
+            if(piece_block(pool, piece) == block)
             {
                 bucket_in_this_block++;
                 if(bucket->still_in_use)
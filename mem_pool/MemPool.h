@@ -2,8 +2,7 @@
 #define __MEMPOOL_H__
 #include <string.h>
 #include <stdlib.h>
-
-#define MP_ALLWAYS_FREE_BUCKET
+#include <stdint.h>
 
 #ifndef _NO_PRINT
 #define log printf
@@ -11,19 +10,78 @@
 #define log(x)
 #endif
 
-#define MP_PAGE_SIZE (4 * 1024) // 页大小4k，不要让用户设置的 block大小超过这个值
+#define MP_PAGE_SIZE (4 * 1024) // 页大小4k，mp_create_pool 的 block大小不超过这个值
 #define MP_MIN_BLK_SZIE 128     // 一个块过小失去意义
 #define MP_MEM_ALIGN 32
-#define MP_MAX_BLOCK_FAIL_TIME 4
+#define MP_MIN_ALIGN 8          // mp_malloc 返回地址默认的对齐（片头是一个指针）
+#define MP_MAX_ALIGN 64         // 池的默认对齐最大可以设到 cache line，更大的对齐用 mp_malloc_aligned
+#define MP_MAX_BLOCK_SIZE (1024 * 1024)     // mp_create_pool_ex 允许的最大 block
+#define MP_SPACE_CLASS_NUM 21               // bump模式下按剩余空间 [2^k, 2^(k+1)) 分档，k 最大到 MP_MAX_BLOCK_SIZE 的20
+
+#define MP_BACKING_MALLOC 0     // 每个 block 用 posix_memalign 单独申请（默认）
+#define MP_BACKING_MMAP 1       // block 从 mmap 的大区域中连续切出，区域中的 block 全部空闲时 MADV_DONTNEED 归还物理内存
+
+#define MP_HUGE_NONE 0
+#define MP_HUGE_MADVISE 1       // madvise(MADV_HUGEPAGE)，由透明大页合并，区域按大页对齐
+#define MP_HUGE_TLB 2           // MAP_HUGETLB，需要系统预留大页，映射失败则退回 MP_HUGE_MADVISE
+
+#define MP_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define MP_REGION_SIZE (2 * 1024 * 1024)   // mmap 区域的默认大小，向上取整到大页
+
+//header_free 的池中片没有片头：block 按自身大小对齐，片所在的 block 由地址去掉低位得到；
+//bucket 的独立内存同样按 block 大小对齐，数据区落在 MP_BLOCK 描述符的位置，地址低位小于 sizeof(MP_BLOCK) 即为 bucket
+
+//每次分配返回地址的前一个字标明它属于谁：片为 MP_PIECE.block（对齐的指针，最低位为0），
+//bucket 为描述符地址最低位置1。mp_free 据此直接区分，不需要遍历 bucket 链表
+//mp_malloc_aligned 在片内对齐时返回地址前一个字为片原来的地址并置 MP_ALIGN_TAG
+#define MP_BUCKET_TAG 1
+#define MP_ALIGN_TAG 2
+#define MP_BUCKET_HEAD MP_MAX_ALIGN     // bucket 独立内存前预留的头部，保持数据区按 MP_MAX_ALIGN 对齐
+
+//释放的 bucket 内存按大小分档缓存，下次申请相近大小时直接复用，不再 free/posix_memalign
+#define MP_BUCKET_CACHE_MAX_SIZE (4 * 1024 * 1024)  // 超过这个大小（含头部）的 bucket 内存不缓存
+#define MP_BUCKET_CACHE_CLASS_NUM 41                // 4KB一档，之后每个2的幂区间分4档，直到 MP_BUCKET_CACHE_MAX_SIZE
+#define MP_BUCKET_CACHE_DEFAULT (4 * 1024 * 1024)   // 默认缓存总量上限
+
+#define MP_MODE_BUMP 0          // block内顺序分配，block引用计数归零时整块回收（默认）
+#define MP_MODE_SLAB 1          // 按 size class 分配，释放的片立即可被同 class 复用
+
+#define MP_SLAB_BLOCK_SIZE (32 * 1024)  // slab模式下的block大小，最大的 class 每块也能放下15片
+#define MP_SLAB_MAX_SIZE 2048           // slab模式下 size class 覆盖的最大分配，更大的用 bucket
+#define MP_SLAB_CLASS_NUM 24            // 16~128每16一档，之后每个2的幂区间分4档
+
+#define MP_MARK_MAX_DEPTH 16            // bump模式下检查点最多嵌套的层数
+
+#define MP_STATS_HIST_NUM 16            // 分配大小分布：第0档 1~16，第 k 档 (2^(k+3), 2^(k+4)]，最后一档包括更大的
 
 typedef unsigned char* ADDR;
 
+struct _MP_REGION {         // mmap 后备时的一块映射区域，block 从中顺序切出
+    struct _MP_REGION* next;
+    ADDR base;
+    size_t size;
+    ADDR carve;             // 下一个 block 从这里切，等于 base 表示区域空闲（物理内存已归还或从未使用）
+    int busy;               // 区域中有片在使用的 block 数，归零时归还物理内存
+    int huge;               // 实际生效的大页方式 MP_HUGE_xxx
+};
+typedef struct _MP_REGION MP_REGION;
+
 struct _MP_BLOCK {
     struct _MP_BLOCK* next;	// block的next指针，链起pool中所有block
     ADDR start_of_rest;     // 当前 block剩余空间的起始地址
     ADDR end_of_block;      // 当前 block的最后一个地址加1
-    int failed_time;        // 这个 block被申请内存时出现失败的次数
+    int failed_time;        // 这个 block被申请内存时出现失败的次数（bump模式下按剩余空间档试探它但不够用）
     int ref_counter;        // 引用计数
+
+    //slab模式：一个 block只分配一个 size class 的片
+    void* free_list;                // 已释放、可复用的片（MP_PIECE），链表指针放在片的数据区
+    struct _MP_BLOCK* class_prev;   // slab模式：所属 class 中还有空闲片的 block 链表，空闲 block 链表也用 class_next；
+    struct _MP_BLOCK* class_next;   // bump模式：所在剩余空间档的 block 链表
+    int size_class;                 // slab模式：所属 class，-1表示空闲 block；bump模式：剩余空间档，-1表示没有可用空间
+    int piece_size;                 // 片大小（含 MP_PIECE 头）
+
+    MP_REGION* region;              // 所在 mmap 区域，posix_memalign 申请的 block 为NULL
+    int undo;                       // 检查点期间：这个 block 最近的一条撤销记录，-1表示没有
 };
 typedef struct _MP_BLOCK MP_BLOCK;
 
@@ -33,27 +91,166 @@ struct _MP_PIECE {
 };
 typedef struct _MP_PIECE MP_PIECE;
 
-struct _MP_BUCKET {         // 超过 BLOCK_SIZE 内存用 MP_BUCKET 描述
+struct _MP_BUCKET {         // 超过 BLOCK_SIZE 内存用 MP_BUCKET 描述，描述符本身是 block 中的一片，随 bucket 一起释放
+   struct _MP_BUCKET* prev;
    struct _MP_BUCKET* next;
-   int still_in_use;        // 这个bucket描述符当前有没有被释放掉，如果被释放了可以尝试复用
-   ADDR start_of_bucket;	// 实际分配的bucket内存不跟在bucket描述符后
+   int still_in_use;        // 这个bucket当前是否在使用
+   int cache_class;         // 独立内存所属的缓存档，-1表示不缓存（释放时直接 free）
+   long seq;                // 分配序号，检查点回滚时释放序号不小于检查点的 bucket
+   size_t size;             // 申请的大小
+   ADDR start_of_bucket;	// 实际分配的bucket内存不跟在bucket描述符后，前面有 MP_BUCKET_HEAD 字节的头部
 };
 typedef struct _MP_BUCKET MP_BUCKET;
 
+struct _MP_UNDO {           // 检查点之后第一次从某 block 切片时记下它当时的状态，回滚时恢复
+    MP_BLOCK* block;
+    ADDR start_of_rest;
+    int ref_counter;
+    int pre_freed;          // 之后释放的、检查点之前切出的片数（地址低于 start_of_rest），回滚时从引用中扣掉
+    int prev;               // 同一 block 在外层检查点的记录，-1表示没有
+};
+typedef struct _MP_UNDO MP_UNDO;
+
+struct _MP_MARK {
+    int undo_base;          // 这个检查点的撤销记录从这里开始
+    long bucket_seq;        // 设置检查点时下一个 bucket 的序号
+};
+typedef struct _MP_MARK MP_MARK;
+
+struct _MP_STATS {          // 池的统计，随分配释放增量维护，mp_get_stats 读取是 O(1) 的
+    size_t footprint;       // 向系统申请的内存：池描述符、block（含描述符）、bucket 独立内存（含缓存）
+    long block_num;
+    long empty_block_num;   // 完全空闲的 block（bump模式下清空的，slab模式下空闲 block 链表中的）
+    size_t block_bytes;     // block 可分配空间总量
+    size_t used_bytes;      // block 中被占用的空间：bump模式为已切出的（片释放后要等 block 清空才回收），slab模式为在用片（含片头）
+    size_t free_bytes;      // block 中可再分配的空间，bump模式下即各 block 末尾还没切的空间之和
+    double fragmentation;   // 空闲空间中不在完全空闲 block 里的比例，0表示空闲空间都是整块的
+    long piece_num;         // 在用的片（包括 bucket 描述符）
+    long bucket_num;        // 在用的 bucket
+    size_t bucket_bytes;    // 在用 bucket 申请的大小之和
+    size_t bucket_mem_bytes;    // 在用 bucket 的独立内存（含头部和按档取整）
+    size_t bucket_cache_bytes;
+    long malloc_count;
+    long free_count;
+    long failed_fits;       // bump模式下按剩余空间档试探 block 但不够用的次数
+    long new_blocks;        // 没有 block 放得下而新建 block 的次数
+    long size_hist[MP_STATS_HIST_NUM];  // 各档大小的分配次数
+};
+typedef struct _MP_STATS MP_STATS;
+
+struct _MP_SLAB_CLASS {
+    size_t size;                // 这个 class 的分配大小
+    MP_BLOCK* partial;          // 还有空闲片的 block
+};
+typedef struct _MP_SLAB_CLASS MP_SLAB_CLASS;
+
 struct _MP_POOL {
     size_t block_size;
-    MP_BLOCK* current_block;    // 当前使用的 block，申请内存时优先使用这个 block（也就是开始遍历的那个 block）
+    MP_BLOCK* current_block;    // block 链表的最后一个 block，新 block 直接接在它后面
     MP_BUCKET* first_bucket;    // 内存池中的第一个 bucket的位置
-    int auto_clear;             // 内存池是否自动做清理
+    int auto_clear;             // 内存池是否自动做清理；slab模式下 block 全部片释放后还给空闲 block 链表
+    int mode;                   // MP_MODE_xxx
+    size_t align;               // mp_malloc 返回地址的对齐
+    uintptr_t block_mask;       // header_free 的池：block 对齐大小减1；否则为0
+    MP_BLOCK* empty_blocks;     // slab模式下不属于任何 class 的空闲 block
+    MP_SLAB_CLASS classes[MP_SLAB_CLASS_NUM];
+    MP_BLOCK* space_lists[MP_SPACE_CLASS_NUM];  // bump模式下按剩余空间分档的 block 链表
+    uint32_t space_bitmap;                      // 哪些档非空
+
+    int backing;                // MP_BACKING_xxx
+    int huge_page;              // MP_HUGE_xxx
+    size_t region_size;
+    MP_REGION* regions;         // 所有映射过的区域
+    MP_REGION* carve_region;    // 当前正在切 block 的区域，它不会被归还
+    long region_maps;           // mmap 次数
+    long region_releases;       // MADV_DONTNEED 归还次数
+
+    size_t bucket_cache_max;    // bucket 内存缓存的总量上限，0表示不缓存
+    size_t bucket_cache_bytes;  // 当前缓存的总量
+    void* bucket_cache[MP_BUCKET_CACHE_CLASS_NUM];  // 每档缓存的内存链表，链表指针放在内存的前8字节
+    uint64_t bucket_cache_bitmap;                   // 哪些档非空
+    long bucket_cache_hits;
+    long bucket_cache_misses;
+
+    long bucket_seq;            // 下一个 bucket 的序号
+    MP_MARK marks[MP_MARK_MAX_DEPTH];   // 检查点栈
+    int mark_depth;
+    MP_UNDO* undo;              // 撤销记录栈，按检查点分段
+    int undo_num;
+    int undo_cap;
+
+    MP_STATS stats;             // 增量维护的计数，派生的字段在 mp_get_stats 中计算
+
     MP_BLOCK first_block[0];    // pool描述符后是内存池中的第一个 block的位置，block的可分配内存跟在block描述符后
 };
 typedef struct _MP_POOL MP_POOL;
 
+struct _MP_CONFIG {
+    size_t block_size;          // block 的大小，不超过 MP_MAX_BLOCK_SIZE；slab模式下至少 MP_SLAB_BLOCK_SIZE
+    int auto_clear;
+    int mode;                   // MP_MODE_xxx
+    int backing;                // MP_BACKING_xxx
+    int huge_page;              // MP_HUGE_xxx，只对 MP_BACKING_MMAP 有效
+    size_t region_size;         // mmap 区域大小
+    size_t bucket_cache_max;    // bucket 内存缓存的总量上限，0表示不缓存
+    size_t align;               // mp_malloc 返回地址的对齐：MP_MIN_ALIGN（默认）、16、32 或 MP_MAX_ALIGN
+    int header_free;            // 1：片不带片头，block_size 为含描述符的 block 大小，须为2的幂；
+                                // 池描述符后的第一个 block 没有按大小对齐，不用来分配
+};
+typedef struct _MP_CONFIG MP_CONFIG;
+
+/******************************************
+*name：		mp_slab_class_of
+*brief:		计算分配大小所属的 size class：16~128每16一档，之后每个2的幂区间分4档，直到2048
+*input:		size：分配大小，1~MP_SLAB_MAX_SIZE
+*output:	无
+*return:	class 下标
+******************************************/
+static inline int mp_slab_class_of(size_t size)
+{
+    if(size <= 128)
+        return (size + 15) / 16 - 1;
+
+    int shift = 63 - __builtin_clzl(size - 1);  // size 落在 (2^shift, 2^(shift+1)]
+    return 8 + (shift - 7) * 4 + (int)((size - 1) >> (shift - 2)) - 4;
+}
+
+/******************************************
+*name：		mp_slab_class_size
+*brief:		mp_slab_class_of 的反函数，计算 class 的分配大小
+*input:		cls：class 下标
+*output:	无
+*return:	该 class 的分配大小
+******************************************/
+static inline size_t mp_slab_class_size(int cls)
+{
+    if(cls < 8)
+        return (cls + 1) * 16;
+    return (size_t)(4 + (cls - 8) % 4 + 1) << (5 + (cls - 8) / 4);
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mp_config_init(MP_CONFIG* cfg);
+MP_POOL* mp_create_pool_ex(const MP_CONFIG* cfg);
 MP_POOL* mp_create_pool(size_t size, int auto_clear);
 void mp_destroy_pool(MP_POOL* pool);
 void* mp_malloc(MP_POOL* pool, size_t size);
+void* mp_malloc_aligned(MP_POOL* pool, size_t size, size_t align);
 void mp_free(MP_POOL* pool, void* addr);
 void mp_reset_pool(MP_POOL* pool);
+void mp_trim_bucket_cache(MP_POOL* pool, size_t keep);
+void mp_get_stats(MP_POOL* pool, MP_STATS* stats);
+int mp_stats_json(const MP_STATS* stats, char* buf, size_t size);
+int mp_mark(MP_POOL* pool);
+void mp_rollback(MP_POOL* pool, int mark);
+void mp_unmark(MP_POOL* pool, int mark);
 void mp_pool_statistic(MP_POOL* pool);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
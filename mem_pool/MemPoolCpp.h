@@ -0,0 +1,124 @@
+#ifndef __MEMPOOL_CPP_H__
+#define __MEMPOOL_CPP_H__
+
+/*
+ * MemPool 的 C++ 封装：
+ * MemPool          持有一个 MP_POOL，析构时销毁；
+ * ObjectPool<T>    在池中构造/析构 T，代替 mp_malloc + placement new + 手动调用析构函数；
+ * MemPoolAllocator STL 分配器，容器的节点内存从指定的 MP_POOL 中取，不持有池。
+ *
+ * 和 C 接口一样不是线程安全的。对齐要求超过池的对齐（默认 MP_MIN_ALIGN）的类型用 mp_malloc_aligned 分配。
+ * 容器的节点大小固定，一般用 slab 模式的池（释放的片立即可被复用）。
+ */
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include "MemPool.h"
+
+#undef log      // MemPool.h 的 log 宏会替换掉 std::log
+
+class MemPool
+{
+private:
+    MP_POOL* m_pool;
+public:
+    explicit MemPool(int mode = MP_MODE_SLAB)
+    {
+        MP_CONFIG cfg;
+        mp_config_init(&cfg);
+        cfg.mode = mode;
+        m_pool = mp_create_pool_ex(&cfg);
+        if(m_pool == NULL)
+            throw std::bad_alloc();
+    }
+    explicit MemPool(const MP_CONFIG& cfg) : m_pool(mp_create_pool_ex(&cfg))
+    {
+        if(m_pool == NULL)
+            throw std::bad_alloc();
+    }
+    ~MemPool() { mp_destroy_pool(m_pool); }    // 池中还没析构的对象不会被析构
+    MemPool(const MemPool&) = delete;
+    MemPool& operator=(const MemPool&) = delete;
+
+    MP_POOL* get() const { return m_pool; }
+    void* malloc(size_t size) { return mp_malloc(m_pool, size); }
+    void* malloc(size_t size, size_t align) { return mp_malloc_aligned(m_pool, size, align); }
+    void free(void* addr) { mp_free(m_pool, addr); }
+    void reset() { mp_reset_pool(m_pool); }
+};
+
+template<class T>
+class ObjectPool
+{
+private:
+    MemPool m_pool;
+public:
+    explicit ObjectPool(int mode = MP_MODE_SLAB) : m_pool(mode) {}
+    explicit ObjectPool(const MP_CONFIG& cfg) : m_pool(cfg) {}
+
+    // 申请一片并用 args 构造，构造函数抛异常时归还这一片再继续抛出
+    template<class... Args>
+    T* create(Args&&... args)
+    {
+        void* mem = m_pool.malloc(sizeof(T), alignof(T));
+        if(mem == NULL)
+            throw std::bad_alloc();
+        try
+        {
+            return new(mem) T(std::forward<Args>(args)...);
+        }
+        catch(...)
+        {
+            m_pool.free(mem);
+            throw;
+        }
+    }
+
+    void destroy(T* obj)
+    {
+        if(obj == NULL)
+            return;
+        obj->~T();
+        m_pool.free(obj);
+    }
+
+    MP_POOL* get() const { return m_pool.get(); }
+};
+
+template<class T>
+class MemPoolAllocator
+{
+    template<class U> friend class MemPoolAllocator;
+private:
+    MP_POOL* m_pool;
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;     // 容器之间赋值、交换时分配器跟着走，
+    typedef std::true_type propagate_on_container_move_assignment;     // 保证节点总是还给申请它的池
+    typedef std::true_type propagate_on_container_swap;
+
+    explicit MemPoolAllocator(MP_POOL* pool) noexcept : m_pool(pool) {}
+    template<class U>
+    MemPoolAllocator(const MemPoolAllocator<U>& other) noexcept : m_pool(other.m_pool) {}
+
+    T* allocate(size_t n)
+    {
+        if(n > (size_t)-1 / sizeof(T))
+            throw std::bad_array_new_length();
+        void* mem = mp_malloc_aligned(m_pool, n ? n * sizeof(T) : 1, alignof(T));     // mp_malloc 不接受0
+        if(mem == NULL)
+            throw std::bad_alloc();
+        return static_cast<T*>(mem);
+    }
+    void deallocate(T* p, size_t) noexcept { mp_free(m_pool, p); }
+
+    MP_POOL* pool() const noexcept { return m_pool; }
+};
+
+template<class T, class U>
+bool operator==(const MemPoolAllocator<T>& a, const MemPoolAllocator<U>& b) noexcept { return a.pool() == b.pool(); }
+template<class T, class U>
+bool operator!=(const MemPoolAllocator<T>& a, const MemPoolAllocator<U>& b) noexcept { return a.pool() != b.pool(); }
+
+#endif
@@ -0,0 +1,504 @@
+#include "MemPoolMT.h"
+#include <stdio.h>
+#include <errno.h>
+
+/******************************************
+*name：		page_of
+*brief:		根据片的地址找到所在 page 的描述符
+*input:		addr：片的地址
+*output:	无
+*return:	page 描述符
+******************************************/
+static inline MP_MT_PAGE* page_of(void* addr)
+{
+    return (MP_MT_PAGE*)((uintptr_t)addr & ~(uintptr_t)(MP_MT_PAGE_SIZE - 1));
+}
+
+/******************************************
+*name：		page_push/page_remove
+*brief:		page 加入/移出一个双向链表
+*input:		head：链表头；page：page
+*output:	无
+*return:	无
+******************************************/
+static inline void page_push(MP_MT_PAGE** head, MP_MT_PAGE* page)
+{
+    page->prev = NULL;
+    page->next = *head;
+    if(*head)
+        (*head)->prev = page;
+    *head = page;
+}
+
+static inline void page_remove(MP_MT_PAGE** head, MP_MT_PAGE* page)
+{
+    if(page->prev)
+        page->prev->next = page->next;
+    else
+        *head = page->next;
+    if(page->next)
+        page->next->prev = page->prev;
+    page->prev = page->next = NULL;
+}
+
+/******************************************
+*name：		page_init
+*brief:		把空闲 page 分给 heap 的某个 class
+*input:		page：page；heap：所属 heap；cls：class 下标
+*output:	无
+*return:	无
+******************************************/
+static void page_init(MP_MT_PAGE* page, MP_MT_HEAP* heap, int cls)
+{
+    page->heap = heap;
+    page->size_class = cls;
+    page->piece_size = mp_slab_class_size(cls);
+    page->used = 0;
+    page->full = 0;
+    page->free_list = NULL;
+    atomic_store_explicit(&page->remote_free, NULL, memory_order_relaxed);
+    page->start_of_rest = (ADDR)page + sizeof(MP_MT_PAGE);
+    page->end_of_page = (ADDR)page + MP_MT_PAGE_SIZE;
+    page->prev = page->next = NULL;
+}
+
+/******************************************
+*name：		page_take
+*brief:		从 page 取一片：先用本线程释放的片，再从剩余空间顺序切
+*input:		page：page
+*output:	无
+*return:	片的地址，page 已满返回NULL
+******************************************/
+static inline void* page_take(MP_MT_PAGE* page)
+{
+    void* piece = page->free_list;
+    if(piece)
+    {
+        page->free_list = *(void**)piece;
+    }
+    else if(page->start_of_rest + page->piece_size <= page->end_of_page)
+    {
+        piece = page->start_of_rest;
+        page->start_of_rest += page->piece_size;
+    }
+    else
+    {
+        return NULL;
+    }
+    page->used++;
+    return piece;
+}
+
+/******************************************
+*name：		page_collect
+*brief:		整体摘下其他线程释放到这个 page 的片，并入本线程的空闲链表
+*input:		page：page
+*output:	无
+*return:	回收的片数
+******************************************/
+static int page_collect(MP_MT_PAGE* page)
+{
+    void* list = atomic_exchange_explicit(&page->remote_free, NULL, memory_order_acquire);
+    if(list == NULL)
+        return 0;
+
+    void* tail = list;
+    int n = 1;
+    while(*(void**)tail)
+    {
+        tail = *(void**)tail;
+        n++;
+    }
+    *(void**)tail = page->free_list;
+    page->free_list = list;
+    page->used -= n;
+    return n;
+}
+
+/******************************************
+*name：		central_take
+*brief:		heap 从中心池批量取空闲 page，中心池不够时向系统申请一个 chunk
+*input:		pool：池对象；heap：heap
+*output:	无
+*return:	取到的 page 数
+******************************************/
+static int central_take(MP_MT_POOL* pool, MP_MT_HEAP* heap)
+{
+    int n = 0, i;
+
+    pthread_mutex_lock(&pool->lock);
+    if(pool->free_pages == NULL)
+    {
+        MP_MT_CHUNK* chunk = malloc(sizeof(MP_MT_CHUNK));
+        if(chunk == NULL || posix_memalign((void**)&chunk->mem, MP_MT_PAGE_SIZE, MP_MT_PAGE_SIZE * MP_MT_CHUNK_PAGES))
+        {
+            pthread_mutex_unlock(&pool->lock);
+            free(chunk);
+            log("[%d]posix_memalign error[%d].\n", __LINE__, errno);
+            return 0;
+        }
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+        pool->page_num += MP_MT_CHUNK_PAGES;
+        for(i = 0; i < MP_MT_CHUNK_PAGES; i++)
+        {
+            MP_MT_PAGE* page = (MP_MT_PAGE*)(chunk->mem + (size_t)i * MP_MT_PAGE_SIZE);
+            page->size_class = -2;
+            page->next = pool->free_pages;
+            pool->free_pages = page;
+        }
+    }
+
+    while(pool->free_pages && n < MP_MT_REFILL_PAGES)
+    {
+        MP_MT_PAGE* page = pool->free_pages;
+        pool->free_pages = page->next;
+        page_push(&heap->empty, page);
+        n++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    heap->empty_num += n;
+    return n;
+}
+
+/******************************************
+*name：		central_give
+*brief:		heap 把缓存的空闲 page 批量还给中心池
+*input:		pool：池对象；heap：heap；keep：heap 中保留的空闲 page 数
+*output:	无
+*return:	无
+******************************************/
+static void central_give(MP_MT_POOL* pool, MP_MT_HEAP* heap, int keep)
+{
+    if(heap->empty_num <= keep)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    while(heap->empty_num > keep)
+    {
+        MP_MT_PAGE* page = heap->empty;
+        page_remove(&heap->empty, page);
+        page->next = pool->free_pages;
+        pool->free_pages = page;
+        heap->empty_num--;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/******************************************
+*name：		page_release
+*brief:		page 中的片全部释放了，放回 heap 的空闲 page 缓存，缓存太多则还一半给中心池
+*input:		heap：heap；page：已移出 class 链表的 page
+*output:	无
+*return:	无
+******************************************/
+static void page_release(MP_MT_HEAP* heap, MP_MT_PAGE* page)
+{
+    page->size_class = -2;
+    page_push(&heap->empty, page);
+    heap->empty_num++;
+    if(heap->empty_num > MP_MT_HEAP_EMPTY_MAX)
+        central_give(heap->pool, heap, MP_MT_HEAP_EMPTY_MAX / 2);
+}
+
+/******************************************
+*name：		heap_collect_full
+*brief:		回收 full 链表中各 page 被其他线程释放的片，有空闲片的 page 回到 class 链表
+*input:		heap：heap
+*output:	无
+*return:	无
+******************************************/
+static void heap_collect_full(MP_MT_HEAP* heap)
+{
+    MP_MT_PAGE* page = heap->full;
+    while(page)
+    {
+        MP_MT_PAGE* next = page->next;
+        if(page_collect(page))
+        {
+            page_remove(&heap->full, page);
+            page->full = 0;
+            if(page->used == 0)
+                page_release(heap, page);
+            else
+                page_push(&heap->classes[page->size_class], page);
+        }
+        page = next;
+    }
+}
+
+/******************************************
+*name：		heap_abandon
+*brief:		线程退出时调用（pthread key 的析构），空闲 page 还给中心池，heap 留给后来的线程接手
+*input:		arg：heap
+*output:	无
+*return:	无
+******************************************/
+static void heap_abandon(void* arg)
+{
+    MP_MT_HEAP* heap = arg;
+    MP_MT_POOL* pool = heap->pool;
+
+    central_give(pool, heap, 0);
+    pthread_mutex_lock(&pool->lock);
+    heap->next_abandoned = pool->abandoned;
+    pool->abandoned = heap;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/******************************************
+*name：		heap_get
+*brief:		取当前线程的 heap，第一次调用时接手一个被遗弃的 heap 或新建一个
+*input:		pool：池对象
+*output:	无
+*return:	heap，失败返回NULL
+******************************************/
+static MP_MT_HEAP* heap_get(MP_MT_POOL* pool)
+{
+    MP_MT_HEAP* heap = pthread_getspecific(pool->key);
+    if(heap)
+        return heap;
+
+    pthread_mutex_lock(&pool->lock);
+    heap = pool->abandoned;
+    if(heap)
+    {
+        pool->abandoned = heap->next_abandoned;
+    }
+    else
+    {
+        heap = calloc(1, sizeof(MP_MT_HEAP));
+        if(heap)
+        {
+            heap->pool = pool;
+            atomic_init(&heap->remote_pending, 0);
+            heap->next = pool->heaps;
+            pool->heaps = heap;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if(heap)
+        pthread_setspecific(pool->key, heap);
+    return heap;
+}
+
+/******************************************
+*name：		large_malloc
+*brief:		超过 MP_SLAB_MAX_SIZE 的分配直接向系统申请，前面放一个 size_class 为-1的 page 描述符
+*input:		size：分配大小
+*output:	无
+*return:	分配完成的内存的起始地址
+******************************************/
+static void* large_malloc(size_t size)
+{
+    MP_MT_PAGE* page;
+    if(posix_memalign((void**)&page, MP_MT_PAGE_SIZE, sizeof(MP_MT_PAGE) + size))
+    {
+        log("[%d]posix_memalign error[%d].\n", __LINE__, errno);
+        return NULL;
+    }
+    page->heap = NULL;
+    page->size_class = -1;
+    return (ADDR)page + sizeof(MP_MT_PAGE);
+}
+
+/******************************************
+*name：		mp_mt_create_pool
+*brief:		创建线程安全的内存池
+*input:		无
+*output:	无
+*return:	返回内存池对象
+******************************************/
+MP_MT_POOL* mp_mt_create_pool(void)
+{
+    MP_MT_POOL* pool = calloc(1, sizeof(MP_MT_POOL));
+    if(pool == NULL)
+        return NULL;
+
+    if(pthread_key_create(&pool->key, heap_abandon))
+    {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+/******************************************
+*name：		mp_mt_destroy_pool
+*brief:		释放整个池空间，调用时所有线程都不能再使用这个池
+*input:		pool：池对象
+*output:	无
+*return:	无
+******************************************/
+void mp_mt_destroy_pool(MP_MT_POOL* pool)
+{
+    if(pool == NULL)
+        return;
+
+    pthread_key_delete(pool->key);
+    while(pool->chunks)
+    {
+        MP_MT_CHUNK* chunk = pool->chunks;
+        pool->chunks = chunk->next;
+        free(chunk->mem);
+        free(chunk);
+    }
+    while(pool->heaps)
+    {
+        MP_MT_HEAP* heap = pool->heaps;
+        pool->heaps = heap->next;
+        free(heap);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+/******************************************
+*name：		mp_mt_malloc
+*brief:		从内存池中分配内存，可多线程并发调用
+*input:		pool：池对象；size：分配大小；
+*output:	无
+*return:	分配完成的内存的起始地址
+******************************************/
+void* mp_mt_malloc(MP_MT_POOL* pool, size_t size)
+{
+    if(size == 0 || pool == NULL)
+        return NULL;
+    if(size > MP_SLAB_MAX_SIZE)
+        return large_malloc(size);
+
+    MP_MT_HEAP* heap = heap_get(pool);
+    if(heap == NULL)
+        return NULL;
+
+    int cls = mp_slab_class_of(size);
+    MP_MT_PAGE* page = heap->classes[cls];
+    void* piece;
+
+	//1、从这个 class 已有的 page 中取，本线程释放的片用完了再收其他线程释放的片，都没有则移到 full 链表
+    while(page)
+    {
+        if(page->free_list == NULL)
+            page_collect(page);
+        piece = page_take(page);
+        if(piece)
+            return piece;
+
+        page_remove(&heap->classes[cls], page);
+        page->full = 1;
+        page_push(&heap->full, page);
+        page = heap->classes[cls];
+    }
+
+	//2、其他线程向已满的 page 释放过片，先把它们收回来
+    if(atomic_load_explicit(&heap->remote_pending, memory_order_relaxed)
+        && atomic_exchange_explicit(&heap->remote_pending, 0, memory_order_acq_rel))
+    {
+        heap_collect_full(heap);
+        page = heap->classes[cls];
+        if(page)
+            return page_take(page);
+    }
+
+	//3、换一个空闲 page，heap 没有缓存则从中心池批量取
+    if(heap->empty == NULL && central_take(pool, heap) == 0)
+        return NULL;
+    page = heap->empty;
+    page_remove(&heap->empty, page);
+    heap->empty_num--;
+    page_init(page, heap, cls);
+    page_push(&heap->classes[cls], page);
+    return page_take(page);
+}
+
+/******************************************
+*name：		mp_mt_free
+*brief:		释放池中取出的空间，可以在任意线程调用
+*input:		pool：池对象；addr：曾分配的内存起始地址；
+*output:	无
+*return:	无
+******************************************/
+void mp_mt_free(MP_MT_POOL* pool, void* addr)
+{
+    if(pool == NULL || addr == NULL)
+        return;
+
+    MP_MT_PAGE* page = page_of(addr);
+    if(page->size_class == -1)
+    {
+        free(page);
+        return;
+    }
+
+    MP_MT_HEAP* heap = pthread_getspecific(pool->key);
+    MP_MT_HEAP* owner = page->heap;
+
+	//1、其他线程的 page：无锁压进 remote_free，并告诉所属 heap 去回收
+    if(owner != heap)
+    {
+        void* old = atomic_load_explicit(&page->remote_free, memory_order_relaxed);
+        do
+        {
+            *(void**)addr = old;
+        } while(!atomic_compare_exchange_weak_explicit(&page->remote_free, &old, addr,
+                    memory_order_release, memory_order_relaxed));
+
+        if(atomic_load_explicit(&owner->remote_pending, memory_order_relaxed) == 0)
+            atomic_store_explicit(&owner->remote_pending, 1, memory_order_release);
+        return;
+    }
+
+	//2、本线程的 page：直接挂回空闲链表
+    *(void**)addr = page->free_list;
+    page->free_list = addr;
+    page->used--;
+
+    MP_MT_PAGE** head = &heap->classes[page->size_class];
+    if(page->full)
+    {
+        page_remove(&heap->full, page);
+        page->full = 0;
+        page_push(head, page);
+    }
+
+	//3、page 全部空闲且不是这个 class 唯一的 page，放回空闲 page 缓存
+    if(page->used == 0 && (*head != page || page->next))
+    {
+        page_remove(head, page);
+        page_release(heap, page);
+    }
+}
+
+/******************************************
+*name：		mp_mt_pool_statistic
+*brief:		输出中心池统计信息
+*input:		内存池对象
+*output:	无
+*return:	无
+******************************************/
+void mp_mt_pool_statistic(MP_MT_POOL* pool)
+{
+    if(pool == NULL) return;
+
+    int free_num = 0, heap_num = 0, abandoned_num = 0;
+    MP_MT_PAGE* page;
+    MP_MT_HEAP* heap;
+
+    pthread_mutex_lock(&pool->lock);
+    for(page = pool->free_pages; page; page = page->next)
+        free_num++;
+    for(heap = pool->heaps; heap; heap = heap->next)
+        heap_num++;
+    for(heap = pool->abandoned; heap; heap = heap->next_abandoned)
+        abandoned_num++;
+
+    printf("###################################################\n");
+    printf("# page size: %d\n", MP_MT_PAGE_SIZE);
+    printf("# page(s) num: %ld (%ldKB)\n", pool->page_num, pool->page_num * MP_MT_PAGE_SIZE / 1024);
+    printf("# page(s) free in central: %d\n", free_num);
+    printf("# heap(s) num: %d, abandoned: %d\n", heap_num, abandoned_num);
+    pthread_mutex_unlock(&pool->lock);
+}
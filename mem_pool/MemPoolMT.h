@@ -0,0 +1,76 @@
+#ifndef __MEMPOOL_MT_H__
+#define __MEMPOOL_MT_H__
+
+/*
+ * 线程安全的内存池。
+ * 每个线程有自己的 heap（线程本地缓存），按 size class 持有若干 page，本线程的申请和释放不加锁；
+ * heap 缺 page 时从中心池一次批量取 MP_MT_REFILL_PAGES 个，空闲 page 多了再批量还回去，只有这两处加锁。
+ * 其他线程释放的片用 CAS 压进所属 page 的 remote_free 链表（无锁），由 page 所属线程整体摘下回收。
+ *
+ * page 按 MP_MT_PAGE_SIZE 对齐，片的地址去掉低位就是所在 page 的描述符，片本身没有头部。
+ * 超过 MP_SLAB_MAX_SIZE 的分配直接向系统申请，前面同样放一个 page 描述符以便释放时区分。
+ * 线程退出时它的 heap 挂到中心池的 abandoned 链表，新线程优先接手，heap 中未释放的片仍然有效。
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include "MemPool.h"
+
+#define MP_MT_PAGE_SIZE (64 * 1024)     // page 大小，同时也是对齐大小
+#define MP_MT_CHUNK_PAGES 16            // 中心池向系统申请内存时一次申请的 page 数
+#define MP_MT_REFILL_PAGES 4            // heap 一次从中心池取的 page 数
+#define MP_MT_HEAP_EMPTY_MAX 8          // heap 最多缓存的空闲 page 数，超过则还一批给中心池
+
+typedef struct _MP_MT_HEAP MP_MT_HEAP;
+
+struct _MP_MT_PAGE {
+    MP_MT_HEAP* heap;                   // 所属 heap，page 中有片在使用时不变
+    int size_class;                     // -1 表示大块分配（独立向系统申请），-2 表示空闲 page
+    int piece_size;
+    int used;                           // 在用的片数，只由所属线程修改（其他线程释放的片回收时才扣减）
+    int full;                           // 在 heap 的 full 链表中
+    void* free_list;                    // 本线程释放的片，链表指针放在片的前8字节
+    _Atomic(void*) remote_free;         // 其他线程释放的片
+    ADDR start_of_rest;                 // 还没切过的空间
+    ADDR end_of_page;
+    struct _MP_MT_PAGE* prev;           // heap 中同 class 的 page 链表 / full 链表 / 空闲 page 链表
+    struct _MP_MT_PAGE* next;
+} __attribute__((aligned(64)));         // 描述符占满整数个 cache line，数据区按64字节对齐
+typedef struct _MP_MT_PAGE MP_MT_PAGE;
+
+struct _MP_MT_POOL;
+
+struct _MP_MT_HEAP {
+    struct _MP_MT_POOL* pool;
+    MP_MT_PAGE* classes[MP_SLAB_CLASS_NUM];     // 每个 class 还有可分配片的 page
+    MP_MT_PAGE* full;                           // 已经切满的 page，等待释放
+    MP_MT_PAGE* empty;                          // 缓存的空闲 page
+    int empty_num;
+    atomic_int remote_pending;                  // 有其他线程向 full 链表中的 page 释放过片
+    struct _MP_MT_HEAP* next;                   // 中心池的 heap 链表
+    struct _MP_MT_HEAP* next_abandoned;
+};
+
+struct _MP_MT_CHUNK {
+    struct _MP_MT_CHUNK* next;
+    ADDR mem;
+};
+typedef struct _MP_MT_CHUNK MP_MT_CHUNK;
+
+struct _MP_MT_POOL {
+    pthread_key_t key;                  // 线程本地的 heap
+    pthread_mutex_t lock;               // 保护以下中心池的字段
+    MP_MT_PAGE* free_pages;
+    MP_MT_CHUNK* chunks;
+    MP_MT_HEAP* heaps;
+    MP_MT_HEAP* abandoned;
+    long page_num;                      // 向系统申请的 page 总数
+};
+typedef struct _MP_MT_POOL MP_MT_POOL;
+
+MP_MT_POOL* mp_mt_create_pool(void);
+void mp_mt_destroy_pool(MP_MT_POOL* pool);
+void* mp_mt_malloc(MP_MT_POOL* pool, size_t size);
+void mp_mt_free(MP_MT_POOL* pool, void* addr);
+void mp_mt_pool_statistic(MP_MT_POOL* pool);
+
+#endif
@@ -0,0 +1,128 @@
+#include "MemPool.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * 对齐分配测试：
+ * 分别用池的默认对齐（MP_CONFIG.align 为 8/16/32/64，mp_malloc）和 mp_malloc_aligned（默认对齐的池上要求 16/32/64/4096），
+ * 申请 count 片 16~256 字节的随机大小内存，检查每个地址都满足对齐，写满后全部释放。
+ * 输出申请耗时，以及 block 中被占用的空间加 bucket 内存（MP_STATS.used_bytes + bucket_mem_bytes）与申请大小之和的比，
+ * 多出的部分即片头加对齐补齐的开销。正式测试前先不输出地跑一轮，避免第一轮承担进程的缺页。
+ */
+
+#define DEFAULT_COUNT   (1000 * 1000)
+
+static int quiet;
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static inline uint64_t xorshift64(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/******************************************
+*name：		run
+*brief:		在一个新池上跑一轮
+*input:		mode：MP_MODE_xxx；pool_align：池的默认对齐；align：mp_malloc_aligned 的对齐，0表示用 mp_malloc；
+*           mem：存放地址的数组；count：片数
+*output:	无
+*return:	对齐错误的片数，池创建失败返回-1
+******************************************/
+static long run(int mode, size_t pool_align, size_t align, void** mem, long count)
+{
+    MP_CONFIG cfg;
+    mp_config_init(&cfg);
+    cfg.mode = mode;
+    cfg.align = pool_align;
+    MP_POOL* pool = mp_create_pool_ex(&cfg);
+    if(pool == NULL)
+        return -1;
+
+    size_t expect = align ? align : pool_align;
+    size_t requested = 0;
+    long bad = 0, i;
+    rng_state = 88172645463325252ULL;
+
+	//1、申请并检查对齐
+    double begin = now_sec();
+    for(i = 0; i < count; i++)
+    {
+        size_t size = 16 + xorshift64() % 241;
+        mem[i] = align ? mp_malloc_aligned(pool, size, align) : mp_malloc(pool, size);
+        if(mem[i] == NULL || ((uintptr_t)mem[i] & (expect - 1)))
+            bad++;
+        else
+            memset(mem[i], 0x5a, size);
+        requested += size;
+    }
+    double elapsed = now_sec() - begin;
+
+    MP_STATS stats;
+    mp_get_stats(pool, &stats);
+    if(!quiet)
+    {
+        printf("%-6s pool align:%-3lu %-17s %6.1f ns/op  used/requested:%.3f  misaligned:%ld",
+            mode == MP_MODE_SLAB ? "slab" : "bump", pool_align, align ? "mp_malloc_aligned" : "mp_malloc",
+            elapsed * 1e9 / count, (double)(stats.used_bytes + stats.bucket_mem_bytes) / requested, bad);
+        if(align)
+            printf("  (align %lu)", align);
+        printf("\n");
+    }
+
+	//2、全部释放，池中不应再有在用的片
+    for(i = 0; i < count; i++)
+        mp_free(pool, mem[i]);
+    mp_get_stats(pool, &stats);
+    if(stats.piece_num || stats.bucket_num)
+    {
+        printf("leak: pieces:%ld buckets:%ld\n", stats.piece_num, stats.bucket_num);
+        bad++;
+    }
+    mp_destroy_pool(pool);
+    return bad;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        printf("Usage: %s <bump|slab> [count]\n", argv[0]);
+        return 0;
+    }
+
+    int mode = strcmp(argv[1], "slab") == 0 ? MP_MODE_SLAB : MP_MODE_BUMP;
+    long count = argc > 2 ? atol(argv[2]) : DEFAULT_COUNT;
+    if(count <= 0)
+        count = DEFAULT_COUNT;
+    void** mem = malloc(count * sizeof(void*));
+    if(mem == NULL)
+        return -1;
+
+    size_t aligns[] = { 8, 16, 32, 64 };
+    size_t extra[] = { 16, 32, 64, 4096 };
+    long bad = 0;
+    int i;
+    quiet = 1;
+    run(mode, MP_MIN_ALIGN, 0, mem, count);
+    quiet = 0;
+    for(i = 0; i < 4; i++)
+        bad += run(mode, aligns[i], 0, mem, count);
+    for(i = 0; i < 4; i++)
+        bad += run(mode, MP_MIN_ALIGN, extra[i], mem, count);
+
+    printf("%s\n", bad ? "FAILED" : "all aligned");
+    free(mem);
+    return bad ? 1 : 0;
+}
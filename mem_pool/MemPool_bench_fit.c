@@ -0,0 +1,90 @@
+#include "MemPool.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * bump 模式找 block 的基准测试：
+ * 先申请 16~2048 字节的随机片直到池中有 blocks 个 block（4KB），这些片全部保持存活；
+ * 然后每次操作随机替换其中一片（释放旧的，申请新的），此时大部分 block 剩余空间都不够，统计申请耗时。
+ */
+
+#define DEFAULT_BLOCKS  10000
+#define DEFAULT_OPS     (1000 * 1000)
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static inline uint64_t xorshift64(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int count_blocks(MP_POOL* pool)
+{
+    int n = 0;
+    MP_BLOCK* block;
+    for(block = pool->first_block; block; block = block->next)
+        n++;
+    return n;
+}
+
+int main(int argc, char* argv[])
+{
+    long blocks = argc > 1 ? atol(argv[1]) : DEFAULT_BLOCKS;
+    long ops = argc > 2 ? atol(argv[2]) : DEFAULT_OPS;
+    if(blocks <= 0)
+        blocks = DEFAULT_BLOCKS;
+    if(ops <= 0)
+        ops = DEFAULT_OPS;
+
+    MP_POOL* pool = mp_create_pool(MP_PAGE_SIZE, 1);
+    long cap = blocks * (MP_PAGE_SIZE / 16);
+    void** mem = malloc(cap * sizeof(void*));
+    if(pool == NULL || mem == NULL)
+    {
+        printf("create failed.\n");
+        return -1;
+    }
+
+	//1、填充到 blocks 个 block，片全部存活
+    long n = 0, i;
+    double begin = now_sec();
+    while(n < cap && (n % 4096 || count_blocks(pool) < blocks))
+    {
+        mem[n] = mp_malloc(pool, 16 + xorshift64() % 2033);
+        if(mem[n] == NULL)
+            break;
+        n++;
+    }
+    double fill_sec = now_sec() - begin;
+
+	//2、随机替换
+    begin = now_sec();
+    for(i = 0; i < ops; i++)
+    {
+        long k = xorshift64() % n;
+        mp_free(pool, mem[k]);
+        mem[k] = mp_malloc(pool, 16 + xorshift64() % 2033);
+    }
+    double churn_sec = now_sec() - begin;
+
+    printf("pieces:%ld blocks:%d->%d\n", n, (int)blocks, count_blocks(pool));
+    printf("fill:%.0f ns/op  churn:%.0f ns/op (%.0f ops/s)\n",
+        fill_sec * 1e9 / n, churn_sec * 1e9 / ops, ops / churn_sec);
+
+    for(i = 0; i < n; i++)
+        mp_free(pool, mem[i]);
+    mp_destroy_pool(pool);
+    free(mem);
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include "MemPool.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * 碎片化基准测试：生命周期混合的随机大小分配。
+ * 每次操作申请一片 16~2048 字节的内存，大部分放进短生命周期的环（SHORT_LIVE 次操作后释放），
+ * 一小部分替换长生命周期表中的随机一项（被替换的那片释放）。
+ * 长生命周期的片散落在各个 block 中，bump模式下它们让整块无法回收，slab模式下空出的片可以被复用。
+ * 输出 ops/s 以及结束时的 VmRSS/VmHWM，分别以 bump、slab、glibc 运行对比。
+ */
+
+#define DEFAULT_OPS     (4 * 1000 * 1000)
+#define SHORT_LIVE      1024        // 短生命周期的片在这么多次操作后释放
+#define LONG_SLOTS      20000       // 长生命周期表大小
+#define LONG_PERCENT    5           // 进入长生命周期表的比例
+
+enum { BENCH_BUMP, BENCH_SLAB, BENCH_GLIBC };
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static inline uint64_t xorshift64(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/******************************************
+*name：		random_size
+*brief:		随机分配大小：70% 16~128，25% 129~512，5% 513~2048
+*input:		无
+*output:	无
+*return:	分配大小
+******************************************/
+static size_t random_size(void)
+{
+    uint64_t r = xorshift64();
+    int p = r % 100;
+    r >>= 8;
+    if(p < 70)
+        return 16 + r % 113;
+    if(p < 95)
+        return 129 + r % 384;
+    return 513 + r % 1536;
+}
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/******************************************
+*name：		read_status_kb
+*brief:		从 /proc/self/status 读取一项内存统计
+*input:		key：如 "VmRSS:"
+*output:	无
+*return:	KB，失败返回-1
+******************************************/
+static long read_status_kb(const char* key)
+{
+    char line[256];
+    long kb = -1;
+    FILE* fp = fopen("/proc/self/status", "r");
+    if(fp == NULL)
+        return -1;
+    while(fgets(line, sizeof(line), fp))
+    {
+        if(strncmp(line, key, strlen(key)) == 0)
+        {
+            kb = atol(line + strlen(key));
+            break;
+        }
+    }
+    fclose(fp);
+    return kb;
+}
+
+static MP_POOL* pool;
+static int mode;
+
+static inline void* bench_malloc(size_t size)
+{
+    if(mode == BENCH_GLIBC)
+        return malloc(size);
+    return mp_malloc(pool, size);
+}
+
+static inline void bench_free(void* p)
+{
+    if(p == NULL)
+        return;
+    if(mode == BENCH_GLIBC)
+        free(p);
+    else
+        mp_free(pool, p);
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        printf("Usage: %s <bump|slab|glibc> [ops]\n", argv[0]);
+        return 0;
+    }
+
+    long ops = argc > 2 ? atol(argv[2]) : DEFAULT_OPS;
+    if(ops <= 0)
+        ops = DEFAULT_OPS;
+
+    MP_CONFIG cfg;
+    mp_config_init(&cfg);
+    if(strcmp(argv[1], "glibc") == 0)
+        mode = BENCH_GLIBC;
+    else if(strcmp(argv[1], "slab") == 0)
+        mode = BENCH_SLAB, cfg.mode = MP_MODE_SLAB;
+    else
+        mode = BENCH_BUMP;
+
+    if(mode != BENCH_GLIBC)
+    {
+        pool = mp_create_pool_ex(&cfg);
+        if(pool == NULL)
+        {
+            printf("mp_create_pool_ex failed.\n");
+            return -1;
+        }
+    }
+
+    static void* short_ring[SHORT_LIVE];
+    static void* long_slots[LONG_SLOTS];
+    long i, failed = 0;
+    size_t live_bytes = 0;
+    static size_t long_size[LONG_SLOTS];
+    static size_t short_size[SHORT_LIVE];
+
+    double begin = now_sec();
+    for(i = 0; i < ops; i++)
+    {
+        size_t size = random_size();
+        void* p = bench_malloc(size);
+        if(p == NULL)
+        {
+            failed++;
+            continue;
+        }
+        ((char*)p)[0] = 1;      // 模拟使用
+        ((char*)p)[size - 1] = 1;
+        live_bytes += size;
+
+        if(xorshift64() % 100 < LONG_PERCENT)
+        {
+            int slot = xorshift64() % LONG_SLOTS;
+            if(long_slots[slot])
+                live_bytes -= long_size[slot];
+            bench_free(long_slots[slot]);
+            long_slots[slot] = p;
+            long_size[slot] = size;
+        }
+        else
+        {
+            int slot = i % SHORT_LIVE;
+            if(short_ring[slot])
+                live_bytes -= short_size[slot];
+            bench_free(short_ring[slot]);
+            short_ring[slot] = p;
+            short_size[slot] = size;
+        }
+    }
+    double elapsed = now_sec() - begin;
+
+    printf("mode:%s ops:%ld failed:%ld elapsed:%.2fs ops/s:%.0f\n",
+        argv[1], ops, failed, elapsed, ops / elapsed);
+    printf("live:%luKB VmRSS:%ldKB VmHWM:%ldKB\n",
+        live_bytes / 1024, read_status_kb("VmRSS:"), read_status_kb("VmHWM:"));
+
+    for(i = 0; i < SHORT_LIVE; i++)
+        bench_free(short_ring[i]);
+    for(i = 0; i < LONG_SLOTS; i++)
+        bench_free(long_slots[i]);
+    if(pool)
+        mp_destroy_pool(pool);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "MemPool.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * 释放速度基准测试：先申请 N 片混合大小的内存（75% 16~1024 字节的片，25% 5000~20000 字节的 bucket），
+ * 再按随机顺序全部释放，分别统计申请和释放的耗时。
+ * 释放时需要判断地址是片还是 bucket，bucket 越多越能看出 mp_free 是否与 bucket 数量有关。
+ */
+
+#define DEFAULT_COUNT   100000
+#define BUCKET_PERCENT  25
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static inline uint64_t xorshift64(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        printf("Usage: %s <bump|slab> [count]\n", argv[0]);
+        return 0;
+    }
+
+    long count = argc > 2 ? atol(argv[2]) : DEFAULT_COUNT;
+    if(count <= 0)
+        count = DEFAULT_COUNT;
+
+    MP_CONFIG cfg;
+    mp_config_init(&cfg);
+    if(strcmp(argv[1], "slab") == 0)
+        cfg.mode = MP_MODE_SLAB;
+
+    MP_POOL* pool = mp_create_pool_ex(&cfg);
+    void** mem = malloc(count * sizeof(void*));
+    if(pool == NULL || mem == NULL)
+    {
+        printf("create failed.\n");
+        return -1;
+    }
+
+    long i, buckets = 0, failed = 0;
+    double begin = now_sec();
+    for(i = 0; i < count; i++)
+    {
+        size_t size;
+        if(xorshift64() % 100 < BUCKET_PERCENT)
+        {
+            size = 5000 + xorshift64() % 15001;
+            buckets++;
+        }
+        else
+        {
+            size = 16 + xorshift64() % 1009;
+        }
+        mem[i] = mp_malloc(pool, size);
+        if(mem[i] == NULL)
+            failed++;
+    }
+    double malloc_sec = now_sec() - begin;
+
+    //打乱释放顺序
+    for(i = count - 1; i > 0; i--)
+    {
+        long j = xorshift64() % (i + 1);
+        void* tmp = mem[i];
+        mem[i] = mem[j];
+        mem[j] = tmp;
+    }
+
+    begin = now_sec();
+    for(i = 0; i < count; i++)
+        mp_free(pool, mem[i]);
+    double free_sec = now_sec() - begin;
+
+    printf("mode:%s count:%ld buckets:%ld failed:%ld\n", argv[1], count, buckets, failed);
+    printf("malloc:%.3fs (%.0f ns/op)  free:%.3fs (%.0f ns/op)\n",
+        malloc_sec, malloc_sec * 1e9 / count, free_sec, free_sec * 1e9 / count);
+
+    mp_destroy_pool(pool);
+    free(mem);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "MemPoolCpp.h"
+
+/*
+ * STL 容器基准测试：
+ * 键在 [0, keys) 中随机取，存在就删除，不存在就插入，容器里大约保持 keys/2 个元素，
+ * 分别用 std::map 和 std::unordered_map 运行 ops 次，输出每秒插入+删除次数。
+ * std 为默认的 std::allocator，slab/bump 为对应模式的池加 MemPoolAllocator。
+ * 最后用 ObjectPool 和 new/delete 各构造析构 ops 次对比。
+ */
+
+#define DEFAULT_KEYS    (200 * 1000)
+#define DEFAULT_OPS     (4 * 1000 * 1000)
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static inline uint64_t xorshift64(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+template<class Map>
+static void run_map(const char* name, Map& m, long keys, long ops)
+{
+    rng_state = 88172645463325252ULL;
+    long i;
+    double begin = now_sec();
+    for(i = 0; i < ops; i++)
+    {
+        long key = xorshift64() % keys;
+        typename Map::iterator it = m.find(key);
+        if(it == m.end())
+            m.emplace(key, i);
+        else
+            m.erase(it);
+    }
+    double elapsed = now_sec() - begin;
+    printf("%-14s size:%-7lu %.0f ns/op  %.0f ops/s\n", name, (unsigned long)m.size(), elapsed * 1e9 / ops, ops / elapsed);
+}
+
+struct Order
+{
+    long id;
+    double price;
+    std::vector<int> legs;      // 移动构造时接管，不复制
+    Order(long i, double p, std::vector<int>&& l) : id(i), price(p), legs(std::move(l)) {}
+};
+
+static void run_object(const char* name, bool pooled, long ops)
+{
+    ObjectPool<Order> pool;
+    Order* live[64] = { 0 };
+    long i;
+    double begin = now_sec();
+    for(i = 0; i < ops; i++)
+    {
+        int slot = i % 64;
+        if(live[slot])
+        {
+            if(pooled)
+                pool.destroy(live[slot]);
+            else
+                delete live[slot];
+        }
+        std::vector<int> legs;
+        live[slot] = pooled ? pool.create(i, 1.5, std::move(legs)) : new Order(i, 1.5, std::move(legs));
+    }
+    for(i = 0; i < 64; i++)
+    {
+        if(pooled)
+            pool.destroy(live[i]);
+        else
+            delete live[i];
+    }
+    double elapsed = now_sec() - begin;
+    printf("%-14s %.1f ns/op\n", name, elapsed * 1e9 / ops);
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        printf("Usage: %s <std|slab|bump> [keys] [ops]\n", argv[0]);
+        return 0;
+    }
+
+    long keys = argc > 2 ? atol(argv[2]) : DEFAULT_KEYS;
+    long ops = argc > 3 ? atol(argv[3]) : DEFAULT_OPS;
+    if(keys <= 0)
+        keys = DEFAULT_KEYS;
+    if(ops <= 0)
+        ops = DEFAULT_OPS;
+
+    typedef std::pair<const long, long> Value;
+    if(strcmp(argv[1], "std") == 0)
+    {
+        std::map<long, long> m;
+        std::unordered_map<long, long> u;
+        run_map("map", m, keys, ops);
+        run_map("unordered_map", u, keys, ops);
+        run_object("new/delete", false, ops);
+    }
+    else
+    {
+        MemPool pool(strcmp(argv[1], "bump") == 0 ? MP_MODE_BUMP : MP_MODE_SLAB);
+        MemPoolAllocator<Value> alloc(pool.get());
+        {
+            std::map<long, long, std::less<long>, MemPoolAllocator<Value> > m(alloc);
+            std::unordered_map<long, long, std::hash<long>, std::equal_to<long>, MemPoolAllocator<Value> > u(0, std::hash<long>(), std::equal_to<long>(), alloc);
+            run_map("map", m, keys, ops);
+            run_map("unordered_map", u, keys, ops);
+        }
+        run_object("ObjectPool", true, ops);
+    }
+    return 0;
+}
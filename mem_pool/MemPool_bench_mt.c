@@ -0,0 +1,251 @@
+#include "MemPoolMT.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+
+/*
+ * 多线程生产者/消费者基准测试。
+ * 每对线程之间一个 SPSC 环形队列：生产者申请 16~512 字节的内存，一半放进队列交给消费者释放（跨线程释放），
+ * 另一半放进本地窗口，WINDOW 次之后自己释放；消费者取出后再申请一片临时内存用完释放。
+ * 分别用 mt（线程安全内存池）、lock（一个 slab 模式 MP_POOL 加互斥锁，原来的用法）、glibc 运行，输出每秒申请+释放次数。
+ */
+
+#define MAX_PAIRS       32
+#define RING_SIZE       1024
+#define WINDOW          64
+#define DEFAULT_OPS     (2 * 1000 * 1000)
+
+enum { BENCH_MT, BENCH_LOCK, BENCH_GLIBC };
+
+static int mode;
+static MP_MT_POOL* mt_pool;
+static MP_POOL* lock_pool;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct ring
+{
+    _Atomic(unsigned long) head;    // 消费者读的位置
+    char pad1[56];
+    _Atomic(unsigned long) tail;    // 生产者写的位置
+    char pad2[56];
+    void* items[RING_SIZE];
+};
+
+struct pair
+{
+    pthread_t producer;
+    pthread_t consumer;
+    struct ring ring;
+    long ops;                       // 生产者申请次数
+    _Atomic(int) done;
+    unsigned long count;            // 申请+释放次数
+};
+
+static inline void* bench_malloc(size_t size)
+{
+    void* p;
+    switch(mode)
+    {
+    case BENCH_MT:
+        return mp_mt_malloc(mt_pool, size);
+    case BENCH_LOCK:
+        pthread_mutex_lock(&pool_lock);
+        p = mp_malloc(lock_pool, size);
+        pthread_mutex_unlock(&pool_lock);
+        return p;
+    default:
+        return malloc(size);
+    }
+}
+
+static inline void bench_free(void* p)
+{
+    switch(mode)
+    {
+    case BENCH_MT:
+        mp_mt_free(mt_pool, p);
+        break;
+    case BENCH_LOCK:
+        pthread_mutex_lock(&pool_lock);
+        mp_free(lock_pool, p);
+        pthread_mutex_unlock(&pool_lock);
+        break;
+    default:
+        free(p);
+        break;
+    }
+}
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/******************************************
+*name：		producer
+*brief:		申请内存，一半交给消费者，一半在本地窗口中稍后自己释放
+*input:		arg：pair
+*output:	无
+*return:	NULL
+******************************************/
+static void* producer(void* arg)
+{
+    struct pair* pr = arg;
+    struct ring* ring = &pr->ring;
+    void* window[WINDOW] = { 0 };
+    uint64_t rng = (uintptr_t)pr | 1;
+    unsigned long count = 0;
+    long i;
+
+    for(i = 0; i < pr->ops; i++)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        size_t size = 16 + rng % 497;
+        char* p = bench_malloc(size);
+        if(p == NULL)
+            continue;
+        p[0] = p[size - 1] = 1;
+        count++;
+
+        if(rng & (1 << 20))
+        {
+            unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            while(tail - atomic_load_explicit(&ring->head, memory_order_acquire) >= RING_SIZE)
+                sched_yield();
+            ring->items[tail % RING_SIZE] = p;
+            atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+        }
+        else
+        {
+            int slot = i % WINDOW;
+            if(window[slot])
+            {
+                bench_free(window[slot]);
+                count++;
+            }
+            window[slot] = p;
+        }
+    }
+
+    for(i = 0; i < WINDOW; i++)
+    {
+        if(window[i])
+        {
+            bench_free(window[i]);
+            count++;
+        }
+    }
+    pr->count += count;     // 在 done 之前，消费者看到 done 后才会修改 count
+    atomic_store_explicit(&pr->done, 1, memory_order_release);
+    return NULL;
+}
+
+/******************************************
+*name：		consumer
+*brief:		取出生产者的内存并释放，每取一片再申请释放一片临时内存
+*input:		arg：pair
+*output:	无
+*return:	NULL
+******************************************/
+static void* consumer(void* arg)
+{
+    struct pair* pr = arg;
+    struct ring* ring = &pr->ring;
+    unsigned long count = 0;
+
+    while(1)
+    {
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        if(head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+        {
+            if(atomic_load_explicit(&pr->done, memory_order_acquire)
+                && head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+                break;
+            sched_yield();
+            continue;
+        }
+
+        char* p = ring->items[head % RING_SIZE];
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+        char* tmp = bench_malloc(64);
+        if(tmp)
+        {
+            tmp[0] = p[0];
+            bench_free(tmp);
+            count += 2;
+        }
+        bench_free(p);
+        count++;
+    }
+
+    pr->count += count;
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        printf("Usage: %s <mt|lock|glibc> [pairs] [ops per producer]\n", argv[0]);
+        return 0;
+    }
+
+    int n = argc > 2 ? atoi(argv[2]) : 4;
+    long ops = argc > 3 ? atol(argv[3]) : DEFAULT_OPS;
+    if(n < 1 || n > MAX_PAIRS)
+        n = 4;
+    if(ops <= 0)
+        ops = DEFAULT_OPS;
+
+    if(strcmp(argv[1], "mt") == 0)
+    {
+        mode = BENCH_MT;
+        mt_pool = mp_mt_create_pool();
+    }
+    else if(strcmp(argv[1], "lock") == 0)
+    {
+        MP_CONFIG cfg;
+        mp_config_init(&cfg);
+        cfg.mode = MP_MODE_SLAB;
+        mode = BENCH_LOCK;
+        lock_pool = mp_create_pool_ex(&cfg);
+    }
+    else
+    {
+        mode = BENCH_GLIBC;
+    }
+
+    static struct pair pairs[MAX_PAIRS];
+    int i;
+    double begin = now_sec();
+    for(i = 0; i < n; i++)
+    {
+        pairs[i].ops = ops;
+        pthread_create(&pairs[i].producer, NULL, producer, &pairs[i]);
+        pthread_create(&pairs[i].consumer, NULL, consumer, &pairs[i]);
+    }
+
+    unsigned long count = 0;
+    for(i = 0; i < n; i++)
+    {
+        pthread_join(pairs[i].producer, NULL);
+        pthread_join(pairs[i].consumer, NULL);
+        count += pairs[i].count;
+    }
+    double elapsed = now_sec() - begin;
+
+    printf("mode:%s pairs:%d ops:%lu elapsed:%.2fs ops/s:%.0f\n", argv[1], n, count, elapsed, count / elapsed);
+    if(mt_pool)
+    {
+        mp_mt_pool_statistic(mt_pool);
+        mp_mt_destroy_pool(mt_pool);
+    }
+    if(lock_pool)
+        mp_destroy_pool(lock_pool);
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "MemPool.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <malloc.h>
+
+/*
+ * 小对象测试：
+ * 同时保留 count 个 16~32 字节的随机大小对象，比较带片头（默认）和不带片头（MP_CONFIG.header_free）的池，以及 glibc malloc。
+ * 输出全部申请、全部释放的耗时，和常驻内存增量（/proc/self/statm）平均到每个对象的字节数；
+ * 池另外输出 MP_STATS.footprint 平均到每个对象的字节数。每轮开始前 malloc_trim 把上一轮释放的内存还给系统，
+ * 正式测试前先不输出地跑一轮，避免第一轮承担进程的缺页。
+ */
+
+#define DEFAULT_COUNT   (4 * 1000 * 1000)
+
+static int quiet;
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static inline uint64_t xorshift64(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static long resident_bytes(void)
+{
+    long size = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if(fp == NULL)
+        return 0;
+    if(fscanf(fp, "%ld %ld", &size, &resident) != 2)
+        resident = 0;
+    fclose(fp);
+    return resident * MP_PAGE_SIZE;
+}
+
+/******************************************
+*name：		run
+*brief:		申请 count 个对象并全部保留，再全部释放
+*input:		name：输出的名字；mode：MP_MODE_xxx，-1 表示用 glibc；header_free：池是否不带片头；
+*           backing：MP_BACKING_xxx；mem：存放地址的数组；count：对象数
+*output:	无
+*return:	0成功，-1失败
+******************************************/
+static int run(const char* name, int mode, int header_free, int backing, void** mem, long count)
+{
+    MP_POOL* pool = NULL;
+    if(mode >= 0)
+    {
+        MP_CONFIG cfg;
+        mp_config_init(&cfg);
+        cfg.mode = mode;
+        cfg.header_free = header_free;
+        cfg.backing = backing;
+        if(mode == MP_MODE_SLAB)
+            cfg.block_size = 64 * 1024;     // header_free 要求2的幂
+        pool = mp_create_pool_ex(&cfg);
+        if(pool == NULL)
+            return -1;
+    }
+
+    long i;
+    size_t requested = 0;
+    rng_state = 88172645463325252ULL;
+
+	//1、全部申请，每个对象写满
+    malloc_trim(0);
+    long rss = resident_bytes();
+    double begin = now_sec();
+    for(i = 0; i < count; i++)
+    {
+        size_t size = 16 + xorshift64() % 17;
+        mem[i] = pool ? mp_malloc(pool, size) : malloc(size);
+        if(mem[i] == NULL)
+            return -1;
+        memset(mem[i], 0x5a, size);
+        requested += size;
+    }
+    double alloc_sec = now_sec() - begin;
+    rss = resident_bytes() - rss;
+
+    MP_STATS stats;
+    if(pool)
+        mp_get_stats(pool, &stats);
+
+	//2、全部释放
+    begin = now_sec();
+    for(i = 0; i < count; i++)
+    {
+        if(pool)
+            mp_free(pool, mem[i]);
+        else
+            free(mem[i]);
+    }
+    double free_sec = now_sec() - begin;
+
+    if(!quiet)
+    {
+        printf("%-16s malloc:%5.1f ns/op  free:%5.1f ns/op  rss:%5.1f B/obj",
+            name, alloc_sec * 1e9 / count, free_sec * 1e9 / count, (double)rss / count);
+        if(pool)
+            printf("  footprint:%5.1f B/obj", (double)stats.footprint / count);
+        printf("  (requested %.1f B/obj)\n", (double)requested / count);
+    }
+    if(pool)
+        mp_destroy_pool(pool);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    long count = argc > 1 ? atol(argv[1]) : DEFAULT_COUNT;
+    if(count <= 0)
+        count = DEFAULT_COUNT;
+    void** mem = malloc(count * sizeof(void*));
+    if(mem == NULL)
+        return -1;
+    memset(mem, 0, count * sizeof(void*));     // 数组本身的缺页不算到第一轮里
+
+    int ret = 0, i;
+    int backing[] = { MP_BACKING_MALLOC, MP_BACKING_MMAP };
+    quiet = 1;
+    run("warmup", MP_MODE_SLAB, 1, MP_BACKING_MMAP, mem, count);
+    quiet = 0;
+    for(i = 0; i < 2; i++)
+    {
+        printf("backing:%s\n", backing[i] == MP_BACKING_MMAP ? "mmap" : "malloc");
+        ret |= run("slab", MP_MODE_SLAB, 0, backing[i], mem, count);
+        ret |= run("slab header_free", MP_MODE_SLAB, 1, backing[i], mem, count);
+        ret |= run("bump", MP_MODE_BUMP, 0, backing[i], mem, count);
+        ret |= run("bump header_free", MP_MODE_BUMP, 1, backing[i], mem, count);
+    }
+    ret |= run("glibc", -1, 0, 0, mem, count);
+    if(ret)
+        printf("FAILED\n");
+    free(mem);
+    return ret ? 1 : 0;
+}
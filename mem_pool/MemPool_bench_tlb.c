@@ -0,0 +1,210 @@
+#include "MemPool.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/*
+ * block 后备方式基准测试：
+ * 1、在 bump 模式的池中申请 32~256 字节的片直到总量达到 MB，统计申请速度和缺页次数；
+ * 2、把所有片随机串成一个环（片的前8字节指向下一片），沿环访问 steps 次，统计每步耗时和 dTLB 读缺失；
+ * 3、全部释放，对比释放前后的 VmRSS（mmap 后备的区域空闲后 MADV_DONTNEED 归还物理内存）。
+ * 计数器用 perf_event_open 读取，没有硬件计数器（如虚拟机）时显示 n/a，也可以直接在 perf stat 下运行。
+ */
+
+#define DEFAULT_MB      256
+#define DEFAULT_STEPS   (20 * 1000 * 1000)
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static inline uint64_t xorshift64(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/******************************************
+*name：		counter_open
+*brief:		打开当前线程的一个 perf 计数器（只计用户态）
+*input:		type/config：perf_event_attr 的类型和配置
+*output:	无
+*return:	计数器fd，不支持返回-1
+******************************************/
+static int counter_open(int type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long counter_read(int fd)
+{
+    long value;
+    if(fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value))
+        return -1;
+    return value;
+}
+
+static void counter_print(const char* name, long value)
+{
+    if(value < 0)
+        printf("%s:n/a", name);
+    else
+        printf("%s:%ld", name, value);
+}
+
+/******************************************
+*name：		read_kb
+*brief:		从 /proc 文件中读取一项以 kB 为单位的统计
+*input:		path：文件；key：如 "VmRSS:"
+*output:	无
+*return:	KB，失败返回-1
+******************************************/
+static long read_kb(const char* path, const char* key)
+{
+    char line[256];
+    long kb = -1;
+    FILE* fp = fopen(path, "r");
+    if(fp == NULL)
+        return -1;
+    while(fgets(line, sizeof(line), fp))
+    {
+        if(strncmp(line, key, strlen(key)) == 0)
+        {
+            kb = atol(line + strlen(key));
+            break;
+        }
+    }
+    fclose(fp);
+    return kb;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        printf("Usage: %s <malloc|mmap|thp|hugetlb> [MB] [block KB] [steps]\n", argv[0]);
+        return 0;
+    }
+
+    MP_CONFIG cfg;
+    mp_config_init(&cfg);
+    cfg.block_size = 64 * 1024;
+    if(strcmp(argv[1], "malloc") == 0)
+    {
+        cfg.block_size = MP_PAGE_SIZE;   // 原来的用法：4KB 的 block 单独申请
+    }
+    else
+    {
+        cfg.backing = MP_BACKING_MMAP;
+        if(strcmp(argv[1], "thp") == 0)
+            cfg.huge_page = MP_HUGE_MADVISE;
+        else if(strcmp(argv[1], "hugetlb") == 0)
+            cfg.huge_page = MP_HUGE_TLB;
+    }
+
+    long mb = argc > 2 ? atol(argv[2]) : DEFAULT_MB;
+    if(argc > 3 && atol(argv[3]) > 0)
+        cfg.block_size = atol(argv[3]) * 1024;
+    long steps = argc > 4 ? atol(argv[4]) : DEFAULT_STEPS;
+    if(mb <= 0)
+        mb = DEFAULT_MB;
+
+    MP_POOL* pool = mp_create_pool_ex(&cfg);
+    long cap = mb * 1024 * 1024 / 32;
+    void** mem = malloc(cap * sizeof(void*));
+    if(pool == NULL || mem == NULL)
+    {
+        printf("create failed.\n");
+        return -1;
+    }
+
+    int tlb_fd = counter_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    int fault_fd = counter_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+
+	//1、申请
+    long n = 0, i;
+    size_t total = 0;
+    long faults = counter_read(fault_fd);
+    double begin = now_sec();
+    while(total < (size_t)mb * 1024 * 1024 && n < cap)
+    {
+        size_t size = 32 + xorshift64() % 225;
+        void** p = mp_malloc(pool, size);
+        if(p == NULL)
+            break;
+        *p = NULL;
+        mem[n++] = p;
+        total += size;
+    }
+    double alloc_sec = now_sec() - begin;
+    if(faults >= 0)
+        faults = counter_read(fault_fd) - faults;
+
+	//2、随机串成环后沿环访问
+    long* order = malloc(n * sizeof(long));
+    for(i = 0; i < n; i++)
+        order[i] = i;
+    for(i = n - 1; i > 0; i--)
+    {
+        long j = xorshift64() % (i + 1);
+        long tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for(i = 0; i < n; i++)
+        *(void**)mem[order[i]] = mem[order[(i + 1) % n]];
+    free(order);
+
+    void** p = mem[0];
+    long misses = counter_read(tlb_fd);
+    begin = now_sec();
+    for(i = 0; i < steps; i++)
+        p = *p;
+    double chase_sec = now_sec() - begin;
+    if(p == NULL)       // 使用 p，避免访问被优化掉
+        printf("broken ring\n");
+    if(misses >= 0)
+        misses = counter_read(tlb_fd) - misses;
+
+    long rss = read_kb("/proc/self/status", "VmRSS:");
+    long thp = read_kb("/proc/self/smaps_rollup", "AnonHugePages:");
+
+	//3、全部释放
+    begin = now_sec();
+    for(i = 0; i < n; i++)
+        mp_free(pool, mem[i]);
+    double free_sec = now_sec() - begin;
+    long rss_free = read_kb("/proc/self/status", "VmRSS:");
+
+    printf("mode:%s pieces:%ld data:%luMB block:%luKB\n", argv[1], n, total >> 20, pool->block_size / 1024);
+    printf("alloc:%.0f ns/op  ", alloc_sec * 1e9 / n);
+    counter_print("page faults", faults);
+    printf("\nchase:%.1f ns/step  ", chase_sec * 1e9 / steps);
+    counter_print("dTLB misses/step*1000", misses < 0 ? -1 : misses * 1000 / steps);
+    printf("\nfree:%.0f ns/op  VmRSS:%ldKB -> %ldKB  AnonHugePages:%ldKB\n",
+        free_sec * 1e9 / n, rss, rss_free, thp);
+    if(pool->backing == MP_BACKING_MMAP)
+        printf("regions mapped:%ld released:%ld\n", pool->region_maps, pool->region_releases);
+
+    mp_destroy_pool(pool);
+    free(mem);
+    return 0;
+}
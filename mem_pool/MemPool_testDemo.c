@@ -50,6 +50,29 @@ int main()
 
     mp_pool_statistic(pool);
 
+    //测试检查点：回滚后检查点之后的 piece 和 bucket 都被撤销，之前的不受影响
+    printf("------------ checkpoint test --------------\n");
+    char* keep = (char*)mp_malloc(pool, 256);
+    int outer = mp_mark(pool);
+    for(i = 0; i < 4; i++)
+        mem[i] = (char*)mp_malloc(pool, 512);
+    int inner = mp_mark(pool);
+    for(; i < 8; i++)
+        mem[i] = (char*)mp_malloc(pool, 8192);
+    mp_rollback(pool, inner);
+    mp_pool_statistic(pool);
+    mp_rollback(pool, outer);
+    mp_free(pool, keep);
+
+    mp_pool_statistic(pool);
+
+    //统计输出为 JSON
+    char json[1024];
+    MP_STATS stats;
+    mp_get_stats(pool, &stats);
+    mp_stats_json(&stats, json, sizeof(json));
+    printf("%s\n", json);
+
     mp_destroy_pool(pool);
     return 0;
 }
\ No newline at end of file
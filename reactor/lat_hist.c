@@ -0,0 +1,100 @@
+#include "lat_hist.h"
+#include <stdio.h>
+#include <string.h>
+
+/******************************************
+*name：		lh_init
+*brief:		初始化直方图
+*input:		h：直方图
+*output:	无
+*return:	无
+******************************************/
+void lh_init(LAT_HIST* h)
+{
+    memset(h, 0, sizeof(LAT_HIST));
+    h->min = UINT64_MAX;
+}
+
+/******************************************
+*name：		lh_merge
+*brief:		把src合并到dst
+*input:		dst：目标直方图；src：源直方图
+*output:	无
+*return:	无
+******************************************/
+void lh_merge(LAT_HIST* dst, const LAT_HIST* src)
+{
+    int i;
+    for(i = 0; i < LH_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if(src->min < dst->min)
+        dst->min = src->min;
+    if(src->max > dst->max)
+        dst->max = src->max;
+}
+
+/******************************************
+*name：		lh_upper
+*brief:		桶中最大的值
+*input:		idx：桶下标
+*output:	无
+*return:	桶的上界（含）
+******************************************/
+static uint64_t lh_upper(int idx)
+{
+    if(idx < 2 * LH_SUB_BUCKETS)
+        return idx;
+
+    int seg = (idx - 2 * LH_SUB_BUCKETS) / LH_SUB_BUCKETS;  // 最高位 = seg + LH_SUB_BITS + 1
+    int sub = (idx - 2 * LH_SUB_BUCKETS) % LH_SUB_BUCKETS;
+    int shift = seg + 1;
+    return (((uint64_t)(LH_SUB_BUCKETS + sub) + 1) << shift) - 1;
+}
+
+/******************************************
+*name：		lh_percentile
+*brief:		分位数，返回所在桶的上界（不超过记录到的最大值）
+*input:		h：直方图；pct：分位（如99.9）
+*output:	无
+*return:	分位数，没有数据返回0
+******************************************/
+uint64_t lh_percentile(const LAT_HIST* h, double pct)
+{
+    if(h->count == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)(h->count * pct / 100.0);
+    uint64_t sum = 0;
+    int i;
+    if(target >= h->count)
+        target = h->count - 1;
+    for(i = 0; i < LH_BUCKETS; i++)
+    {
+        sum += h->counts[i];
+        if(sum > target)
+        {
+            uint64_t v = lh_upper(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+/******************************************
+*name：		lh_format_json
+*brief:		输出为JSON对象：count/min/mean/p50/p90/p99/p999/max
+*input:		h：直方图；scale：输出时除以的系数（如记录纳秒、输出微秒时为1000）；buf/len：输出缓冲
+*output:	buf：文本
+*return:	写入的长度
+******************************************/
+int lh_format_json(const LAT_HIST* h, double scale, char* buf, int len)
+{
+    int n = snprintf(buf, len,
+        "{\"count\":%lu,\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}",
+        (unsigned long)h->count, h->count ? h->min / scale : 0.0, h->count ? (double)h->sum / h->count / scale : 0.0,
+        lh_percentile(h, 50) / scale, lh_percentile(h, 90) / scale, lh_percentile(h, 99) / scale,
+        lh_percentile(h, 99.9) / scale, h->max / scale);
+    return n < len ? n : len - 1;
+}
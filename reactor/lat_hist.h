@@ -0,0 +1,65 @@
+#ifndef __LAT_HIST_H__
+#define __LAT_HIST_H__
+
+/*
+ * HDR 风格的延迟直方图（对数-线性分桶）。
+ * 小于 256 的值每个值一个桶；更大的值按最高位分段，每段再线性分成 LH_SUB_BUCKETS 个桶，
+ * 相对误差小于 1/LH_SUB_BUCKETS（<0.8%），记录一次 O(1)，可覆盖 64 位全部取值。
+ * 只由一个线程写，多个线程的直方图在结束时合并。
+ */
+#include <stdint.h>
+
+#define LH_SUB_BITS     7
+#define LH_SUB_BUCKETS  (1 << LH_SUB_BITS)                          // 每段的桶数
+#define LH_BUCKETS      (2 * LH_SUB_BUCKETS + (63 - LH_SUB_BITS) * LH_SUB_BUCKETS)
+
+struct _LAT_HIST {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t counts[LH_BUCKETS];
+};
+typedef struct _LAT_HIST LAT_HIST;
+
+/******************************************
+*name：		lh_index
+*brief:		值所在的桶
+*input:		v：值
+*output:	无
+*return:	桶下标
+******************************************/
+static inline int lh_index(uint64_t v)
+{
+    if(v < 2 * LH_SUB_BUCKETS)
+        return (int)v;
+
+    int m = 63 - __builtin_clzll(v);    // 最高位，>= LH_SUB_BITS + 1
+    int sub = (int)(v >> (m - LH_SUB_BITS)) & (LH_SUB_BUCKETS - 1);
+    return 2 * LH_SUB_BUCKETS + (m - LH_SUB_BITS - 1) * LH_SUB_BUCKETS + sub;
+}
+
+/******************************************
+*name：		lh_record
+*brief:		记录一个值
+*input:		h：直方图；v：值
+*output:	无
+*return:	无
+******************************************/
+static inline void lh_record(LAT_HIST* h, uint64_t v)
+{
+    h->counts[lh_index(v)]++;
+    h->count++;
+    h->sum += v;
+    if(v < h->min)
+        h->min = v;
+    if(v > h->max)
+        h->max = v;
+}
+
+void lh_init(LAT_HIST* h);
+void lh_merge(LAT_HIST* dst, const LAT_HIST* src);
+uint64_t lh_percentile(const LAT_HIST* h, double pct);
+int lh_format_json(const LAT_HIST* h, double scale, char* buf, int len);
+
+#endif
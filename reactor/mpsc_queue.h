@@ -0,0 +1,68 @@
+#ifndef __MPSC_QUEUE_H__
+#define __MPSC_QUEUE_H__
+
+/*
+ * 无锁多生产者单消费者队列（侵入式）
+ * 生产者（工作线程）CAS 压栈，消费者（事件循环）一次性摘下整条链表再反转，恢复 FIFO 顺序。
+ * 消费者总是整体取走，不存在单节点出栈，因此没有 ABA 问题。
+ */
+#include <stddef.h>
+#include <stdatomic.h>
+
+struct mpsc_node
+{
+    struct mpsc_node* next;
+};
+
+struct mpsc_queue
+{
+    _Atomic(struct mpsc_node*) head;
+};
+
+static inline void mpsc_init(struct mpsc_queue* q)
+{
+    atomic_init(&q->head, NULL);
+}
+
+/******************************************
+*name：		mpsc_push
+*brief:		生产者放入一个节点，可多线程并发调用
+*input:		q：队列；node：节点
+*output:	无
+*return:	1：放入前队列为空（调用者需要唤醒消费者）；0：无需唤醒
+******************************************/
+static inline int mpsc_push(struct mpsc_queue* q, struct mpsc_node* node)
+{
+    struct mpsc_node* old = atomic_load_explicit(&q->head, memory_order_relaxed);
+    do
+    {
+        node->next = old;
+    } while(!atomic_compare_exchange_weak_explicit(&q->head, &old, node,
+                memory_order_release, memory_order_relaxed));
+
+    return old == NULL;
+}
+
+/******************************************
+*name：		mpsc_pop_all
+*brief:		消费者取走队列中全部节点，只允许单线程调用
+*input:		q：队列
+*output:	无
+*return:	按放入顺序排列的链表头，队列为空返回NULL
+******************************************/
+static inline struct mpsc_node* mpsc_pop_all(struct mpsc_queue* q)
+{
+    struct mpsc_node* node = atomic_exchange_explicit(&q->head, NULL, memory_order_acquire);
+    struct mpsc_node* fifo = NULL;
+
+    while(node)     // 反转成 FIFO
+    {
+        struct mpsc_node* next = node->next;
+        node->next = fifo;
+        fifo = node;
+        node = next;
+    }
+    return fifo;
+}
+
+#endif
@@ -0,0 +1,2308 @@
+#define _GNU_SOURCE     // accept4
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/un.h>
+#include <sys/sendfile.h>
+#include <signal.h>
+#include "reactor.h"
+#include "mpsc_queue.h"
+
+
+#define MAX_BUFFER_SIZE 1024
+#define SOCKITEM_CHUNK  1024        // sockitem按块分配，一块中的个数
+#define ADMIN_MAX_CONN_LIST     1000    // conn命令最多列出的连接数
+#define FILE_MAX_PER_EVENT      (1024 * 1024)   // 一次可写事件中最多发送的文件字节数，避免大文件饿死其他连接
+#define FILE_COPY_BUFFER        (64 * 1024)     // file_copy模式下pread的缓冲大小
+#define UDP_MAX_DGRAM           2048    // 单个UDP报文的缓冲大小，更长的报文被截断
+#define UDP_GRO_BUFFER          65536   // 开启GRO时每个接收缓冲的大小，可容纳内核合并的多个报文
+#define UDP_GRO_BATCH           16      // 开启GRO时recvmmsg一次最多收的缓冲数，限制内存
+#define UDP_MAX_PER_EVENT       1024    // 一次可读事件最多处理的报文数，避免饿死其他fd
+
+//REACTOR_CONFIG的默认值
+#define EPOLL_BATCH             256     // 连接数再多也不需要一次全取回，小数组始终在cache中
+#define LISTEN_BACKLOG          4096
+#define ACCEPT_MAX_PER_EVENT    1024
+#define STAT_INTERVAL_MS        1000
+#define UDP_BATCH               64      // recvmmsg/sendmmsg一次最多收发的报文数
+#define CONN_HIGH_WATER         (64 * 1024)         // 连接积压的输出达到它时停止读
+#define CONN_LOW_WATER          (16 * 1024)         // 降到它以下时恢复读
+#define GLOBAL_HIGH_WATER       (64 * 1024 * 1024)  // 本循环所有连接积压的输出合计达到它时，有积压的连接都停止读
+#define GLOBAL_LOW_WATER        (32 * 1024 * 1024)
+#define IDLE_TIMEOUT_MS         60000
+#define READ_TIMEOUT_MS         10000
+#define WRITE_TIMEOUT_MS        10000
+
+#ifdef REACTOR_USE_THREADPOOL
+#define MAX_WORKER_NUM      8       // 循环自己创建线程池时的最大线程数
+#define MAX_DISPATCH_BATCH  1024    // 一次唤醒中最多积攒多少个请求批量提交给线程池
+#endif
+
+//sockitem的类型
+#define SI_CONN         1   // listener accept的客户端连接
+#define SI_LISTEN       2   // listen fd
+#define SI_NOTIFY       3   // eventfd
+#define SI_ADMIN_LISTEN 4   // 管理端口的listen fd
+#define SI_ADMIN        5   // 管理连接
+#define SI_USER_FD      6   // reactor_add_fd 注册的fd
+#define SI_UDP          7   // reactor_add_udp 创建的UDP socket
+
+//逐连接的日志只在调试时打开，避免热路径上printf
+#ifdef REACTOR_CONN_LOG
+#define conn_log printf
+#else
+#define conn_log(...)
+#endif
+
+struct job;
+
+//连接的冷数据：缓冲区、超时计时等，只有真正收发数据或定时器到期时才访问
+struct sockbuf
+{
+    char recvbuffer[MAX_BUFFER_SIZE]; // 接收缓冲
+	char sendinline[MAX_BUFFER_SIZE]; // 发送缓冲的初始空间，不够时换成堆上按倍增长的缓冲，发完后换回
+    char* sendbuffer;   // 发送缓冲，指向sendinline或堆
+    int recvlength; // 接收缓冲区中的数据长度
+    int sendlength; // 发送缓冲区中的数据长度
+    int sendcap;    // 发送缓冲大小
+
+    //读背压：积压的输出达到高水位时停止读（不监听EPOLLIN），降到低水位以下再恢复
+    uint32_t events;            // 当前在epoll中监听的事件
+    int throttled;              // 是否已停止读
+    long backlog;               // 已计入 r->backlog 的积压字节数
+    struct sockitem* throttle_prev;     // 停止读的连接链表
+    struct sockitem* throttle_next;
+
+    //超时管理：收发时只记录时间戳，定时器到期时才计算真正的截止时间并重新挂入时间轮，重置代价为O(1)
+    TW_TIMER timer;
+    uint64_t read_start;    // 接收缓冲中有半帧的起始时间，0表示没有
+    uint64_t write_start;   // 发送缓冲中有数据且未取得进展的起始时间，0表示没有
+
+    //跟踪信息，供管理端口查询
+    struct sockaddr_in peer;    // 对端地址
+    uint64_t created;           // 建立连接的时间
+    unsigned long bytes_in;     // 累计接收字节数
+    unsigned long bytes_out;    // 累计发送字节数
+
+    //正在发送的文件区间，发完sendbuffer后发送；发送期间不再处理后续请求，保证响应顺序
+    int file_fd;                // <0表示没有
+    off_t file_offset;
+    size_t file_remain;
+
+#ifdef REACTOR_USE_THREADPOOL
+    struct job* pending_head;   // 等待派发的请求，同一连接同时只派发一个，以保证按序处理和响应
+    struct job* pending_tail;
+    int npending;               // 待派发的请求数
+#endif
+};
+
+//连接的热数据：每个事件都要访问，控制在一个cache line内，按块连续分配
+struct sockitem
+{
+	int sockfd;
+    short port_idx;             // 所属listen端口的序号
+    unsigned char type;         // SI_xxx
+#ifdef REACTOR_USE_THREADPOOL
+    unsigned char inflight;     // 是否有请求正在工作线程中处理
+    unsigned char closed;       // 连接已关闭但仍有请求在处理，待其返回后再释放 sockitem
+#endif
+	int (*callback)(void *arg);	//回调函数
+    REACTOR* r;                 // 所属事件循环，回调函数中使用
+    uint64_t last_active;       // 最近一次收发数据的时间
+    struct sockbuf* buf;        // 冷数据，只有客户端连接有，其他为NULL
+    struct sockitem* next_free; // 空闲链表
+    void* ctx;                  // 管理连接、用户fd等其他类型fd的私有数据
+} __attribute__((aligned(64)));
+
+//跨线程投递给事件循环的任务，经无锁队列 + eventfd 交给事件循环执行
+struct reactor_task
+{
+    struct mpsc_node node;      // 必须是第一个成员
+    void (*run)(REACTOR* r, struct reactor_task* t);    // 执行任务，并负责释放
+};
+
+//reactor_post投递的任务
+struct post_task
+{
+    struct reactor_task base;
+    REACTOR_TASK_CB cb;
+    void* arg;
+};
+
+#ifdef REACTOR_USE_THREADPOOL
+//交给工作线程处理的一个请求
+struct job
+{
+    struct reactor_task task;   // 必须是第一个成员，处理完后作为任务交回事件循环
+    struct job* next;           // 连接的待派发链表
+    struct sockitem* si;        // 所属连接
+    REACTOR_HANDLER handler;
+    REACTOR_FILE file;          // 响应附带的文件
+    int reqlen;
+    int resplen;
+    char req[MAX_BUFFER_SIZE];
+    char resp[MAX_BUFFER_SIZE];
+};
+#endif
+
+//reactor_add_fd注册的fd
+struct user_fd
+{
+    REACTOR_IO_CB read_cb;
+    REACTOR_IO_CB write_cb;
+    void* arg;
+};
+
+//reactor_add_udp创建的UDP socket：一次recvmmsg收一批报文，回复攒成一批sendmmsg发出
+struct udp_sock
+{
+    REACTOR_UDP_HANDLER handler;
+    int batch;                  // 一次recvmmsg的缓冲数
+    int slot;                   // 每个接收缓冲的大小
+    int gro;                    // 是否开启了UDP_GRO
+    struct mmsghdr* rmsgs;      // 接收
+    struct iovec* riov;
+    struct sockaddr_in* raddr;
+    char* rbuf;
+    char* rcmsg;                // GRO的分段大小
+    int nsend;                  // 已攒下的回复数
+    struct mmsghdr* smsgs;      // 发送，共UDP_BATCH个
+    struct iovec* siov;
+    struct sockaddr_in* saddr;
+    char* sbuf;
+};
+
+//管理连接：读入一行命令，输出结果后关闭
+struct admin_session
+{
+    char cmd[128];
+    int cmdlength;
+    char* out;      // 待发送的结果
+    int outlength;
+    int outpos;     // 已发送的位置
+};
+
+struct _REACTOR
+{
+    REACTOR_CONFIG cfg;
+    int epfd;
+    int idlefd;             // 预留的fd，fd耗尽时释放它来accept并关闭新连接，避免listen fd一直可读导致空转
+    int notifyfd;           // eventfd，其他线程投递任务或停止时唤醒事件循环
+    int stop;               // reactor_stop设置，事件循环本轮结束后退出
+    struct mpsc_queue tasks;    // 其他线程投递的任务
+    struct reactor_stat stat;
+    unsigned long last_accepts; // 上个输出周期结束时的统计，用于计算速率
+    unsigned long last_events;
+    unsigned long last_wakeups;
+    unsigned long last_udp_in;
+    unsigned long last_udp_calls;
+    unsigned long last_throttles;
+    TW_TIMER stat_timer;    // 周期输出统计
+    struct epoll_event* events;     // cfg.epoll_batch个
+    uint32_t revents;               // 当前回调对应的事件
+    struct sockitem* free_items;    // 空闲的sockitem
+    struct sockitem** chunks;       // 所有sockitem块，遍历连接时使用
+    int nchunks;
+    uint64_t now;           // 本轮epoll_wait返回时的时间（毫秒），回调中统一使用，避免反复取时间
+    TW_WHEEL wheel;         // 连接超时时间轮
+    REACTOR_HANDLER handlers[STAT_MAX_PORT];    // 各listen端口的业务处理，下标为port_idx
+    char admin_path[108];   // 管理端口路径，销毁时删除
+    long backlog;           // 所有连接积压的输出合计
+    int global_throttling;  // backlog超过全局高水位，尚未降到低水位
+    int resume_pending;     // 全局积压已降到低水位，本轮事件处理完后恢复停止读的连接
+    struct sockitem* throttled;     // 停止读的连接
+
+#ifdef REACTOR_USE_THREADPOOL
+    TP_POOL* workers;       // 工作线程池
+    int own_workers;        // 线程池是否由本循环创建
+    int inflight;           // 已派发、尚未交回的请求数
+    void* dispatch[MAX_DISPATCH_BATCH]; // 本轮待批量提交的 job
+    int ndispatch;
+#endif
+};
+
+static int recv_cb(void *arg);
+static int send_cb(void *arg);
+static void conn_rearm_timer(struct sockitem* si);
+
+/******************************************
+*name：		conn_attach_file
+*brief:		把响应附带的文件区间挂到连接上，等sendbuffer发完后发送
+*input:		si：连接；file：文件区间
+*output:	无
+*return:	无
+******************************************/
+static void conn_attach_file(struct sockitem* si, REACTOR_FILE* file)
+{
+    if(file->length == 0)
+    {
+        close(file->fd);
+        return;
+    }
+    si->buf->file_fd = file->fd;
+    si->buf->file_offset = file->offset;
+    si->buf->file_remain = file->length;
+}
+
+/******************************************
+*name：		conn_backlog
+*brief:		连接积压的输出：发送缓冲中未发送的字节，线程池模式下每个待处理的请求按最大响应长度预留
+*input:		si：连接
+*output:	无
+*return:	字节数
+******************************************/
+static long conn_backlog(struct sockitem* si)
+{
+    long n = si->buf->sendlength;
+#ifdef REACTOR_USE_THREADPOOL
+    n += (long)(si->buf->npending + si->inflight) * MAX_BUFFER_SIZE;
+#endif
+    return n;
+}
+
+/******************************************
+*name：		conn_reserve
+*brief:		保证发送缓冲中至少还有need字节空闲，不够时换成堆上的缓冲并按倍增长。
+            积压由读背压限制在高水位附近，缓冲不会无限增长
+*input:		si：连接；need：需要的空闲字节数
+*output:	无
+*return:	0：成功；-1：内存不足
+******************************************/
+static int conn_reserve(struct sockitem* si, int need)
+{
+    struct sockbuf* buf = si->buf;
+    if(buf->sendcap - buf->sendlength >= need)
+        return 0;
+
+    int cap = buf->sendcap * 2;
+    while(cap - buf->sendlength < need)
+        cap *= 2;
+
+    char* p;
+    if(buf->sendbuffer == buf->sendinline)
+    {
+        p = (char*)malloc(cap);
+        if(p)
+            memcpy(p, buf->sendinline, buf->sendlength);
+    }
+    else
+        p = (char*)realloc(buf->sendbuffer, cap);
+    if(p == NULL)
+        return -1;
+
+    buf->sendbuffer = p;
+    buf->sendcap = cap;
+    return 0;
+}
+
+/******************************************
+*name：		sockitem_alloc
+*brief:		分配一个清零的sockitem。按块向系统申请，块内连续存放，事件循环访问的热数据更集中
+*input:		r：事件循环；type：SI_xxx
+*output:	无
+*return:	sockitem，失败返回NULL
+******************************************/
+static struct sockitem* sockitem_alloc(REACTOR* r, int type)
+{
+    //空闲链表为空时申请一整块（块不归还给系统，循环销毁时才释放）
+    if(r->free_items == NULL)
+    {
+        struct sockitem* chunk;
+        struct sockitem** chunks = (struct sockitem**)realloc(r->chunks, (r->nchunks + 1) * sizeof(struct sockitem*));
+        if(chunks == NULL)
+            return NULL;
+        r->chunks = chunks;
+        if(posix_memalign((void**)&chunk, 64, SOCKITEM_CHUNK * sizeof(struct sockitem)))
+            return NULL;
+        memset(chunk, 0, SOCKITEM_CHUNK * sizeof(struct sockitem));
+        r->chunks[r->nchunks++] = chunk;
+
+        int i;
+        for(i = SOCKITEM_CHUNK - 1; i >= 0; i--)
+        {
+            chunk[i].next_free = r->free_items;
+            r->free_items = &chunk[i];
+        }
+    }
+
+    struct sockitem* si = r->free_items;
+    r->free_items = si->next_free;
+    memset(si, 0, sizeof(struct sockitem));
+    si->r = r;
+    si->type = type;
+    return si;
+}
+
+/******************************************
+*name：		sockitem_free
+*brief:		归还sockitem到空闲链表
+*input:		si：sockitem
+*output:	无
+*return:	无
+******************************************/
+static void sockitem_free(struct sockitem* si)
+{
+    REACTOR* r = si->r;
+    si->callback = NULL;
+    si->type = 0;
+    si->next_free = r->free_items;
+    r->free_items = si;
+}
+
+/******************************************
+*name：		sockitem_watch
+*brief:		把sockitem的fd加入epoll或修改监听的事件
+*input:		si：sockitem；op：EPOLL_CTL_ADD/EPOLL_CTL_MOD；events：epoll事件
+*output:	无
+*return:	epoll_ctl的返回值
+******************************************/
+static int sockitem_watch(struct sockitem* si, int op, uint32_t events)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(struct epoll_event));
+    ev.events = events;
+    ev.data.ptr = si;
+    return epoll_ctl(si->r->epfd, op, si->sockfd, &ev);
+}
+
+/******************************************
+*name：		sockSetReuseAddr
+*brief:		设置socket SO_REUSEADDR
+*input:		sockfd：需要设置的fd
+*output:	无
+*return:	0：成功
+******************************************/
+static int sockSetReuseAddr(int sockfd)
+{
+    int reuse = 1;
+    return setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+}
+
+/******************************************
+*name：		now_ns
+*brief:		获取单调时钟的当前时间
+*input:		无
+*output:	无
+*return:	纳秒数
+******************************************/
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/******************************************
+*name：		push_task
+*brief:		任务放入事件循环的任务队列，队列由空变非空时才写 eventfd，一次唤醒可以带回多个任务
+*input:		r：事件循环；t：任务
+*output:	无
+*return:	无
+******************************************/
+static void push_task(REACTOR* r, struct reactor_task* t)
+{
+    if(mpsc_push(&r->tasks, &t->node))
+        eventfd_write(r->notifyfd, 1);
+}
+
+#ifdef REACTOR_USE_THREADPOOL
+/******************************************
+*name：		worker_cb
+*brief:		工作线程中执行请求，完成后作为任务交回事件循环
+*input:		arg：job
+*output:	无
+*return:	NULL
+******************************************/
+static void* worker_cb(void* arg)
+{
+    struct job* j = arg;
+
+    j->file.fd = -1;
+    j->resplen = j->handler(j->req, j->reqlen, j->resp, MAX_BUFFER_SIZE, &j->file);
+    push_task(j->si->r, &j->task);
+
+    return NULL;    // push 之后 job 归事件循环所有，不能再访问
+}
+
+/******************************************
+*name：		flush_dispatch
+*brief:		将本轮积攒的请求批量提交给线程池
+*input:		r：事件循环
+*output:	无
+*return:	无
+******************************************/
+static void flush_dispatch(REACTOR* r)
+{
+    if(r->ndispatch > 0)
+    {
+        tp_submit_batch(r->workers, worker_cb, r->dispatch, r->ndispatch);
+        r->inflight += r->ndispatch;
+        r->ndispatch = 0;
+    }
+}
+
+/******************************************
+*name：		dispatch_next
+*brief:		取出连接的下一个待处理请求放入派发批次
+*input:		si：连接
+*output:	无
+*return:	无
+******************************************/
+static void dispatch_next(struct sockitem* si)
+{
+    REACTOR* r = si->r;
+    struct job* j = si->buf->pending_head;
+    if(j == NULL || si->inflight || si->buf->file_fd >= 0)
+        return;
+
+    si->buf->pending_head = j->next;
+    if(si->buf->pending_head == NULL)
+        si->buf->pending_tail = NULL;
+    si->buf->npending--;
+    si->inflight = 1;
+
+    r->dispatch[r->ndispatch++] = j;
+    if(r->ndispatch == MAX_DISPATCH_BATCH)
+        flush_dispatch(r);
+}
+
+/******************************************
+*name：		job_done
+*brief:		工作线程处理完的请求回到事件循环：写入连接发送缓冲并发送，再派发该连接的下一个请求
+*input:		r：事件循环；t：job
+*output:	无
+*return:	无
+******************************************/
+static void job_done(REACTOR* r, struct reactor_task* t)
+{
+    struct job* j = (struct job*)t;
+    struct sockitem* si = j->si;
+
+    r->inflight--;
+    si->inflight = 0;
+    if(si->closed)  //处理期间连接已关闭
+    {
+        if(j->file.fd >= 0)
+            close(j->file.fd);
+        free(j);
+        sockitem_free(si);
+        return;
+    }
+
+    int len = j->resplen;
+    conn_reserve(si, len);
+    if(len > si->buf->sendcap - si->buf->sendlength)    //内存不足时截断
+        len = si->buf->sendcap - si->buf->sendlength;
+    memcpy(si->buf->sendbuffer + si->buf->sendlength, j->resp, len);
+    si->buf->sendlength += len;
+    if(j->file.fd >= 0)
+        conn_attach_file(si, &j->file);
+    free(j);
+
+    send_cb(si);    // 发完后派发下一个请求
+}
+#endif
+
+/******************************************
+*name：		process_frame
+*brief:		处理一帧完整请求。同步模式直接处理并写入发送缓冲；线程池模式放入连接的待处理队列
+*input:		si：连接；frame：帧起始；len：帧长度
+*output:	无
+*return:	无
+******************************************/
+static void process_frame(struct sockitem* si, const char* frame, int len)
+{
+    REACTOR_HANDLER handler = si->r->handlers[si->port_idx];
+
+#ifdef REACTOR_USE_THREADPOOL
+    struct job* j = (struct job*)malloc(sizeof(struct job));
+    if(j == NULL)
+        return;
+    j->task.run = job_done;
+    j->next = NULL;
+    j->si = si;
+    j->handler = handler;
+    j->reqlen = len;
+    memcpy(j->req, frame, len);
+
+    if(si->buf->pending_tail)
+        si->buf->pending_tail->next = j;
+    else
+        si->buf->pending_head = j;
+    si->buf->pending_tail = j;
+    si->buf->npending++;
+
+    dispatch_next(si);
+#else
+    REACTOR_FILE file = { -1, 0, 0 };
+    conn_reserve(si, MAX_BUFFER_SIZE);  //一帧响应最长MAX_BUFFER_SIZE，内存不足时handler拿到的空间更小
+    si->buf->sendlength += handler(frame, len, si->buf->sendbuffer + si->buf->sendlength,
+                                   si->buf->sendcap - si->buf->sendlength, &file);
+    if(file.fd >= 0)
+        conn_attach_file(si, &file);
+#endif
+}
+
+#ifdef REACTOR_USE_THREADPOOL
+#define FILE_BLOCKS_FRAMES(si)  0   // 线程池模式下请求进入待派发队列，由dispatch_next等文件发完再派发
+#else
+#define FILE_BLOCKS_FRAMES(si)  ((si)->buf->file_fd >= 0)
+#endif
+
+/******************************************
+*name：		split_frames
+*brief:		从接收缓冲中按'\n'切出完整帧逐个处理，不完整的尾部留待下次接收
+*input:		si：连接
+*output:	无
+*return:	处理掉的字节数
+******************************************/
+static int split_frames(struct sockitem* si)
+{
+    int start = 0;
+    char* nl;
+
+    //同步模式下有文件在发送时暂停处理，积压达到高水位时也暂停（连接随后停止读），
+    //剩下的帧留在缓冲中，文件发完或积压降下来后继续
+    while(!FILE_BLOCKS_FRAMES(si) && conn_backlog(si) < si->r->cfg.conn_high_water &&
+          (nl = memchr(si->buf->recvbuffer + start, '\n', si->buf->recvlength - start)) != NULL)
+    {
+        int len = nl - (si->buf->recvbuffer + start) + 1;
+        process_frame(si, si->buf->recvbuffer + start, len);
+        start += len;
+    }
+
+    //缓冲区满了仍没有完整帧，整体当作一帧处理，避免卡死
+    if(start == 0 && si->buf->recvlength == MAX_BUFFER_SIZE && !FILE_BLOCKS_FRAMES(si)
+       && conn_backlog(si) < si->r->cfg.conn_high_water)
+    {
+        process_frame(si, si->buf->recvbuffer, si->buf->recvlength);
+        start = si->buf->recvlength;
+    }
+
+    si->buf->recvlength -= start;
+    if(si->buf->recvlength > 0 && start > 0)
+        memmove(si->buf->recvbuffer, si->buf->recvbuffer + start, si->buf->recvlength);
+    return start;
+}
+
+/******************************************
+*name：		conn_read_clock
+*brief:		切帧后更新读超时：只有缓冲尾部是未收全的半帧时计时，切出过帧就从现在重新计时。
+            缓冲中留着的是因停止读、文件发送而暂缓处理的完整帧（或已满的缓冲）时不计时，等处理时再看
+*input:		si：连接；consumed：本次切帧处理掉的字节数
+*output:	无
+*return:	无
+******************************************/
+static void conn_read_clock(struct sockitem* si, int consumed)
+{
+    struct sockbuf* buf = si->buf;
+
+    if(buf->recvlength == 0 || buf->recvlength == MAX_BUFFER_SIZE || buf->file_fd >= 0 || buf->throttled
+       || memchr(buf->recvbuffer, '\n', buf->recvlength) != NULL)
+        buf->read_start = 0;
+    else if(buf->read_start == 0)
+    {
+        buf->read_start = si->r->now;    //开始等待半帧的剩余部分
+        conn_rearm_timer(si);
+    }
+    else if(consumed > 0)
+        buf->read_start = si->r->now;    //有帧收全，顺延读超时
+}
+
+/******************************************
+*name：		backlog_add
+*brief:		调整循环积压的合计，越过全局高/低水位时切换全局停读状态
+*input:		r：事件循环；delta：变化量
+*output:	无
+*return:	无
+******************************************/
+static void backlog_add(REACTOR* r, long delta)
+{
+    r->backlog += delta;
+    STAT_ADD(r->stat.backlog, delta);
+    if(!r->global_throttling && r->backlog >= r->cfg.global_high_water)
+    {
+        r->global_throttling = 1;
+        STAT_ADD(r->stat.global_throttles, 1);
+    }
+    else if(r->global_throttling && r->backlog <= r->cfg.global_low_water)
+    {
+        r->global_throttling = 0;
+        r->resume_pending = 1;  //不在这里遍历，当前可能正处于某个连接的回调中
+    }
+}
+
+/******************************************
+*name：		conn_account
+*brief:		把连接积压的变化计入循环的合计
+*input:		si：连接
+*output:	无
+*return:	无
+******************************************/
+static void conn_account(struct sockitem* si)
+{
+    long backlog = conn_backlog(si);
+    if(backlog != si->buf->backlog)
+    {
+        backlog_add(si->r, backlog - si->buf->backlog);
+        si->buf->backlog = backlog;
+    }
+}
+
+/******************************************
+*name：		conn_update_events
+*brief:		按连接状态计算需要监听的事件（水平触发），有变化时才调用epoll_ctl。
+            停止读、接收缓冲满或（同步模式）文件发送中时不监听EPOLLIN，有待发送数据时监听EPOLLOUT
+*input:		si：连接
+*output:	无
+*return:	无
+******************************************/
+static void conn_update_events(struct sockitem* si)
+{
+    struct sockbuf* buf = si->buf;
+    uint32_t events = 0;
+
+    if(!buf->throttled && buf->recvlength < MAX_BUFFER_SIZE && !FILE_BLOCKS_FRAMES(si))
+        events |= EPOLLIN;
+    if(buf->sendlength > 0 || buf->file_fd >= 0)
+        events |= EPOLLOUT;
+
+    if(events != buf->events)
+    {
+        buf->events = events;
+        sockitem_watch(si, EPOLL_CTL_MOD, events);
+    }
+}
+
+/******************************************
+*name：		conn_throttle_unlink
+*brief:		连接移出停止读链表
+*input:		si：连接
+*output:	无
+*return:	无
+******************************************/
+static void conn_throttle_unlink(struct sockitem* si)
+{
+    REACTOR* r = si->r;
+    struct sockbuf* buf = si->buf;
+
+    if(buf->throttle_prev)
+        buf->throttle_prev->buf->throttle_next = buf->throttle_next;
+    else
+        r->throttled = buf->throttle_next;
+    if(buf->throttle_next)
+        buf->throttle_next->buf->throttle_prev = buf->throttle_prev;
+    buf->throttle_prev = buf->throttle_next = NULL;
+    buf->throttled = 0;
+    STAT_SUB(r->stat.throttled, 1);
+}
+
+/******************************************
+*name：		conn_throttle_check
+*brief:		收发之后检查读背压：积压达到连接高水位，或全局停读时有积压，则停止读；
+            积压降到低水位以下且不在全局停读时恢复读，并先处理停读期间留在接收缓冲中的帧。
+            全局停读期间积压已发完的连接也恢复读，否则其他不读响应的对端会让它一直停下去。最后更新监听的事件
+*input:		si：连接
+*output:	无
+*return:	无
+******************************************/
+static void conn_throttle_check(struct sockitem* si)
+{
+    REACTOR* r = si->r;
+    struct sockbuf* buf = si->buf;
+
+    conn_account(si);
+    if(buf->throttled && buf->backlog <= r->cfg.conn_low_water && (!r->global_throttling || buf->backlog == 0))
+    {
+        conn_throttle_unlink(si);
+        if(buf->recvlength > 0)
+        {
+            conn_read_clock(si, split_frames(si));
+            conn_account(si);
+        }
+    }
+
+    if(!buf->throttled && (buf->backlog >= r->cfg.conn_high_water || (r->global_throttling && buf->backlog > 0)))
+    {
+        buf->throttled = 1;
+        buf->throttle_prev = NULL;
+        buf->throttle_next = r->throttled;
+        if(r->throttled)
+            r->throttled->buf->throttle_prev = si;
+        r->throttled = si;
+        buf->read_start = 0;    //停止读期间半帧收不全，不算读超时，恢复读时重新计时
+        STAT_ADD(r->stat.throttles, 1);
+        STAT_ADD(r->stat.throttled, 1);
+    }
+
+    conn_update_events(si);
+}
+
+/******************************************
+*name：		resume_throttled
+*brief:		全局积压降到低水位后，逐个检查停止读的连接，积压不高的恢复读
+*input:		r：事件循环
+*output:	无
+*return:	无
+******************************************/
+static void resume_throttled(REACTOR* r)
+{
+    struct sockitem* si = r->throttled;
+    r->resume_pending = 0;
+    while(si)
+    {
+        struct sockitem* next = si->buf->throttle_next;  //恢复后可能重新停读并插到链表头，先取下一个
+        conn_throttle_check(si);
+        si = next;
+    }
+}
+
+/******************************************
+*name：		close_conn
+*brief:		关闭客户端连接并释放资源。线程池模式下若仍有请求在处理，延迟到其返回时释放
+*input:		si：连接
+*output:	无
+*return:	无
+******************************************/
+static void close_conn(struct sockitem* si)
+{
+    REACTOR* r = si->r;
+
+    tw_del(&r->wheel, &si->buf->timer);
+
+    //将当前客户端socket从epoll中删除
+    epoll_ctl(r->epfd, EPOLL_CTL_DEL, si->sockfd, NULL);
+    close(si->sockfd);
+
+    STAT_ADD(r->stat.closes, 1);
+    STAT_SUB(r->stat.active[si->port_idx], 1);
+    if(si->buf->file_fd >= 0)
+        close(si->buf->file_fd);
+    if(si->buf->throttled)
+        conn_throttle_unlink(si);
+    backlog_add(r, -si->buf->backlog);
+    if(si->buf->sendbuffer != si->buf->sendinline)
+        free(si->buf->sendbuffer);
+
+#ifdef REACTOR_USE_THREADPOOL
+    while(si->buf->pending_head)
+    {
+        struct job* j = si->buf->pending_head;
+        si->buf->pending_head = j->next;
+        free(j);
+    }
+#endif
+    free(si->buf);
+    si->buf = NULL;
+
+#ifdef REACTOR_USE_THREADPOOL
+    if(si->inflight)
+    {
+        si->closed = 1;
+        si->callback = NULL;
+        return;
+    }
+#endif
+    sockitem_free(si);
+}
+
+/******************************************
+*name：		conn_deadline
+*brief:		计算连接的下一个超时截止时间（空闲、读、写三者中最早的）
+*input:		si：连接
+*output:	reason：对应的超时类型
+*return:	截止时间（毫秒）
+******************************************/
+static uint64_t conn_deadline(struct sockitem* si, const char** reason)
+{
+    REACTOR_CONFIG* cfg = &si->r->cfg;
+    uint64_t deadline = si->last_active + cfg->idle_timeout_ms;
+    *reason = "idle";
+
+    if(si->buf->read_start && si->buf->read_start + cfg->read_timeout_ms < deadline)
+    {
+        deadline = si->buf->read_start + cfg->read_timeout_ms;
+        *reason = "read";
+    }
+    if(si->buf->write_start && si->buf->write_start + cfg->write_timeout_ms < deadline)
+    {
+        deadline = si->buf->write_start + cfg->write_timeout_ms;
+        *reason = "write";
+    }
+    return deadline;
+}
+
+/******************************************
+*name：		conn_rearm_timer
+*brief:		读/写超时开始计时，截止时间可能早于时间轮中的，需要重新挂入。
+            只推迟截止时间的空闲重置不调用它，等定时器到期时再顺延
+*input:		si：连接
+*output:	无
+*return:	无
+******************************************/
+static void conn_rearm_timer(struct sockitem* si)
+{
+    const char* reason;
+    tw_add(&si->r->wheel, &si->buf->timer, conn_deadline(si, &reason));
+}
+
+/******************************************
+*name：		conn_timeout_cb
+*brief:		连接定时器到期回调：确实超时则关闭连接，否则按最新的截止时间重新挂入时间轮
+*input:		arg：sockitem
+*output:	无
+*return:	无
+******************************************/
+static void conn_timeout_cb(void* arg)
+{
+    struct sockitem* si = arg;
+    REACTOR* r = si->r;
+    const char* reason;
+    uint64_t deadline = conn_deadline(si, &reason);
+
+    if(deadline > r->now)
+    {
+        tw_add(&r->wheel, &si->buf->timer, deadline);
+        return;
+    }
+
+    conn_log("# client %s timeout... fd:%d\n", reason, si->sockfd);
+    STAT_ADD(r->stat.timeouts, 1);
+    close_conn(si);
+}
+
+/******************************************
+*name：		conn_send_file
+*brief:		发送连接挂着的文件区间的一段。默认用sendfile由内核直接从page cache发往socket，
+            不经过用户态；cfg.file_copy时用pread+send，作为对比
+*input:		si：连接；max：本次最多发送的字节数
+*output:	无
+*return:	发送的字节数；<0失败（errno）；0表示文件比声明的短
+******************************************/
+static ssize_t conn_send_file(struct sockitem* si, size_t max)
+{
+    struct sockbuf* buf = si->buf;
+    size_t n = buf->file_remain < max ? buf->file_remain : max;
+
+    if(!si->r->cfg.file_copy)
+        return sendfile(si->sockfd, buf->file_fd, &buf->file_offset, n);   //成功时内核推进file_offset
+
+    char tmp[FILE_COPY_BUFFER];
+    if(n > sizeof(tmp))
+        n = sizeof(tmp);
+    ssize_t rn = pread(buf->file_fd, tmp, n, buf->file_offset);
+    if(rn <= 0)
+        return rn;
+    ssize_t ret = send(si->sockfd, tmp, rn, MSG_NOSIGNAL);
+    if(ret > 0)
+        buf->file_offset += ret;    //没发出去的部分下次重新pread
+    return ret;
+}
+
+/******************************************
+*name：		send_cb
+*brief:		发送给客户端数据：先发发送缓冲，再发挂着的文件区间。
+            没发完时继续监听EPOLLOUT，积压降到低水位以下时恢复读
+*input:		arg：sockitem；
+*output:	无
+*return:	返回本次发送的总长度，失败返回-1
+******************************************/
+static int send_cb(void *arg)
+{
+    struct sockitem *si = arg;
+    REACTOR* r = si->r;
+    struct sockbuf* buf = si->buf;
+    int clientfd = si->sockfd;
+    int total = 0;
+    size_t file_budget = FILE_MAX_PER_EVENT;   //单个连接一次最多发这么多文件数据，发不完靠EPOLL_CTL_MOD重新触发
+
+    for(;;)
+    {
+        if(buf->sendlength > 0)
+        {
+            //后面还有文件时带MSG_MORE，响应头和文件开头合并成一个报文，避免Nagle+延迟ACK等待
+            int ret = send(clientfd, buf->sendbuffer, buf->sendlength,
+                           MSG_NOSIGNAL | (buf->file_fd >= 0 ? MSG_MORE : 0));	//对端已关闭时不产生SIGPIPE
+            if(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                conn_log("# client send err... fd:%d\n", clientfd);
+                close_conn(si);     //水平触发下出错的socket会一直可写，不能等写超时
+                return -1;
+            }
+            if(ret <= 0)
+                break;
+            STAT_ADD(r->stat.bytes_out, ret);
+            buf->bytes_out += ret;
+            buf->sendlength -= ret;
+            total += ret;
+            if(buf->sendlength > 0)  //只发出去一部分，剩余的挪到缓冲区头部，等下次可写
+            {
+                memmove(buf->sendbuffer, buf->sendbuffer + ret, buf->sendlength);
+                break;
+            }
+            if(buf->sendbuffer != buf->sendinline)  //积压发完，堆上的大缓冲还给系统
+            {
+                free(buf->sendbuffer);
+                buf->sendbuffer = buf->sendinline;
+                buf->sendcap = MAX_BUFFER_SIZE;
+            }
+        }
+        else if(buf->file_fd >= 0 && file_budget > 0)
+        {
+            ssize_t ret = conn_send_file(si, file_budget);
+            if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                break;
+            if(ret <= 0)    //socket出错、文件读失败或被截短，响应已无法完整发出
+            {
+                conn_log("# client sendfile err... fd:%d\n", clientfd);
+                close_conn(si);
+                return -1;
+            }
+            STAT_ADD(r->stat.bytes_out, ret);
+            STAT_ADD(r->stat.file_bytes, ret);
+            buf->bytes_out += ret;
+            buf->file_remain -= ret;
+            file_budget -= ret;
+            total += ret;
+            if(buf->file_remain == 0)
+            {
+                close(buf->file_fd);
+                buf->file_fd = -1;
+#ifndef REACTOR_USE_THREADPOOL
+                conn_read_clock(si, split_frames(si));   //继续处理文件发送期间积压在接收缓冲中的请求
+#endif
+            }
+        }
+        else
+            break;
+    }
+
+    int pending = buf->sendlength > 0 || buf->file_fd >= 0;
+    if(total > 0)
+    {
+        si->last_active = r->now;
+        if(!pending)
+            buf->write_start = 0;
+        else if(buf->write_start == 0)
+        {
+            buf->write_start = r->now;
+            conn_rearm_timer(si);
+        }
+        else
+            buf->write_start = r->now;   //有进展，顺延写超时
+    }
+    else if(pending && buf->write_start == 0)
+    {
+        buf->write_start = r->now;
+        conn_rearm_timer(si);
+    }
+
+#ifdef REACTOR_USE_THREADPOOL
+    if(buf->file_fd < 0)
+        dispatch_next(si);  //文件发完后才派发该连接的下一个请求
+#endif
+    conn_throttle_check(si);    //更新监听的事件：没发完继续等待EPOLLOUT，积压降下来恢复EPOLLIN
+    return total;
+}
+
+/******************************************
+*name：		recv_cb
+*brief:		接收客户端的数据，切帧处理后检查读背压，有响应待发送时监听EPOLLOUT
+*input:		arg：sockitem；
+*output:	无
+*return:	返回接收长度
+******************************************/
+static int recv_cb(void *arg)
+{
+    struct sockitem *si = arg;
+    REACTOR* r = si->r;
+
+    int clientfd = si->sockfd;
+    if(si->buf->recvlength == MAX_BUFFER_SIZE)  //缓冲中的帧还没处理完，recv长度为0会被当成对端关闭
+        return 0;
+    int ret = recv(clientfd, si->buf->recvbuffer + si->buf->recvlength, MAX_BUFFER_SIZE - si->buf->recvlength, 0);
+
+	//1、recv失败
+	if(ret <= 0)
+    {
+        if(ret < 0)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)	//被打断直接返回的情况
+            {
+                return ret;
+            }
+			conn_log("# client err... fd:%d\n", clientfd);
+        }
+        else
+        {
+            conn_log("# client disconn... fd:%d\n", clientfd);
+        }
+
+        close_conn(si);
+    }
+    else	//2、recv成功
+    {
+        STAT_ADD(r->stat.bytes_in, ret);
+        si->buf->bytes_in += ret;
+        si->buf->recvlength += ret;
+        int consumed = split_frames(si);   //切出完整帧交给业务处理
+
+        si->last_active = r->now;
+        conn_read_clock(si, consumed);
+
+        //同步模式下响应已在发送缓冲中，等待EPOLLOUT发送；线程池模式下响应由 job_done 在处理完成后发送
+        conn_throttle_check(si);
+    }
+
+    return ret;
+}
+
+/******************************************
+*name：		conn_cb
+*brief:		客户端连接的事件回调：可写时发送，可读时接收。停止读期间对端关闭或出错则直接关闭
+*input:		arg：sockitem
+*output:	无
+*return:	0，连接已关闭返回-1
+******************************************/
+static int conn_cb(void *arg)
+{
+    struct sockitem *si = arg;
+    uint32_t revents = si->r->revents;
+
+    if(!(si->buf->events & EPOLLIN) && (revents & (EPOLLERR | EPOLLHUP)))
+    {
+        conn_log("# client hup while not reading... fd:%d\n", si->sockfd);
+        close_conn(si);
+        return -1;
+    }
+    if((revents & EPOLLOUT) && send_cb(si) < 0)
+        return -1;
+    if((revents & (EPOLLIN | EPOLLERR | EPOLLHUP)) && (si->buf->events & EPOLLIN))
+        recv_cb(si);
+    return 0;
+}
+
+/******************************************
+*name：		add_client
+*brief:		为新连接创建sockitem，回调为conn_cb、epoll监听EPOLLIN，并启动超时定时器
+*input:		si：listen fd的sockitem；clientfd：新连接；client：对端地址
+*output:	无
+*return:	无
+******************************************/
+static void add_client(struct sockitem *si, int clientfd, struct sockaddr_in *client)
+{
+    REACTOR* r = si->r;
+#ifdef REACTOR_CONN_LOG
+    char str[INET_ADDRSTRLEN] = {0};
+#endif
+
+	//配置sockitem
+    struct sockitem *client_si = sockitem_alloc(r, SI_CONN);
+    if(client_si == NULL || (client_si->buf = (struct sockbuf*)calloc(1, sizeof(struct sockbuf))) == NULL)
+    {
+        printf("# no memory for new client\n");
+        if(client_si)
+            sockitem_free(client_si);
+        close(clientfd);
+        return;
+    }
+
+    conn_log("Accept from %s:%d fd:%d\n", inet_ntop(AF_INET, &client->sin_addr, str, sizeof(str)),
+        ntohs(client->sin_port), clientfd);
+    STAT_ADD(r->stat.active[si->port_idx], 1);
+
+    client_si->sockfd = clientfd;
+    client_si->callback = conn_cb;
+    client_si->port_idx = si->port_idx;
+    client_si->buf->peer = *client;
+    client_si->buf->file_fd = -1;
+    client_si->buf->sendbuffer = client_si->buf->sendinline;
+    client_si->buf->sendcap = MAX_BUFFER_SIZE;
+    client_si->buf->events = EPOLLIN;   // accept完的下一步就是接收客户端数据
+    client_si->buf->created = r->now;
+
+    //启动空闲超时定时器
+    client_si->last_active = r->now;
+    tw_timer_init(&client_si->buf->timer, conn_timeout_cb, client_si);
+    tw_add(&r->wheel, &client_si->buf->timer, r->now + r->cfg.idle_timeout_ms);
+
+	//配置epoll监听
+    sockitem_watch(client_si, EPOLL_CTL_ADD, EPOLLIN);
+}
+
+/******************************************
+*name：		drop_one_conn
+*brief:		fd耗尽时释放预留fd，accept一个连接后立即关闭，再把预留fd占回来
+*input:		r：事件循环；listenfd：listen fd
+*output:	无
+*return:	无
+******************************************/
+static void drop_one_conn(REACTOR* r, int listenfd)
+{
+    close(r->idlefd);
+    int fd = accept(listenfd, NULL, NULL);
+    if(fd >= 0)
+    {
+        close(fd);
+        STAT_ADD(r->stat.accept_dropped, 1);
+    }
+    r->idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+/******************************************
+*name：		accept_cb
+*brief:		接收客户端的连接，循环accept4直到EAGAIN（最多cfg.accept_max个）。
+            新连接直接以非阻塞方式创建，交给add_client加入epoll（accept也属于读IO操作的回调）
+*input:		arg：sockitem；
+*output:	无
+*return:	返回本次接收的连接数
+******************************************/
+static int accept_cb(void *arg)
+{
+    struct sockitem *si = arg;
+    REACTOR* r = si->r;
+    unsigned long n = 0;
+
+    while(n < (unsigned long)r->cfg.accept_max)
+    {
+        struct sockaddr_in client;
+        socklen_t caddr_len = sizeof(struct sockaddr_in);
+
+        int clientfd = accept4(si->sockfd, (struct sockaddr*)&client, &caddr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(clientfd < 0)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;  // accept队列已取空
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            STAT_ADD(r->stat.accept_errors, 1);
+            if((errno == EMFILE || errno == ENFILE) && r->idlefd >= 0)
+            {
+                drop_one_conn(r, si->sockfd);
+                continue;
+            }
+            printf("# accept error[%d]\n", errno);
+            break;
+        }
+
+        n++;
+        add_client(si, clientfd, &client);
+    }
+
+    STAT_ADD(r->stat.accepts, n);
+    if(n > r->stat.accept_max_batch)
+        STAT_ADD(r->stat.accept_max_batch, n - r->stat.accept_max_batch);
+
+    return n;
+}
+
+/******************************************
+*name：		stat_timer_cb
+*brief:		周期输出accept速率、事件处理速率等统计，本周期没有新连接/事件时不输出
+*input:		arg：事件循环
+*output:	无
+*return:	无
+******************************************/
+static void stat_timer_cb(void *arg)
+{
+    REACTOR* r = arg;
+    struct reactor_stat *st = &r->stat;
+    int interval = r->cfg.stat_interval_ms;
+    unsigned long accepts = st->accepts - r->last_accepts;
+    unsigned long events = st->events - r->last_events;
+    unsigned long wakeups = st->wakeups - r->last_wakeups;
+    unsigned long udp_in = st->udp_in - r->last_udp_in;
+    unsigned long udp_calls = st->udp_recv_calls - r->last_udp_calls;
+    unsigned long throttles = st->throttles - r->last_throttles;
+
+    if(accepts > 0)
+        printf("# [%d] accept rate: %lu conn/s, total: %lu, errors: %lu, dropped: %lu\n", r->cfg.id,
+            accepts * 1000 / interval, st->accepts, st->accept_errors, st->accept_dropped);
+    if(events > 0)
+        printf("# [%d] loop: %lu events/s, %lu wakeups/s, avg events per wakeup: %.1f\n", r->cfg.id,
+            events * 1000 / interval, wakeups * 1000 / interval, (double)events / wakeups);
+    if(udp_in > 0)
+        printf("# [%d] udp: %lu pkt/s, %lu recv calls/s, avg pkts per call: %.1f, dropped replies: %lu\n", r->cfg.id,
+            udp_in * 1000 / interval, udp_calls * 1000 / interval, (double)udp_in / udp_calls, st->udp_send_dropped);
+
+    if(throttles > 0 || st->throttled > 0)
+        printf("# [%d] backpressure: %lu throttles/s, throttled: %lu, backlog: %lu bytes\n", r->cfg.id,
+            throttles * 1000 / interval, st->throttled, st->backlog);
+
+    r->last_accepts = st->accepts;
+    r->last_throttles = st->throttles;
+    r->last_udp_in = st->udp_in;
+    r->last_udp_calls = st->udp_recv_calls;
+    r->last_events = st->events;
+    r->last_wakeups = st->wakeups;
+    tw_add(&r->wheel, &r->stat_timer, r->now + interval);
+}
+
+/******************************************
+*name：		notify_cb
+*brief:		eventfd可读回调：取出其他线程投递的任务（含工作线程处理完的请求）逐个执行
+*input:		arg：eventfd的sockitem
+*output:	无
+*return:	本次执行的任务数
+******************************************/
+static int notify_cb(void *arg)
+{
+    struct sockitem *si = arg;
+    REACTOR* r = si->r;
+    eventfd_t cnt;
+    int done = 0;
+
+    eventfd_read(r->notifyfd, &cnt);
+
+    struct mpsc_node* node = mpsc_pop_all(&r->tasks);
+    while(node)
+    {
+        struct reactor_task* t = (struct reactor_task*)node;
+        node = node->next;  // run 会释放任务，先取下一个
+        t->run(r, t);
+        done++;
+    }
+
+    return done;
+}
+
+/******************************************
+*name：		post_task_run
+*brief:		在事件循环中执行reactor_post投递的任务
+*input:		r：事件循环；t：任务
+*output:	无
+*return:	无
+******************************************/
+static void post_task_run(REACTOR* r, struct reactor_task* t)
+{
+    struct post_task* pt = (struct post_task*)t;
+    pt->cb(r, pt->arg);
+    free(pt);
+}
+
+/******************************************
+*name：		user_fd_cb
+*brief:		reactor_add_fd注册的fd的事件回调，按事件类型调用用户的读/写回调
+*input:		arg：sockitem
+*output:	无
+*return:	0
+******************************************/
+static int user_fd_cb(void *arg)
+{
+    struct sockitem *si = arg;
+    struct user_fd *u = si->ctx;
+    REACTOR* r = si->r;
+    uint32_t events = r->revents;
+
+    if((events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && u->read_cb)
+    {
+        u->read_cb(r, si, si->sockfd, u->arg);
+        if(si->callback != user_fd_cb || si->ctx != u)
+            return 0;   // 读回调中已经删除
+    }
+    if((events & (EPOLLOUT | EPOLLERR)) && u->write_cb)
+        u->write_cb(r, si, si->sockfd, u->arg);
+    return 0;
+}
+
+/******************************************
+*name：		udp_sock_free
+*brief:		释放UDP socket的收发缓冲
+*input:		u：udp_sock
+*output:	无
+*return:	无
+******************************************/
+static void udp_sock_free(struct udp_sock* u)
+{
+    if(u == NULL)
+        return;
+    free(u->rmsgs);
+    free(u->riov);
+    free(u->raddr);
+    free(u->rbuf);
+    free(u->rcmsg);
+    free(u->smsgs);
+    free(u->siov);
+    free(u->saddr);
+    free(u->sbuf);
+    free(u);
+}
+
+/******************************************
+*name：		udp_sock_new
+*brief:		分配UDP socket的收发缓冲：batch个接收缓冲和UDP_BATCH个回复缓冲
+*input:		batch：一次recvmmsg的缓冲数；gro：是否开启GRO
+*output:	无
+*return:	udp_sock，失败返回NULL
+******************************************/
+static struct udp_sock* udp_sock_new(int batch, int gro)
+{
+    struct udp_sock* u = (struct udp_sock*)calloc(1, sizeof(struct udp_sock));
+    if(u == NULL)
+        return NULL;
+
+    u->gro = gro;
+    u->batch = batch;
+    u->slot = gro ? UDP_GRO_BUFFER : UDP_MAX_DGRAM;
+    u->rmsgs = (struct mmsghdr*)calloc(batch, sizeof(struct mmsghdr));
+    u->riov = (struct iovec*)calloc(batch, sizeof(struct iovec));
+    u->raddr = (struct sockaddr_in*)calloc(batch, sizeof(struct sockaddr_in));
+    u->rbuf = (char*)malloc((size_t)batch * u->slot);
+    u->rcmsg = (char*)calloc(batch, CMSG_SPACE(sizeof(uint16_t)));
+    u->smsgs = (struct mmsghdr*)calloc(UDP_BATCH, sizeof(struct mmsghdr));
+    u->siov = (struct iovec*)calloc(UDP_BATCH, sizeof(struct iovec));
+    u->saddr = (struct sockaddr_in*)calloc(UDP_BATCH, sizeof(struct sockaddr_in));
+    u->sbuf = (char*)malloc(UDP_BATCH * UDP_MAX_DGRAM);
+    if(!u->rmsgs || !u->riov || !u->raddr || !u->rbuf || !u->rcmsg || !u->smsgs || !u->siov || !u->saddr || !u->sbuf)
+    {
+        udp_sock_free(u);
+        return NULL;
+    }
+
+    //iovec和地址固定对应，每次收发前只需重置长度
+    int i;
+    for(i = 0; i < batch; i++)
+    {
+        u->riov[i].iov_base = u->rbuf + (size_t)i * u->slot;
+        u->riov[i].iov_len = u->slot;
+        u->rmsgs[i].msg_hdr.msg_iov = &u->riov[i];
+        u->rmsgs[i].msg_hdr.msg_iovlen = 1;
+        u->rmsgs[i].msg_hdr.msg_name = &u->raddr[i];
+    }
+    for(i = 0; i < UDP_BATCH; i++)
+    {
+        u->siov[i].iov_base = u->sbuf + i * UDP_MAX_DGRAM;
+        u->smsgs[i].msg_hdr.msg_iov = &u->siov[i];
+        u->smsgs[i].msg_hdr.msg_iovlen = 1;
+        u->smsgs[i].msg_hdr.msg_name = &u->saddr[i];
+        u->smsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    return u;
+}
+
+/******************************************
+*name：		udp_flush
+*brief:		把攒下的回复用sendmmsg一次发出。发送缓冲满时丢弃剩余回复（UDP本身不保证送达），计入udp_send_dropped
+*input:		si：UDP socket
+*output:	无
+*return:	无
+******************************************/
+static void udp_flush(struct sockitem* si)
+{
+    struct udp_sock* u = si->ctx;
+    REACTOR* r = si->r;
+    int off = 0;
+
+    while(off < u->nsend)
+    {
+        int ret = sendmmsg(si->sockfd, u->smsgs + off, u->nsend - off, MSG_DONTWAIT);
+        if(ret <= 0)
+        {
+            if(ret < 0 && errno == EINTR)
+                continue;
+            STAT_ADD(r->stat.udp_send_dropped, u->nsend - off);
+            break;
+        }
+        STAT_ADD(r->stat.udp_out, ret);
+        off += ret;
+    }
+    u->nsend = 0;
+}
+
+/******************************************
+*name：		udp_handle
+*brief:		一个报文交给handler，回复放入待发送批次，批次满时发出
+*input:		si：UDP socket；data/len：报文；peer：来源地址
+*output:	无
+*return:	无
+******************************************/
+static void udp_handle(struct sockitem* si, const char* data, int len, const struct sockaddr_in* peer)
+{
+    struct udp_sock* u = si->ctx;
+    int k = u->nsend;
+    int n = u->handler(data, len, peer, u->sbuf + k * UDP_MAX_DGRAM, UDP_MAX_DGRAM);
+    if(n <= 0)
+        return;
+
+    u->siov[k].iov_len = n;
+    u->saddr[k] = *peer;
+    if(++u->nsend == UDP_BATCH)
+        udp_flush(si);
+}
+
+/******************************************
+*name：		udp_gro_size
+*brief:		取recvmmsg返回的GRO分段大小，没有时整个缓冲是一个报文
+*input:		msg：接收的msghdr；len：收到的长度
+*output:	无
+*return:	分段大小
+******************************************/
+static int udp_gro_size(struct msghdr* msg, int len)
+{
+    struct cmsghdr* cm;
+    for(cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm))
+    {
+        if(cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+        {
+            uint16_t seg;
+            memcpy(&seg, CMSG_DATA(cm), sizeof(seg));
+            return seg > 0 ? seg : len;
+        }
+    }
+    return len;
+}
+
+/******************************************
+*name：		udp_cb
+*brief:		UDP socket可读：循环recvmmsg一批报文逐个处理，回复攒批sendmmsg，直到收空或达到UDP_MAX_PER_EVENT。
+            cfg.udp_batch为1时每次事件只recvfrom/sendto一个报文，作为对比基准
+*input:		arg：sockitem
+*output:	无
+*return:	本次处理的报文数
+******************************************/
+static int udp_cb(void *arg)
+{
+    struct sockitem* si = arg;
+    struct udp_sock* u = si->ctx;
+    REACTOR* r = si->r;
+    int total = 0;
+
+    if(u->batch == 1 && !u->gro)
+    {
+        socklen_t addrlen = sizeof(struct sockaddr_in);
+        int len = recvfrom(si->sockfd, u->rbuf, u->slot, MSG_DONTWAIT, (struct sockaddr*)&u->raddr[0], &addrlen);
+        if(len < 0)
+            return 0;
+        STAT_ADD(r->stat.udp_recv_calls, 1);
+        STAT_ADD(r->stat.udp_in, 1);
+        int n = u->handler(u->rbuf, len, &u->raddr[0], u->sbuf, UDP_MAX_DGRAM);
+        if(n > 0)
+        {
+            if(sendto(si->sockfd, u->sbuf, n, MSG_DONTWAIT, (struct sockaddr*)&u->raddr[0], sizeof(struct sockaddr_in)) == n)
+                STAT_ADD(r->stat.udp_out, 1);
+            else
+                STAT_ADD(r->stat.udp_send_dropped, 1);
+        }
+        return 1;
+    }
+
+    while(total < UDP_MAX_PER_EVENT)
+    {
+        int i;
+        for(i = 0; i < u->batch; i++)
+        {
+            u->rmsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            if(u->gro)
+            {
+                u->rmsgs[i].msg_hdr.msg_control = u->rcmsg + i * CMSG_SPACE(sizeof(uint16_t));
+                u->rmsgs[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            }
+        }
+
+        int n = recvmmsg(si->sockfd, u->rmsgs, u->batch, MSG_DONTWAIT, NULL);
+        if(n <= 0)
+            break;
+        STAT_ADD(r->stat.udp_recv_calls, 1);
+
+        for(i = 0; i < n; i++)
+        {
+            char* data = u->riov[i].iov_base;
+            int len = u->rmsgs[i].msg_len;
+            int seg = u->gro ? udp_gro_size(&u->rmsgs[i].msg_hdr, len) : len;
+            int off = 0;
+            do  //GRO合并的报文按分段大小拆开，最后一段可能较短
+            {
+                int l = len - off < seg ? len - off : seg;
+                udp_handle(si, data + off, l, &u->raddr[i]);
+                off += l;
+                total++;
+            } while(off < len);
+        }
+        udp_flush(si);
+
+        if(n < u->batch)    //没有收满说明已经收空，省一次返回EAGAIN的系统调用
+            break;
+    }
+
+    STAT_ADD(r->stat.udp_in, total);
+    return total;
+}
+
+/******************************************
+*name：		admin_close
+*brief:		关闭管理连接，释放会话
+*input:		si：管理连接
+*output:	无
+*return:	无
+******************************************/
+static void admin_close(struct sockitem* si)
+{
+    struct admin_session* as = si->ctx;
+
+    epoll_ctl(si->r->epfd, EPOLL_CTL_DEL, si->sockfd, NULL);
+    close(si->sockfd);
+    free(as->out);
+    free(as);
+    sockitem_free(si);
+}
+
+/******************************************
+*name：		admin_format_conn
+*brief:		输出一个连接的跟踪信息
+*input:		si：连接；buf：输出缓冲；len：缓冲大小
+*output:	buf：一行文本
+*return:	写入的长度
+******************************************/
+static int admin_format_conn(struct sockitem* si, char* buf, int len)
+{
+    REACTOR* r = si->r;
+    struct sockbuf* b = si->buf;
+    char str[INET_ADDRSTRLEN] = {0};
+
+    int n = snprintf(buf, len, "fd:%d peer:%s:%d port:%d age_ms:%lu idle_ms:%lu bytes_in:%lu bytes_out:%lu "
+        "recvlength:%d sendlength:%d sendcap:%d backlog:%ld state:%s",
+        si->sockfd, inet_ntop(AF_INET, &b->peer.sin_addr, str, sizeof(str)), ntohs(b->peer.sin_port),
+        r->stat.ports[si->port_idx], (unsigned long)(r->now - b->created), (unsigned long)(r->now - si->last_active),
+        b->bytes_in, b->bytes_out, b->recvlength, b->sendlength, b->sendcap, b->backlog,
+        b->throttled ? "throttled" : (b->events & EPOLLOUT) ? "send" : "recv");
+#ifdef REACTOR_USE_THREADPOOL
+    if(n < len)
+        n += snprintf(buf + n, len - n, " inflight:%d", si->inflight);
+#endif
+    if(b->file_fd >= 0 && n < len)
+        n += snprintf(buf + n, len - n, " file_remain:%lu", (unsigned long)b->file_remain);
+    if(n < len)
+        n += snprintf(buf + n, len - n, "\n");
+    return n < len ? n : len;
+}
+
+/******************************************
+*name：		admin_execute
+*brief:		执行管理命令，结果放入会话的输出缓冲
+            stat：输出统计；conn：列出连接；conn <fd>：输出指定连接
+*input:		r：事件循环；as：管理会话
+*output:	无
+*return:	无
+******************************************/
+static void admin_execute(REACTOR* r, struct admin_session* as)
+{
+    int cap = 16384 + ADMIN_MAX_CONN_LIST * 256;
+    int n = 0;
+    int fd = -1;
+
+    as->out = (char*)malloc(cap);
+    if(as->out == NULL)
+        return;
+
+    if(strncmp(as->cmd, "stat", 4) == 0)
+    {
+        n = reactor_stat_format(&r->stat, as->out, cap);
+    }
+    else if(strncmp(as->cmd, "conn", 4) == 0)
+    {
+        if(as->cmd[4] == ' ')
+            fd = atoi(as->cmd + 5);
+
+        int listed = 0, total = 0, i, k;
+        for(i = 0; i < r->nchunks; i++)
+        {
+            for(k = 0; k < SOCKITEM_CHUNK; k++)
+            {
+                struct sockitem* si = &r->chunks[i][k];
+                if(si->type != SI_CONN || si->buf == NULL)
+                    continue;   // 空闲项、listen fd、管理连接、已关闭待释放的连接等
+                if(fd >= 0 && si->sockfd != fd)
+                    continue;
+                total++;
+                if(listed < ADMIN_MAX_CONN_LIST)
+                {
+                    n += admin_format_conn(si, as->out + n, cap - n);
+                    listed++;
+                }
+            }
+        }
+        if(total > listed)
+            n += snprintf(as->out + n, cap - n, "... %d more\n", total - listed);
+        else if(total == 0)
+            n += snprintf(as->out + n, cap - n, "no connection\n");
+    }
+    else
+    {
+        n = snprintf(as->out, cap, "usage: stat | conn | conn <fd>\n");
+    }
+
+    as->outlength = n < cap ? n : cap - 1;
+    as->outpos = 0;
+}
+
+/******************************************
+*name：		admin_send_cb
+*brief:		发送管理命令结果，发完后关闭连接
+*input:		arg：管理连接的sockitem
+*output:	无
+*return:	send返回值
+******************************************/
+static int admin_send_cb(void *arg)
+{
+    struct sockitem *si = arg;
+    struct admin_session* as = si->ctx;
+
+    int ret = send(si->sockfd, as->out + as->outpos, as->outlength - as->outpos, MSG_NOSIGNAL);
+    if(ret > 0)
+        as->outpos += ret;
+
+    if(as->outpos >= as->outlength || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        admin_close(si);
+
+    return ret;
+}
+
+/******************************************
+*name：		admin_recv_cb
+*brief:		读取一行管理命令，执行后切换为发送结果
+*input:		arg：管理连接的sockitem
+*output:	无
+*return:	recv返回值
+******************************************/
+static int admin_recv_cb(void *arg)
+{
+    struct sockitem *si = arg;
+    struct admin_session* as = si->ctx;
+
+    int ret = recv(si->sockfd, as->cmd + as->cmdlength, sizeof(as->cmd) - 1 - as->cmdlength, 0);
+    if(ret <= 0)
+    {
+        if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return ret;
+        admin_close(si);
+        return ret;
+    }
+
+    as->cmdlength += ret;
+    as->cmd[as->cmdlength] = '\0';
+    if(strchr(as->cmd, '\n') == NULL && as->cmdlength < (int)sizeof(as->cmd) - 1)
+        return ret; // 命令还没收全
+
+    admin_execute(si->r, as);
+    if(as->out == NULL)
+    {
+        admin_close(si);
+        return ret;
+    }
+
+    si->callback = admin_send_cb;
+    sockitem_watch(si, EPOLL_CTL_MOD, EPOLLOUT);
+    return ret;
+}
+
+/******************************************
+*name：		admin_accept_cb
+*brief:		接收管理连接
+*input:		arg：管理端口的sockitem
+*output:	无
+*return:	管理连接的fd，失败返回<0
+******************************************/
+static int admin_accept_cb(void *arg)
+{
+    struct sockitem *si = arg;
+
+    int fd = accept4(si->sockfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd < 0)
+        return fd;
+
+    struct sockitem *admin_si = sockitem_alloc(si->r, SI_ADMIN);
+    struct admin_session *as = (struct admin_session*)calloc(1, sizeof(struct admin_session));
+    if(admin_si == NULL || as == NULL)
+    {
+        if(admin_si)
+            sockitem_free(admin_si);
+        free(as);
+        close(fd);
+        return -1;
+    }
+
+    admin_si->sockfd = fd;
+    admin_si->callback = admin_recv_cb;
+    admin_si->ctx = as;
+    sockitem_watch(admin_si, EPOLL_CTL_ADD, EPOLLIN);
+    return fd;
+}
+
+/******************************************
+*name：		reactor_config_init
+*brief:		配置填为默认值
+*input:		无
+*output:	cfg：配置
+*return:	无
+******************************************/
+void reactor_config_init(REACTOR_CONFIG* cfg)
+{
+    memset(cfg, 0, sizeof(REACTOR_CONFIG));
+    cfg->epoll_batch = EPOLL_BATCH;
+    cfg->listen_backlog = LISTEN_BACKLOG;
+    cfg->accept_max = ACCEPT_MAX_PER_EVENT;
+    cfg->idle_timeout_ms = IDLE_TIMEOUT_MS;
+    cfg->read_timeout_ms = READ_TIMEOUT_MS;
+    cfg->write_timeout_ms = WRITE_TIMEOUT_MS;
+    cfg->stat_interval_ms = STAT_INTERVAL_MS;
+    cfg->udp_batch = UDP_BATCH;
+    cfg->conn_high_water = CONN_HIGH_WATER;
+    cfg->conn_low_water = CONN_LOW_WATER;
+    cfg->global_high_water = GLOBAL_HIGH_WATER;
+    cfg->global_low_water = GLOBAL_LOW_WATER;
+#ifdef REACTOR_USE_THREADPOOL
+    cfg->worker_num = MAX_WORKER_NUM;
+#endif
+}
+
+/******************************************
+*name：		reactor_create
+*brief:		创建事件循环：epoll fd、eventfd、时间轮，线程池模式下还有工作线程池
+*input:		cfg：配置，NULL使用默认配置
+*output:	无
+*return:	事件循环，失败返回NULL
+******************************************/
+REACTOR* reactor_create(const REACTOR_CONFIG* cfg)
+{
+    REACTOR* r = (REACTOR*)calloc(1, sizeof(REACTOR));
+    if(r == NULL)
+        return NULL;
+
+    if(cfg)
+        r->cfg = *cfg;
+    else
+        reactor_config_init(&r->cfg);
+
+    //sendfile没有MSG_NOSIGNAL，对端关闭时会产生SIGPIPE；应用没有设置过时忽略它，错误由EPIPE返回
+    struct sigaction sa;
+    if(sigaction(SIGPIPE, NULL, &sa) == 0 && sa.sa_handler == SIG_DFL)
+        signal(SIGPIPE, SIG_IGN);
+
+    r->epfd = -1;
+    r->notifyfd = -1;
+    r->idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    r->now = now_ns() / 1000000;
+    tw_init(&r->wheel, r->now);
+    mpsc_init(&r->tasks);
+
+    r->events = (struct epoll_event*)malloc(r->cfg.epoll_batch * sizeof(struct epoll_event));
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    r->notifyfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(r->events == NULL || r->epfd < 0 || r->notifyfd < 0)
+        goto fail;
+
+    struct sockitem *si = sockitem_alloc(r, SI_NOTIFY);
+    if(si == NULL)
+        goto fail;
+    si->sockfd = r->notifyfd;
+    si->callback = notify_cb;
+    if(sockitem_watch(si, EPOLL_CTL_ADD, EPOLLIN) < 0)
+        goto fail;
+
+#ifdef REACTOR_USE_THREADPOOL
+    r->workers = r->cfg.workers;
+    if(r->workers == NULL)
+    {
+        r->workers = tp_create_pool(r->cfg.worker_num);
+        if(r->workers == NULL)
+            goto fail;
+        r->own_workers = 1;
+    }
+#endif
+
+    if(r->cfg.stat_interval_ms > 0)
+    {
+        tw_timer_init(&r->stat_timer, stat_timer_cb, r);
+        tw_add(&r->wheel, &r->stat_timer, r->now + r->cfg.stat_interval_ms);
+    }
+    return r;
+
+fail:
+    reactor_destroy(r);
+    return NULL;
+}
+
+/******************************************
+*name：		reactor_destroy
+*brief:		销毁事件循环，关闭所有连接和listen fd。reactor_add_fd注册的fd由调用者关闭。
+            线程池模式下先等待已派发的请求全部交回
+*input:		r：事件循环，reactor_run已返回
+*output:	无
+*return:	无
+******************************************/
+void reactor_destroy(REACTOR* r)
+{
+    int i, k;
+
+    if(r == NULL)
+        return;
+
+#ifdef REACTOR_USE_THREADPOOL
+    flush_dispatch(r);
+    while(r->inflight > 0)
+    {
+        struct pollfd pfd = { r->notifyfd, POLLIN, 0 };
+        poll(&pfd, 1, 100);
+        notify_cb(r->chunks[0]);    // eventfd总是第一个分配的sockitem
+        flush_dispatch(r);
+    }
+    if(r->own_workers)
+        tp_destroy_pool(r->workers);
+#endif
+
+    //未执行的投递任务直接丢弃
+    struct mpsc_node* node = mpsc_pop_all(&r->tasks);
+    while(node)
+    {
+        struct mpsc_node* next = node->next;
+        free(node);
+        node = next;
+    }
+
+    for(i = 0; i < r->nchunks; i++)
+    {
+        for(k = 0; k < SOCKITEM_CHUNK; k++)
+        {
+            struct sockitem* si = &r->chunks[i][k];
+            switch(si->type)
+            {
+            case SI_CONN:
+                if(si->buf)
+                    close_conn(si);
+                break;
+            case SI_ADMIN:
+                admin_close(si);
+                break;
+            case SI_LISTEN:
+            case SI_ADMIN_LISTEN:
+                close(si->sockfd);
+                break;
+            case SI_USER_FD:
+                free(si->ctx);
+                break;
+            case SI_UDP:
+                close(si->sockfd);
+                udp_sock_free(si->ctx);
+                break;
+            }
+        }
+        free(r->chunks[i]);
+    }
+    free(r->chunks);
+
+    if(r->admin_path[0])
+        unlink(r->admin_path);
+    if(r->notifyfd >= 0)
+        close(r->notifyfd);
+    if(r->epfd >= 0)
+        close(r->epfd);
+    if(r->idlefd >= 0)
+        close(r->idlefd);
+    free(r->events);
+    free(r);
+}
+
+/******************************************
+*name：		reactor_run
+*brief:		运行事件循环，直到reactor_stop
+*input:		r：事件循环
+*output:	无
+*return:	0：被reactor_stop停止；<0：epoll_wait出错
+******************************************/
+int reactor_run(REACTOR* r)
+{
+    while(!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE))
+    {
+    	//1、wait事件
+        uint64_t begin = now_ns();
+        int timeout = tw_next_timeout(&r->wheel, begin / 1000000);    //有定时器时最多等到下一个tick
+        int nready = epoll_wait(r->epfd, r->events, r->cfg.epoll_batch, timeout);
+        if(nready < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            printf("epoll_wait error.\n");
+            return -1;
+        }
+
+        uint64_t end = now_ns();
+        stat_hist_add(r->stat.epoll_wait_hist, end - begin);
+        r->now = end / 1000000;
+        if(nready > 0)
+        {
+            STAT_ADD(r->stat.wakeups, 1);
+            STAT_ADD(r->stat.events, nready);
+            stat_hist_add(r->stat.events_hist, nready);
+        }
+
+		//2、响应事件
+        int i;
+        for(i = 0; i < nready; i++)
+        {
+            //预取：后两个事件的热数据，下一个事件的冷数据（其热数据上一轮已经预取）
+            if(i + 2 < nready)
+                __builtin_prefetch(r->events[i + 2].data.ptr);
+            if(i + 1 < nready)
+            {
+                struct sockitem* next = r->events[i + 1].data.ptr;
+                if(next->buf)
+                    __builtin_prefetch(next->buf);
+            }
+
+            struct sockitem* si = r->events[i].data.ptr;	//事件对应的sockitem
+            r->revents = r->events[i].events;
+            if(r->revents & (EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP))
+            {
+                if(si->callback != NULL)
+                    si->callback(si);  // 调用回调函数
+            }
+
+            //回调耗时，上一个回调的结束时间就是这一个的开始时间
+            begin = end;
+            end = now_ns();
+            stat_hist_add(r->stat.callback_hist, end - begin);
+        }
+
+        if(r->resume_pending)
+            resume_throttled(r);
+
+#ifdef REACTOR_USE_THREADPOOL
+        flush_dispatch(r);  //本轮收到的请求一次性提交给线程池
+#endif
+
+        //3、处理到期的定时器
+        tw_advance(&r->wheel, r->now);
+    }
+
+    return 0;
+}
+
+/******************************************
+*name：		reactor_stop
+*brief:		停止事件循环，可在任意线程（包括信号处理函数）中调用，当前这一轮处理完后reactor_run返回
+*input:		r：事件循环
+*output:	无
+*return:	无
+******************************************/
+void reactor_stop(REACTOR* r)
+{
+    __atomic_store_n(&r->stop, 1, __ATOMIC_RELEASE);
+    eventfd_write(r->notifyfd, 1);
+}
+
+/******************************************
+*name：		reactor_post
+*brief:		向事件循环投递任务，可在任意线程中调用，任务在事件循环线程中按投递顺序执行
+*input:		r：事件循环；cb：任务回调；arg：回调参数
+*output:	无
+*return:	0：成功；-1：内存不足
+******************************************/
+int reactor_post(REACTOR* r, REACTOR_TASK_CB cb, void* arg)
+{
+    struct post_task* pt = (struct post_task*)malloc(sizeof(struct post_task));
+    if(pt == NULL)
+        return -1;
+
+    pt->base.run = post_task_run;
+    pt->cb = cb;
+    pt->arg = arg;
+    push_task(r, &pt->base);
+    return 0;
+}
+
+/******************************************
+*name：		reactor_add_listener
+*brief:		在端口上监听，accept的连接按'\n'切帧后交给handler处理，响应写回连接。
+            同一端口可以多次添加（需要cfg.reuseport），共用一个端口统计
+*input:		r：事件循环；port：端口；handler：业务处理
+*output:	无
+*return:	返回建立的listen fd；失败返回       <0
+******************************************/
+int reactor_add_listener(REACTOR* r, int port, REACTOR_HANDLER handler)
+{
+    int port_idx;
+    for(port_idx = 0; port_idx < r->stat.nports; port_idx++)
+    {
+        if(r->stat.ports[port_idx] == port)
+            break;
+    }
+    if(port_idx == STAT_MAX_PORT)
+        return -1;
+
+	//创建对应port的listen fd，accept循环要求listen fd非阻塞
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+		return -1;
+
+    sockSetReuseAddr(sockfd);
+    if(r->cfg.reuseport)
+    {
+        int reuseport = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &reuseport, sizeof(reuseport));
+    }
+    if(r->cfg.defer_accept_sec > 0)
+        setsockopt(sockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &r->cfg.defer_accept_sec, sizeof(int));
+    if(r->cfg.fastopen_qlen > 0)
+        setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN, &r->cfg.fastopen_qlen, sizeof(int));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if(bind(sockfd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0)
+    {
+        close(sockfd);
+        return -2;
+    }
+
+    if(listen(sockfd, r->cfg.listen_backlog) < 0)
+    {
+        close(sockfd);
+        return -3;
+    }
+
+    //配置sockitem
+    struct sockitem *si = sockitem_alloc(r, SI_LISTEN);    // 自定义数据，用于传递给回调函数
+    if(si == NULL)
+    {
+        close(sockfd);
+        return -4;
+    }
+    si->sockfd = sockfd;
+    si->callback = accept_cb;	//回调
+    si->port_idx = port_idx;
+
+    if(port_idx == r->stat.nports)
+    {
+        r->stat.ports[port_idx] = port;
+        r->stat.nports++;
+    }
+    r->handlers[port_idx] = handler;
+
+	//配置epoll监听
+    sockitem_watch(si, EPOLL_CTL_ADD, EPOLLIN);
+
+    return sockfd;
+}
+
+/******************************************
+*name：		reactor_add_udp
+*brief:		在UDP端口上收报文，每个报文交给handler处理，回复发回来源地址。
+            报文用recvmmsg/sendmmsg成批收发，handler在事件循环线程中调用（线程池模式也是）
+*input:		r：事件循环；port：端口；handler：业务处理
+*output:	无
+*return:	UDP socket的fd，失败返回<0
+******************************************/
+int reactor_add_udp(REACTOR* r, int port, REACTOR_UDP_HANDLER handler)
+{
+    int batch = r->cfg.udp_batch;
+    if(batch < 1 || batch > UDP_BATCH)
+        batch = UDP_BATCH;
+    if(r->cfg.udp_gro && batch > UDP_GRO_BATCH)
+        batch = UDP_GRO_BATCH;
+
+    int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sockfd < 0)
+        return -1;
+
+    sockSetReuseAddr(sockfd);
+    if(r->cfg.reuseport)
+    {
+        int reuseport = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &reuseport, sizeof(reuseport));
+    }
+    int gro = 0;
+    if(r->cfg.udp_gro)
+    {
+        int on = 1;
+        gro = (setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0);    //内核不支持时退回普通接收
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if(bind(sockfd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0)
+    {
+        close(sockfd);
+        return -2;
+    }
+
+    struct udp_sock* u = udp_sock_new(batch, gro);
+    struct sockitem *si = u ? sockitem_alloc(r, SI_UDP) : NULL;
+    if(si == NULL)
+    {
+        udp_sock_free(u);
+        close(sockfd);
+        return -4;
+    }
+    u->handler = handler;
+    si->sockfd = sockfd;
+    si->callback = udp_cb;
+    si->ctx = u;
+
+    sockitem_watch(si, EPOLL_CTL_ADD, EPOLLIN);
+    return sockfd;
+}
+
+/******************************************
+*name：		reactor_enable_admin
+*brief:		创建管理端口（unix socket），可用 socat - UNIX-CONNECT:<path> 发送命令查询，循环销毁时删除
+*input:		r：事件循环；path：unix socket路径
+*output:	无
+*return:	管理端口的fd，失败返回<0
+******************************************/
+int reactor_enable_admin(REACTOR* r, const char* path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(addr.sun_path);  // 清理上次运行留下的文件
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_un)) < 0 || listen(fd, 16) < 0)
+    {
+        close(fd);
+        return -2;
+    }
+
+    struct sockitem *si = sockitem_alloc(r, SI_ADMIN_LISTEN);
+    if(si == NULL)
+    {
+        close(fd);
+        return -3;
+    }
+    si->sockfd = fd;
+    si->callback = admin_accept_cb;
+    sockitem_watch(si, EPOLL_CTL_ADD, EPOLLIN);
+
+    snprintf(r->admin_path, sizeof(r->admin_path), "%s", addr.sun_path);
+    return fd;
+}
+
+/******************************************
+*name：		reactor_add_fd
+*brief:		注册fd，可读时调用read_cb，可写时调用write_cb（水平触发）。fd由调用者创建和关闭
+*input:		r：事件循环；fd：需要监听的fd；events：REACTOR_READ/REACTOR_WRITE组合；
+            read_cb/write_cb：回调，可为NULL；arg：回调参数
+*output:	无
+*return:	句柄，用于修改和删除；失败返回NULL
+******************************************/
+REACTOR_FD* reactor_add_fd(REACTOR* r, int fd, int events, REACTOR_IO_CB read_cb, REACTOR_IO_CB write_cb, void* arg)
+{
+    struct sockitem *si = sockitem_alloc(r, SI_USER_FD);
+    struct user_fd *u = (struct user_fd*)malloc(sizeof(struct user_fd));
+    if(si == NULL || u == NULL)
+        goto fail;
+
+    u->read_cb = read_cb;
+    u->write_cb = write_cb;
+    u->arg = arg;
+    si->sockfd = fd;
+    si->callback = user_fd_cb;
+    si->ctx = u;
+    if(sockitem_watch(si, EPOLL_CTL_ADD, (events & REACTOR_READ ? EPOLLIN : 0) | (events & REACTOR_WRITE ? EPOLLOUT : 0)) < 0)
+        goto fail;
+    return si;
+
+fail:
+    if(si)
+        sockitem_free(si);
+    free(u);
+    return NULL;
+}
+
+/******************************************
+*name：		reactor_mod_fd
+*brief:		修改reactor_add_fd注册的fd监听的事件
+*input:		r：事件循环；h：句柄；events：REACTOR_READ/REACTOR_WRITE组合
+*output:	无
+*return:	epoll_ctl的返回值
+******************************************/
+int reactor_mod_fd(REACTOR* r, REACTOR_FD* h, int events)
+{
+    return sockitem_watch(h, EPOLL_CTL_MOD, (events & REACTOR_READ ? EPOLLIN : 0) | (events & REACTOR_WRITE ? EPOLLOUT : 0));
+}
+
+/******************************************
+*name：		reactor_del_fd
+*brief:		取消注册，可在该fd的回调中调用。不关闭fd
+*input:		r：事件循环；h：句柄
+*output:	无
+*return:	无
+******************************************/
+void reactor_del_fd(REACTOR* r, REACTOR_FD* h)
+{
+    epoll_ctl(r->epfd, EPOLL_CTL_DEL, h->sockfd, NULL);
+    free(h->ctx);
+    h->ctx = NULL;
+    sockitem_free(h);
+}
+
+/******************************************
+*name：		reactor_now
+*brief:		本轮epoll_wait返回时的时间（单调时钟）
+*input:		r：事件循环
+*output:	无
+*return:	毫秒数
+******************************************/
+uint64_t reactor_now(REACTOR* r)
+{
+    return r->now;
+}
+
+/******************************************
+*name：		reactor_timer_add
+*brief:		启动定时器，已在运行则重新计时。到期回调在事件循环线程中执行
+*input:		r：事件循环；t：tw_timer_init初始化过的定时器；after_ms：多少毫秒后到期
+*output:	无
+*return:	无
+******************************************/
+void reactor_timer_add(REACTOR* r, TW_TIMER* t, int after_ms)
+{
+    tw_add(&r->wheel, t, r->now + after_ms);
+}
+
+/******************************************
+*name：		reactor_timer_del
+*brief:		停止定时器
+*input:		r：事件循环；t：定时器
+*output:	无
+*return:	无
+******************************************/
+void reactor_timer_del(REACTOR* r, TW_TIMER* t)
+{
+    tw_del(&r->wheel, t);
+}
+
+/******************************************
+*name：		reactor_get_stat
+*brief:		获取统计，可在其他线程中无锁读取（用STAT_GET）
+*input:		r：事件循环
+*output:	无
+*return:	统计
+******************************************/
+struct reactor_stat* reactor_get_stat(REACTOR* r)
+{
+    return &r->stat;
+}
@@ -0,0 +1,98 @@
+#ifndef __REACTOR_H__
+#define __REACTOR_H__
+
+/*
+ * reactor 事件循环库。
+ * 一个 REACTOR 就是一个独立的事件循环（epoll fd、时间轮、连接表、统计都在对象内，没有全局变量），
+ * 同一进程中可以创建多个，各自在一个线程中 reactor_run，用 SO_REUSEPORT 监听同一端口即可由内核分摊连接。
+ *
+ * 除 reactor_post、reactor_stop 和读取统计外，其他接口只能在运行该循环的线程中调用
+ * （reactor_run 之前在创建线程中调用也可以）。
+ *
+ * 编译时定义 REACTOR_USE_THREADPOOL 则 listener 的请求交给 thread_pool 处理，
+ * 处理结果经无锁队列 + eventfd 交回事件循环发送。
+ */
+#include <stdint.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include "timer_wheel.h"
+#include "reactor_stat.h"
+
+#ifdef REACTOR_USE_THREADPOOL
+#include "ThreadPoolC.h"
+#endif
+
+#define REACTOR_READ    0x01    // reactor_add_fd/reactor_mod_fd 监听可读
+#define REACTOR_WRITE   0x02    // 监听可写
+
+typedef struct _REACTOR REACTOR;
+typedef struct sockitem REACTOR_FD;     // 注册到事件循环中的fd
+
+//fd可读/可写回调
+typedef void (*REACTOR_IO_CB)(REACTOR* r, REACTOR_FD* h, int fd, void* arg);
+//跨线程投递的任务，在事件循环线程中执行
+typedef void (*REACTOR_TASK_CB)(REACTOR* r, void* arg);
+
+//响应中附带的文件区间，在resp之后用sendfile发送，fd的所有权交给reactor，发完或连接关闭时close
+struct _REACTOR_FILE {
+    int fd;             // <0表示没有文件，调用handler前置为-1
+    off_t offset;
+    size_t length;
+};
+typedef struct _REACTOR_FILE REACTOR_FILE;
+
+//listener的业务处理：一帧请求（以'\n'结尾）生成一帧响应，返回响应长度；需要回复文件时填写file。
+//线程池模式下在工作线程中调用
+typedef int (*REACTOR_HANDLER)(const char* req, int reqlen, char* resp, int respmax, REACTOR_FILE* file);
+
+//UDP端口的业务处理：一个报文生成一个回复报文，返回回复长度，0表示不回复。在事件循环线程中调用
+typedef int (*REACTOR_UDP_HANDLER)(const char* req, int reqlen, const struct sockaddr_in* peer, char* resp, int respmax);
+
+struct _REACTOR_CONFIG {
+    int id;                 // 循环编号，只用于输出
+    int epoll_batch;        // 一次epoll_wait最多取回的事件数
+    int listen_backlog;     // listen队列长度，实际还受 net.core.somaxconn 限制
+    int reuseport;          // 非0时listen fd开启SO_REUSEPORT，多个循环/多个fd监听同一端口
+    int defer_accept_sec;   // >0时开启TCP_DEFER_ACCEPT，客户端发来数据后才唤醒accept
+    int fastopen_qlen;      // >0时开启TCP_FASTOPEN，值为未完成TFO请求的队列长度
+    int accept_max;         // 一次可读事件中最多accept的连接数，避免其他连接饿死
+    int idle_timeout_ms;    // 连接上没有任何收发超过这个时间则关闭
+    int read_timeout_ms;    // 收到半帧后超过这个时间仍未收全则关闭
+    int write_timeout_ms;   // 有数据待发送但超过这个时间发不出去则关闭
+    int stat_interval_ms;   // 周期输出accept/事件速率，0表示不输出
+    int file_copy;          // 非0时文件响应用pread+send代替sendfile，用于对比
+    int udp_batch;          // UDP一次recvmmsg/sendmmsg的报文数，1表示每次事件只recvfrom/sendto一个报文（对比基准）
+    int udp_gro;            // 非0时UDP socket开启UDP_GRO，内核把同一来源的连续报文合并后一次交付
+    int conn_high_water;    // 连接积压的输出（未发送的响应，线程池模式下另加待处理请求按最大响应计）达到它时停止读
+    int conn_low_water;     // 积压降到它以下时恢复读
+    long global_high_water; // 本循环所有连接积压合计达到它时，有积压的连接都停止读
+    long global_low_water;  // 合计降到它以下时恢复
+#ifdef REACTOR_USE_THREADPOOL
+    TP_POOL* workers;       // 工作线程池，可多个循环共用；NULL则由循环自己创建 worker_num 个线程的池
+    int worker_num;
+#endif
+};
+typedef struct _REACTOR_CONFIG REACTOR_CONFIG;
+
+void reactor_config_init(REACTOR_CONFIG* cfg);
+REACTOR* reactor_create(const REACTOR_CONFIG* cfg);
+void reactor_destroy(REACTOR* r);
+
+int reactor_run(REACTOR* r);
+void reactor_stop(REACTOR* r);
+int reactor_post(REACTOR* r, REACTOR_TASK_CB cb, void* arg);
+
+int reactor_add_listener(REACTOR* r, int port, REACTOR_HANDLER handler);
+int reactor_add_udp(REACTOR* r, int port, REACTOR_UDP_HANDLER handler);
+int reactor_enable_admin(REACTOR* r, const char* path);
+
+REACTOR_FD* reactor_add_fd(REACTOR* r, int fd, int events, REACTOR_IO_CB read_cb, REACTOR_IO_CB write_cb, void* arg);
+int reactor_mod_fd(REACTOR* r, REACTOR_FD* h, int events);
+void reactor_del_fd(REACTOR* r, REACTOR_FD* h);
+
+uint64_t reactor_now(REACTOR* r);
+void reactor_timer_add(REACTOR* r, TW_TIMER* t, int after_ms);
+void reactor_timer_del(REACTOR* r, TW_TIMER* t);
+struct reactor_stat* reactor_get_stat(REACTOR* r);
+
+#endif
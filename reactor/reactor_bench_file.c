@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * 文件响应吞吐基准测试：
+ * 每个线程一个连接，循环发送"file <name>"请求并读完"OK <长度>\n"和文件内容，统计吞吐。
+ * 服务端分别以 FILE_COPY 0（sendfile）和 1（pread+send）编译，对比大文件下的吞吐和服务端CPU。
+ */
+
+#define MAX_BENCH_THREAD    64
+#define RECV_BUFSIZE        (256 * 1024)
+
+struct bench_thread
+{
+    pthread_t tid;
+    const char* ip;
+    int port;
+    const char* name;
+    int seconds;
+    unsigned long files;    // 完成的请求数
+    unsigned long bytes;    // 收到的文件字节数
+    int error;
+};
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/******************************************
+*name：		read_header
+*brief:		读取响应头一行。头部之后紧跟着的文件数据留在buf中
+*input:		fd：连接；buf/len：接收缓冲
+*output:	buf：收到的数据；got：收到的总长度
+*return:	头部长度（含'\n'），失败返回-1
+******************************************/
+static int read_header(int fd, char* buf, int len, int* got)
+{
+    *got = 0;
+    while(*got < len)
+    {
+        int ret = recv(fd, buf + *got, len - *got, 0);
+        if(ret <= 0)
+            return -1;
+        *got += ret;
+        char* nl = memchr(buf, '\n', *got);
+        if(nl)
+            return nl - buf + 1;
+    }
+    return -1;
+}
+
+/******************************************
+*name：		bench_thread
+*brief:		一个连接循环请求文件直到时间结束
+*input:		arg：bench_thread
+*output:	无
+*return:	NULL
+******************************************/
+static void* bench_thread(void* arg)
+{
+    struct bench_thread* t = arg;
+    struct sockaddr_in addr;
+    char req[256];
+    char* buf = malloc(RECV_BUFSIZE);
+    int reqlen = snprintf(req, sizeof(req), "file %s\n", t->name);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(t->port);
+    addr.sin_addr.s_addr = inet_addr(t->ip);
+    if(buf == NULL || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        t->error = 1;
+        goto out;
+    }
+
+    double end = now_sec() + t->seconds;
+    while(now_sec() < end)
+    {
+        int got;
+        if(send(fd, req, reqlen, 0) != reqlen)
+        {
+            t->error = 1;
+            break;
+        }
+        int hlen = read_header(fd, buf, RECV_BUFSIZE, &got);
+        if(hlen < 0 || memcmp(buf, "OK ", 3) != 0)
+        {
+            fprintf(stderr, "bad response: %.*s\n", got > 0 ? got : 0, buf);
+            t->error = 1;
+            break;
+        }
+
+        long length = atol(buf + 3);
+        long remain = length - (got - hlen);
+        while(remain > 0)
+        {
+            int ret = recv(fd, buf, RECV_BUFSIZE, 0);
+            if(ret <= 0)
+            {
+                t->error = 1;
+                goto out;
+            }
+            remain -= ret;
+        }
+        t->files++;
+        t->bytes += length;
+    }
+
+out:
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 4)
+    {
+        printf("Usage: %s <ip> <port> <file name> [threads] [seconds]\n", argv[0]);
+        return 0;
+    }
+
+    int n = argc > 4 ? atoi(argv[4]) : 4;
+    int seconds = argc > 5 ? atoi(argv[5]) : 10;
+    if(n < 1 || n > MAX_BENCH_THREAD)
+        n = 4;
+
+    struct bench_thread threads[MAX_BENCH_THREAD];
+    int i;
+    double begin = now_sec();
+    for(i = 0; i < n; i++)
+    {
+        memset(&threads[i], 0, sizeof(threads[i]));
+        threads[i].ip = argv[1];
+        threads[i].port = atoi(argv[2]);
+        threads[i].name = argv[3];
+        threads[i].seconds = seconds;
+        pthread_create(&threads[i].tid, NULL, bench_thread, &threads[i]);
+    }
+
+    unsigned long files = 0, bytes = 0;
+    int errors = 0;
+    for(i = 0; i < n; i++)
+    {
+        pthread_join(threads[i].tid, NULL);
+        files += threads[i].files;
+        bytes += threads[i].bytes;
+        errors += threads[i].error;
+    }
+    double elapsed = now_sec() - begin;
+
+    printf("threads:%d files:%lu errors:%d elapsed:%.2fs\n", n, files, errors, elapsed);
+    printf("files/s:%.1f  MB/s:%.1f\n", files / elapsed, bytes / elapsed / (1024 * 1024));
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/*
+ * 工作线程模式基准测试：
+ * heavy 连接持续发送"heavy"请求（服务端每个耗CPU HEAVY_WORK_MS），fast 连接持续做"ping"往返并统计延迟。
+ * 同步模式下 fast 请求会被 heavy 请求阻塞在事件循环里，线程池模式下 fast 请求延迟应保持平稳。
+ */
+
+#define MAX_BUFSIZE		128
+#define MAX_BENCH_CONN	256
+
+struct bench_conn
+{
+    int sockfd;
+    int heavy;              // 是否是发送 heavy 请求的连接
+    struct timespec sent;   // 最近一次请求的发送时间
+};
+
+static double now_diff_ms(struct timespec* begin)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - begin->tv_sec) * 1000.0 + (now.tv_nsec - begin->tv_nsec) / 1000000.0;
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : (x > y);
+}
+
+/******************************************
+*name：		send_request
+*brief:		发送一个请求并记录发送时间
+*input:		c：连接
+*output:	无
+*return:	send返回值
+******************************************/
+static int send_request(struct bench_conn* c)
+{
+    const char* req = c->heavy ? "heavy\n" : "ping\n";
+    clock_gettime(CLOCK_MONOTONIC, &c->sent);
+    return send(c->sockfd, req, strlen(req), 0);
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 3)
+    {
+        printf("Usage: %s <ip> <port> [heavy_conns] [fast_conns] [seconds]\n", argv[0]);
+        return 0;
+    }
+
+    const char* ip = argv[1];
+    int port = atoi(argv[2]);
+    int heavy_conns = argc > 3 ? atoi(argv[3]) : 2;
+    int fast_conns = argc > 4 ? atoi(argv[4]) : 8;
+    int seconds = argc > 5 ? atoi(argv[5]) : 10;
+    int total = heavy_conns + fast_conns;
+    if(total > MAX_BENCH_CONN)
+    {
+        printf("too many connections, max %d\n", MAX_BENCH_CONN);
+        return 0;
+    }
+
+    struct bench_conn conns[MAX_BENCH_CONN];
+    struct epoll_event events[MAX_BENCH_CONN];
+    int epfd = epoll_create(1);
+    int i;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(ip);
+    addr.sin_port = htons(port);
+
+    //1、建立连接，各发出第一个请求
+    for(i = 0; i < total; i++)
+    {
+        struct bench_conn* c = &conns[i];
+        c->heavy = i < heavy_conns;
+        c->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if(c->sockfd < 0 || connect(c->sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            perror("connect");
+            return -1;
+        }
+        int nodelay = 1;
+        setsockopt(c->sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c->sockfd, &ev);
+        send_request(c);
+    }
+
+    //2、收到响应就统计延迟并发出下一个请求
+    size_t cap = 1024, nlat = 0;
+    double* lat = (double*)malloc(cap * sizeof(double));
+    long heavy_done = 0;
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    while(now_diff_ms(&begin) < seconds * 1000.0)
+    {
+        int nready = epoll_wait(epfd, events, MAX_BENCH_CONN, 100);
+        for(i = 0; i < nready; i++)
+        {
+            struct bench_conn* c = events[i].data.ptr;
+            char buf[MAX_BUFSIZE];
+            ssize_t length = recv(c->sockfd, buf, sizeof(buf), 0);
+            if(length <= 0)
+            {
+                if(length < 0 && errno == EINTR) continue;
+                printf("connection closed by server\n");
+                return -1;
+            }
+            if(memchr(buf, '\n', length) == NULL)
+                continue;   // 响应还没收全
+
+            if(c->heavy)
+            {
+                heavy_done++;
+            }
+            else
+            {
+                if(nlat == cap)
+                {
+                    cap <<= 1;
+                    lat = (double*)realloc(lat, cap * sizeof(double));
+                }
+                lat[nlat++] = now_diff_ms(&c->sent);
+            }
+            send_request(c);
+        }
+    }
+
+    //3、输出 fast 请求延迟分布
+    if(nlat == 0)
+    {
+        printf("no fast request finished\n");
+        return 0;
+    }
+    qsort(lat, nlat, sizeof(double), cmp_double);
+    double sum = 0;
+    size_t k;
+    for(k = 0; k < nlat; k++)
+        sum += lat[k];
+
+    printf("heavy requests done: %ld\n", heavy_done);
+    printf("fast requests done: %lu\n", nlat);
+    printf("fast latency(ms) avg:%.3f p50:%.3f p99:%.3f max:%.3f\n",
+        sum / nlat, lat[nlat / 2], lat[nlat * 99 / 100], lat[nlat - 1]);
+
+    free(lat);
+    for(i = 0; i < total; i++)
+        close(conns[i].sockfd);
+    return 0;
+}
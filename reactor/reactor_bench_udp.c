@@ -0,0 +1,206 @@
+#define _GNU_SOURCE     // recvmmsg/sendmmsg
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT     103
+#endif
+
+/*
+ * UDP 回显吞吐基准测试：
+ * 每个线程一个 UDP socket，保持 window 个报文在途，每收到一个回复补发一个，统计每秒回复数。
+ * 服务端分别以 UDP_RECV_BATCH 64（recvmmsg/sendmmsg）和 1（每次事件一个 recvfrom）编译对比；
+ * gso 为 1 时客户端用 UDP_SEGMENT 一次发出一整批报文，配合服务端 UDP_USE_GRO 测试 GSO/GRO。
+ */
+
+#define MAX_BENCH_THREAD    64
+#define MAX_WINDOW          64
+#define MAX_PAYLOAD         1400
+#define LOSS_TIMEOUT_MS     100     // 这么久没有收到回复则认为在途的报文已丢失，重新补满窗口
+
+struct bench_thread
+{
+    pthread_t tid;
+    struct sockaddr_in addr;
+    int window;
+    int size;
+    int seconds;
+    int gso;
+    unsigned long sent;
+    unsigned long replies;
+    unsigned long timeouts;     // 超时补窗次数
+};
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/******************************************
+*name：		send_batch
+*brief:		发出n个报文：普通模式一次sendmmsg，gso模式一次sendmsg带UDP_SEGMENT由内核分段
+*input:		t：线程；fd：socket；buf：报文内容（n*size字节）；n：报文数
+*output:	无
+*return:	发出的报文数
+******************************************/
+static int send_batch(struct bench_thread* t, int fd, char* buf, int n)
+{
+    int i;
+    if(t->gso && n > 1)
+    {
+        char control[CMSG_SPACE(sizeof(uint16_t))];
+        struct iovec iov = { buf, (size_t)n * t->size };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        memset(control, 0, sizeof(control));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t seg = t->size;
+        memcpy(CMSG_DATA(cm), &seg, sizeof(seg));
+        return sendmsg(fd, &msg, 0) > 0 ? n : 0;
+    }
+
+    struct mmsghdr msgs[MAX_WINDOW];
+    struct iovec iov[MAX_WINDOW];
+    memset(msgs, 0, sizeof(msgs));
+    for(i = 0; i < n; i++)
+    {
+        iov[i].iov_base = buf + i * t->size;
+        iov[i].iov_len = t->size;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int ret = sendmmsg(fd, msgs, n, 0);
+    return ret > 0 ? ret : 0;
+}
+
+/******************************************
+*name：		bench_thread
+*brief:		保持window个报文在途直到时间结束
+*input:		arg：bench_thread
+*output:	无
+*return:	NULL
+******************************************/
+static void* bench_thread(void* arg)
+{
+    struct bench_thread* t = arg;
+    static char payload[MAX_WINDOW * MAX_PAYLOAD];
+    char rbuf[MAX_WINDOW][MAX_PAYLOAD];
+    struct mmsghdr rmsgs[MAX_WINDOW];
+    struct iovec riov[MAX_WINDOW];
+    int i;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd < 0 || connect(fd, (struct sockaddr*)&t->addr, sizeof(t->addr)) < 0)
+        return NULL;
+
+    memset(rmsgs, 0, sizeof(rmsgs));
+    for(i = 0; i < MAX_WINDOW; i++)
+    {
+        riov[i].iov_base = rbuf[i];
+        riov[i].iov_len = MAX_PAYLOAD;
+        rmsgs[i].msg_hdr.msg_iov = &riov[i];
+        rmsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int inflight = send_batch(t, fd, payload, t->window);
+    t->sent += inflight;
+    double end = now_sec() + t->seconds;
+    while(now_sec() < end)
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if(poll(&pfd, 1, LOSS_TIMEOUT_MS) <= 0)
+        {
+            t->timeouts++;
+            inflight = 0;
+        }
+        else
+        {
+            int n = recvmmsg(fd, rmsgs, MAX_WINDOW, MSG_DONTWAIT, NULL);
+            if(n > 0)
+            {
+                t->replies += n;
+                inflight -= n;
+                if(inflight < 0)
+                    inflight = 0;
+            }
+        }
+
+        int more = send_batch(t, fd, payload, t->window - inflight);
+        t->sent += more;
+        inflight += more;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 3)
+    {
+        printf("Usage: %s <ip> <port> [threads] [window] [size] [seconds] [gso]\n", argv[0]);
+        return 0;
+    }
+
+    int n = argc > 3 ? atoi(argv[3]) : 4;
+    int window = argc > 4 ? atoi(argv[4]) : 32;
+    int size = argc > 5 ? atoi(argv[5]) : 64;
+    int seconds = argc > 6 ? atoi(argv[6]) : 5;
+    int gso = argc > 7 ? atoi(argv[7]) : 0;
+    if(n < 1 || n > MAX_BENCH_THREAD)
+        n = 4;
+    if(window < 1 || window > MAX_WINDOW)
+        window = 32;
+    if(size < 1 || size > MAX_PAYLOAD)
+        size = 64;
+
+    struct bench_thread threads[MAX_BENCH_THREAD];
+    int i;
+    double begin = now_sec();
+    for(i = 0; i < n; i++)
+    {
+        memset(&threads[i], 0, sizeof(threads[i]));
+        threads[i].addr.sin_family = AF_INET;
+        threads[i].addr.sin_port = htons(atoi(argv[2]));
+        threads[i].addr.sin_addr.s_addr = inet_addr(argv[1]);
+        threads[i].window = window;
+        threads[i].size = size;
+        threads[i].seconds = seconds;
+        threads[i].gso = gso;
+        pthread_create(&threads[i].tid, NULL, bench_thread, &threads[i]);
+    }
+
+    unsigned long sent = 0, replies = 0, timeouts = 0;
+    for(i = 0; i < n; i++)
+    {
+        pthread_join(threads[i].tid, NULL);
+        sent += threads[i].sent;
+        replies += threads[i].replies;
+        timeouts += threads[i].timeouts;
+    }
+    double elapsed = now_sec() - begin;
+
+    printf("threads:%d window:%d size:%d gso:%d sent:%lu replies:%lu timeouts:%lu elapsed:%.2fs\n",
+        n, window, size, gso, sent, replies, timeouts, elapsed);
+    printf("replies/s:%.0f  loss:%.2f%%\n", replies / elapsed, sent ? 100.0 * (sent - replies) / sent : 0.0);
+    return 0;
+}
@@ -1,172 +1,973 @@
+#define _GNU_SOURCE     // epoll_pwait2
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <getopt.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
-#include <sys/time.h>
+#include <time.h>
 #include <errno.h>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
-#include <fcntl.h>
+#include "lat_hist.h"
 
-#define MAX_CONNECTION  100000 // 单个客户端建立10W个连接
-#define MAX_BUFSIZE		128
-#define MAX_PORT		10	    // 最大端口数量
+/*
+ * reactor 压测客户端：多线程，每个线程一个 epoll，负责一部分连接。三种模式：
+ * load（默认）：先并行建立所有连接，再收发请求。
+ *   闭环（-r 0）：每个连接收到响应后立刻发下一个请求，测最大吞吐。
+ *   开环（-r N）：按固定速率发请求，请求的"计划发送时间"是 start + k / rate，与服务端快慢无关；
+ *   没有空闲连接时请求在客户端排队，延迟从计划发送时间算起（修正 coordinated omission），
+ *   同时单独统计从实际发出算起的服务时间。
+ * churn：按目标速率不断新建连接，每个连接收发 N 个请求后关闭，测建连/断连的开销，观察服务端内存是否泄漏。
+ * ramp：每次新增一批连接，记录这一批的建连耗时和服务端内存，观察连接数增长时建连是否变慢。
+ * 每个请求携带序号和时间戳，响应按序号与请求匹配。结果以 JSON 输出到 stdout，过程信息输出到 stderr。
+ */
 
-#define TIME_MS_USED(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)  // 用于计算耗时
-struct epoll_event events[MAX_CONNECTION];
+#define MAX_CONNECTION  100000  // 最大连接数
+#define MAX_THREAD      64      // 最大线程数
+#define MAX_PORT		10	    // 服务端端口数量，连接均匀地使用这些端口
+#define MIN_PAYLOAD     48      // 请求头（序号、计划发送时间、实际发送时间）加换行的长度
+#define MAX_PAYLOAD     1024    // 不超过服务端的接收缓冲，否则会被拆成多帧
+#define EVENTS_NUM      1024    // 一次epoll_wait最多取回的事件数
+#define MAX_RSS_SAMPLES 3600    // churn模式最多记录多少个每秒的服务端内存
+
+//压测模式
+#define MODE_LOAD       0
+#define MODE_CHURN      1
+#define MODE_RAMP       2
+
+//连接状态
+#define CONN_CONNECTING 1
+#define CONN_IDLE       2       // 已连接，没有请求在途
+#define CONN_BUSY       3       // 有请求在途
+#define CONN_CLOSED     4
+
+struct conn
+{
+    int fd;
+    int state;
+    int port;
+    int settled;            // 已完成当前阶段（load：建连完成；ramp：收到第一个响应）或已失败
+    int msgs;               // 已收到的响应数
+    uint32_t seq;           // 在途请求的序号
+    uint64_t connect_start; // 开始connect的时间
+    char* rbuf;             // 接收缓冲，长度为2倍payload
+    int rlen;
+    char* wbuf;             // 待发送的请求
+    int wlen;
+    int wpos;               // 已发送的位置
+    struct conn* next_idle; // 空闲连接链表；churn模式下为空闲槽位链表
+};
+
+struct options
+{
+    const char* ip;
+    int port;
+    int nports;
+    int threads;
+    int connections;        // load/ramp：总连接数；churn：同时存在的最大连接数
+    double rate;            // 总请求速率（请求/秒），0表示闭环
+    int payload;            // 请求长度（含换行）
+    int duration;           // 压测时长（秒）；ramp模式下为建满连接后保持的时长
+    int mode;
+    int msgs;               // churn：每个连接收发的请求数
+    double conn_rate;       // churn：总建连速率（连接/秒），0表示有空闲槽位就建连
+    int step;               // ramp：每批新增的连接数
+    int server_pid;         // 服务端进程号，非0时记录服务端内存（须在同一台机器上）
+};
+
+struct worker
+{
+    pthread_t tid;
+    int id;
+    const struct options* opt;
+    pthread_barrier_t* barrier;     // ramp模式下与主线程逐批同步
+    int epfd;
+    struct conn* conns;
+    int nconns;
+    struct conn* idle;      // 空闲连接链表
+    double interval_ns;     // 开环时本线程相邻两个请求的计划间隔
+    uint64_t start;         // 开始压测的时间
+    uint64_t sched;         // 开环：下一个要发出的请求序号，计划发送时间为 start + sched * interval_ns
+    int settled;            // 已完成当前阶段的连接数
+    uint64_t connect_done;  // 所有连接建立（或失败）的时间
+    struct conn* free_conns;    // churn：空闲槽位
+    double conn_interval_ns;    // churn：本线程相邻两个新连接的计划间隔
+
+    //统计，只由本线程写，主线程用 __atomic_load_n 读取进度
+    uint64_t requests;      // 收到的响应数
+    uint64_t sessions;      // churn：完成的连接数
+    uint64_t errors;        // 连接错误数
+    uint64_t mismatches;    // 响应与在途请求不匹配的次数
+    LAT_HIST latency;       // 开环从计划发送时间算起，闭环与service相同
+    LAT_HIST service;       // 从实际发送时间算起
+    LAT_HIST connect;       // connect耗时
+    LAT_HIST setup;         // 从connect到收到第一个响应，包含服务端accept的排队时间
+    LAT_HIST session;       // churn：从connect到收完N个响应
+    int done;               // 线程已结束
+};
 
 /******************************************
-*name：		fdSetNonBlock
-*brief:		设置fd为非阻塞
-*input:		fd：需要设置的fd
+*name：		now_ns
+*brief:		获取单调时钟的当前时间
+*input:		无
 *output:	无
-*return:	0：成功；-1：失败；
+*return:	纳秒数
 ******************************************/
-static int fdSetNonBlock(int fd)
+static uint64_t now_ns(void)
 {
-    int flags;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-    flags = fcntl(fd, F_GETFL);
-    if(flags < 0) return flags;
+/******************************************
+*name：		read_rss_kb
+*brief:		读取进程的常驻内存
+*input:		pid：进程号
+*output:	无
+*return:	VmRSS（KB），pid为0或读取失败返回-1
+******************************************/
+static long read_rss_kb(int pid)
+{
+    char path[64], line[256];
+    long rss = -1;
 
-    flags |= O_NONBLOCK;
-    if(fcntl(fd, F_SETFL, flags) < 0) return -1;
+    if(pid == 0)
+        return -1;
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE* fp = fopen(path, "r");
+    if(fp == NULL)
+        return -1;
+    while(fgets(line, sizeof(line), fp))
+    {
+        if(sscanf(line, "VmRSS: %ld", &rss) == 1)
+            break;
+    }
+    fclose(fp);
+    return rss;
+}
 
+/******************************************
+*name：		conn_settle
+*brief:		连接完成当前阶段（或失败），只计一次
+*input:		w：线程；c：连接
+*output:	无
+*return:	无
+******************************************/
+static void conn_settle(struct worker* w, struct conn* c)
+{
+    if(!c->settled)
+    {
+        c->settled = 1;
+        w->settled++;
+    }
+}
+
+/******************************************
+*name：		conn_close
+*brief:		关闭连接。churn模式下主动关闭用RST，避免客户端堆积TIME_WAIT耗尽本地端口，并归还槽位
+*input:		w：线程；c：连接；error：是否因出错关闭
+*output:	无
+*return:	无
+******************************************/
+static void conn_close(struct worker* w, struct conn* c, int error)
+{
+    if(c->fd >= 0)
+    {
+        if(w->opt->mode == MODE_CHURN && !error)
+        {
+            struct linger lg = { 1, 0 };
+            setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        }
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->fd = -1;
+    }
+    if(error)
+        w->errors++;
+    conn_settle(w, c);
+    c->state = CONN_CLOSED;
+
+    if(w->opt->mode == MODE_CHURN)
+    {
+        c->next_idle = w->free_conns;
+        w->free_conns = c;
+    }
+}
+
+/******************************************
+*name：		conn_flush
+*brief:		发送连接上待发送的请求，发不完时监听EPOLLOUT
+*input:		w：线程；c：连接
+*output:	无
+*return:	0：成功；-1：连接出错已关闭
+******************************************/
+static int conn_flush(struct worker* w, struct conn* c)
+{
+    struct epoll_event ev;
+
+    while(c->wpos < c->wlen)
+    {
+        int ret = send(c->fd, c->wbuf + c->wpos, c->wlen - c->wpos, MSG_NOSIGNAL);
+        if(ret > 0)
+        {
+            c->wpos += ret;
+            continue;
+        }
+        if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            ev.events = EPOLLIN | EPOLLOUT;
+            ev.data.ptr = c;
+            epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+            return 0;
+        }
+        if(ret < 0 && errno == EINTR)
+            continue;
+        conn_close(w, c, 1);
+        return -1;
+    }
     return 0;
 }
 
 /******************************************
-*name：		sockSetReuseAddr
-*brief:		设置socket SO_REUSEADDR
-*input:		sockfd：需要设置的fd
+*name：		conn_request
+*brief:		在连接上发出一个请求。请求格式：序号 计划发送时间 实际发送时间（十六进制），用'x'填充到payload长度，'\n'结尾
+*input:		w：线程；c：空闲连接；intended：计划发送时间；now：当前时间
 *output:	无
-*return:	0：成功
+*return:	无
 ******************************************/
-static int sockSetReuseAddr(int sockfd)
+static void conn_request(struct worker* w, struct conn* c, uint64_t intended, uint64_t now)
 {
-    int reuse = 1;
-    return setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    int payload = w->opt->payload;
+
+    c->seq++;
+    int n = snprintf(c->wbuf, payload, "%08x %016lx %016lx ", c->seq, (unsigned long)intended, (unsigned long)now);
+    memset(c->wbuf + n, 'x', payload - 1 - n);
+    c->wbuf[payload - 1] = '\n';
+    c->wlen = payload;
+    c->wpos = 0;
+    c->state = CONN_BUSY;
+    conn_flush(w, c);
 }
 
-int main(int argc, char *argv[])
+/******************************************
+*name：		next_request
+*brief:		连接空闲时决定下一步：闭环立即发下一个请求；开环若有已到计划时间的请求则发出，否则放入空闲链表
+*input:		w：线程；c：空闲连接；now：当前时间
+*output:	无
+*return:	无
+******************************************/
+static void next_request(struct worker* w, struct conn* c, uint64_t now)
 {
-    if(argc < 3)
+    if(w->interval_ns == 0)
     {
-        printf("Usage: %s <ip> <port>", argv[0]);
-        return 0;
+        conn_request(w, c, now, now);
+        return;
     }
 
-    const char* ip = argv[1];
-    int port = atoi(argv[2]);
-    int connections = 0;    // 建立连接的计数，用于统计
-    char buffer[MAX_BUFSIZE] = {0};
-    int i;
-    int portOffset = 0;
-    int epfd = epoll_create(1);
+    uint64_t intended = w->start + (uint64_t)(w->sched * w->interval_ns);
+    if(intended <= now)
+    {
+        w->sched++;
+        conn_request(w, c, intended, now);
+    }
+    else
+    {
+        c->state = CONN_IDLE;
+        c->next_idle = w->idle;
+        w->idle = c;
+    }
+}
 
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(struct sockaddr_in));
-    addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = inet_addr(ip);
+/******************************************
+*name：		conn_response
+*brief:		处理一行响应：按序号匹配在途请求，记录延迟，再按模式决定下一步
+*input:		w：线程；c：连接；line：响应行；len：长度；now：当前时间
+*output:	无
+*return:	无
+******************************************/
+static void conn_response(struct worker* w, struct conn* c, const char* line, int len, uint64_t now)
+{
+    const struct options* opt = w->opt;
+    char head[MIN_PAYLOAD];
+    unsigned int seq;
+    unsigned long intended, sent;
 
-    struct timeval loopBegin, loopEnd;
+    if(len >= MIN_PAYLOAD)
+        len = MIN_PAYLOAD - 1;
+    memcpy(head, line, len);
+    head[len] = '\0';
 
+    if(c->state != CONN_BUSY || sscanf(head, "%x %lx %lx", &seq, &intended, &sent) != 3 || seq != c->seq)
+    {
+        w->mismatches++;
+        return;
+    }
+
+    lh_record(&w->latency, now - intended);
+    lh_record(&w->service, now - sent);
+    __atomic_store_n(&w->requests, w->requests + 1, __ATOMIC_RELAXED);
+    if(c->msgs++ == 0)
+        lh_record(&w->setup, now - c->connect_start);
+
+    switch(opt->mode)
+    {
+    case MODE_LOAD:
+        if(now < w->start + (uint64_t)opt->duration * 1000000000)
+            next_request(w, c, now);
+        else
+            c->state = CONN_IDLE;   // 压测结束，不再发新请求
+        break;
+    case MODE_RAMP:
+        c->state = CONN_IDLE;       // 连接保持空闲
+        conn_settle(w, c);
+        break;
+    case MODE_CHURN:
+        if(c->msgs < opt->msgs)
+        {
+            conn_request(w, c, now, now);
+            break;
+        }
+        lh_record(&w->session, now - c->connect_start);
+        __atomic_store_n(&w->sessions, w->sessions + 1, __ATOMIC_RELAXED);
+        conn_close(w, c, 0);
+        break;
+    }
+}
+
+/******************************************
+*name：		conn_recv
+*brief:		接收响应，按'\n'切行
+*input:		w：线程；c：连接
+*output:	无
+*return:	无
+******************************************/
+static void conn_recv(struct worker* w, struct conn* c)
+{
+    int cap = 2 * w->opt->payload;
 
     while(1)
     {
-        struct epoll_event ev;
-		int sockfd = 0;
+        int ret = recv(c->fd, c->rbuf + c->rlen, cap - c->rlen, 0);
+        if(ret <= 0)
+        {
+            if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+            if(ret < 0 && errno == EINTR)
+                continue;
+            conn_close(w, c, 1);
+            return;
+        }
+        c->rlen += ret;
 
-		//1、连接数量未达到最大值就一直新建连接并connect到服务端
-        if(connections < MAX_CONNECTION)
+        uint64_t now = now_ns();
+        int start = 0;
+        char* nl;
+        while((nl = memchr(c->rbuf + start, '\n', c->rlen - start)) != NULL)
+        {
+            int len = nl - (c->rbuf + start) + 1;
+            conn_response(w, c, c->rbuf + start, len, now);
+            if(c->state == CONN_CLOSED)
+                return;
+            start += len;
+        }
+        if(start == 0 && c->rlen == cap)
         {
-            sockfd = socket(AF_INET, SOCK_STREAM, 0);
-            if(sockfd < 0)
+            w->mismatches++;    // 超长的行，丢弃
+            start = c->rlen;
+        }
+        c->rlen -= start;
+        if(c->rlen > 0 && start > 0)
+            memmove(c->rbuf, c->rbuf + start, c->rlen);
+    }
+}
+
+/******************************************
+*name：		conn_start
+*brief:		非阻塞connect，结果在EPOLLOUT中处理
+*input:		w：线程；c：连接；addr：服务端地址
+*output:	无
+*return:	无
+******************************************/
+static void conn_start(struct worker* w, struct conn* c, struct sockaddr_in* addr)
+{
+    struct epoll_event ev;
+
+    c->state = CONN_CONNECTING;
+    c->settled = 0;
+    c->msgs = 0;
+    c->rlen = 0;
+    c->connect_start = now_ns();
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(c->fd < 0)
+    {
+        conn_close(w, c, 1);
+        return;
+    }
+
+    addr->sin_port = htons(c->port);
+    if(connect(c->fd, (struct sockaddr*)addr, sizeof(struct sockaddr_in)) < 0 && errno != EINPROGRESS)
+    {
+        conn_close(w, c, 1);
+        return;
+    }
+
+    ev.events = EPOLLOUT;
+    ev.data.ptr = c;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+/******************************************
+*name：		conn_connected
+*brief:		connect完成（EPOLLOUT），检查结果；成功则记录耗时并切换为监听EPOLLIN。
+            churn/ramp模式下立即发出第一个请求
+*input:		w：线程；c：连接
+*output:	无
+*return:	无
+******************************************/
+static void conn_connected(struct worker* w, struct conn* c)
+{
+    struct epoll_event ev;
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if(err != 0)
+    {
+        conn_close(w, c, 1);
+        return;
+    }
+
+    int nodelay = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    uint64_t now = now_ns();
+    lh_record(&w->connect, now - c->connect_start);
+
+    c->state = CONN_IDLE;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+
+    if(w->opt->mode == MODE_LOAD)
+        conn_settle(w, c);
+    else
+        conn_request(w, c, now, now);
+}
+
+/******************************************
+*name：		poll_events
+*brief:		等待并处理一轮事件
+*input:		w：线程；wait：最长等待时间（纳秒）
+*output:	无
+*return:	无
+******************************************/
+static void poll_events(struct worker* w, uint64_t wait)
+{
+    struct epoll_event events[EVENTS_NUM];
+    int i;
+
+    //开环的请求间隔可能远小于1ms，用纳秒精度的epoll_pwait2等待
+    struct timespec ts = { wait / 1000000000, wait % 1000000000 };
+    int nready = epoll_pwait2(w->epfd, events, EVENTS_NUM, &ts, NULL);
+    for(i = 0; i < nready; i++)
+    {
+        struct conn* c = events[i].data.ptr;
+        if(c->state == CONN_CLOSED)
+            continue;   // 本轮前面的事件中已关闭
+        if(c->state == CONN_CONNECTING)
+        {
+            conn_connected(w, c);
+            continue;
+        }
+        if(events[i].events & EPOLLOUT)
+        {
+            if(conn_flush(w, c) == 0 && c->wpos == c->wlen)
             {
-                perror("socket");
-                goto errExit;
+                struct epoll_event ev;
+                ev.events = EPOLLIN;
+                ev.data.ptr = c;
+                epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
             }
+        }
+        if(c->state != CONN_CLOSED && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+            conn_recv(w, c);
+    }
+}
 
-            addr.sin_port = htons(port + portOffset);
-            portOffset = (portOffset + 1) % MAX_PORT;   // 均匀地使用这10个端口
+/******************************************
+*name：		close_all
+*brief:		关闭线程的所有连接
+*input:		w：线程
+*output:	无
+*return:	无
+******************************************/
+static void close_all(struct worker* w)
+{
+    int i;
+    for(i = 0; i < w->nconns; i++)
+    {
+        struct conn* c = &w->conns[i];
+        if(c->state != CONN_CLOSED && c->state != 0)
+        {
+            close(c->fd);
+            c->state = CONN_CLOSED;
+        }
+    }
+}
 
-            if(connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+/******************************************
+*name：		load_loop
+*brief:		load模式：并行建立本线程的所有连接，然后按闭环/开环发请求直到压测时长结束
+*input:		w：线程；addr：服务端地址
+*output:	无
+*return:	无
+******************************************/
+static void load_loop(struct worker* w, struct sockaddr_in* addr)
+{
+    int i;
+
+    //1、所有连接同时发起connect
+    for(i = 0; i < w->nconns; i++)
+        conn_start(w, &w->conns[i], addr);
+    while(w->settled < w->nconns)
+        poll_events(w, 1000000000);
+    w->connect_done = now_ns();
+
+    //2、压测
+    w->start = now_ns();
+    uint64_t end = w->start + (uint64_t)w->opt->duration * 1000000000;
+    for(i = 0; i < w->nconns; i++)
+    {
+        struct conn* c = &w->conns[i];
+        if(c->state == CONN_IDLE)
+            next_request(w, c, w->start);
+    }
+
+    while(1)
+    {
+        uint64_t now = now_ns();
+        if(now >= end)
+            break;
+
+        //开环：把到了计划时间的请求分给空闲连接，没有空闲连接的留在sched之后排队
+        uint64_t wait = end - now;
+        if(w->interval_ns > 0)
+        {
+            uint64_t intended = w->start + (uint64_t)(w->sched * w->interval_ns);
+            while(intended <= now && w->idle)
             {
-                perror("connect");
-                goto errExit;
+                struct conn* c = w->idle;
+                w->idle = c->next_idle;
+                if(c->state == CONN_CLOSED)     //空闲时被服务端关闭的连接，丢弃
+                    continue;
+                w->sched++;
+                conn_request(w, c, intended, now);
+                intended = w->start + (uint64_t)(w->sched * w->interval_ns);
             }
+            while(w->idle && w->idle->state == CONN_CLOSED)
+                w->idle = w->idle->next_idle;
+            if(w->idle && intended < end)
+                wait = intended > now ? intended - now : 0;
+        }
+        poll_events(w, wait);
+    }
+}
 
-            fdSetNonBlock(sockfd);
-            sockSetReuseAddr(sockfd);
+/******************************************
+*name：		churn_loop
+*brief:		churn模式：按计划速率新建连接（同时存在的连接数不超过槽位数），每个连接收发N个请求后关闭
+*input:		w：线程；addr：服务端地址
+*output:	无
+*return:	无
+******************************************/
+static void churn_loop(struct worker* w, struct sockaddr_in* addr)
+{
+    uint64_t sched = 0;
+    int i;
 
-			//配置加入epoll监听
-            ev.events = EPOLLIN | EPOLLOUT;
-            ev.data.fd = sockfd;
-            epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev);
-
-            connections++; // 连接数增加
-        }
-
-        //2、每增加10000个连接就执行一次
-        if(connections % 10000 == 0 || connections == MAX_CONNECTION)
-        {
-            gettimeofday(&loopBegin, NULL);	//起始时间
-			
-			int nready = epoll_wait(epfd, events, 10000, 100);
-			for(i = 0; i < nready; i++)
-			{
-				int clientfd = events[i].data.fd;
-
-				//可读
-				if (events[i].events & EPOLLIN) 
-				{
-					char rBuffer[MAX_BUFSIZE] = {0};				
-					ssize_t length = recv(clientfd, rBuffer, MAX_BUFSIZE, 0);
-					if (length > 0) 
-					{
-						//printf("# Recv from server: %s\n", rBuffer);	//output1打印较多
-					} 
-					else if (length == 0) 
-					{
-						printf("# Disconnected. clientfd:%d\n", clientfd);
-						connections --;
-						epoll_ctl(epfd, EPOLL_CTL_DEL, clientfd, &events[i]);
-						close(clientfd);
-					} 
-					else 
-					{
-						if (errno == EINTR) continue;
-
-						printf(" Error clientfd:%d, errno:%d\n", clientfd, errno);
-						epoll_ctl(epfd, EPOLL_CTL_DEL, clientfd, &events[i]);
-						close(clientfd);
-					}
-				} 
-				else if (events[i].events & EPOLLOUT)	//可写
-				{
-					sprintf(buffer, "client data from fd %d\n", clientfd);
-					send(clientfd, buffer, strlen(buffer), 0);
-					//printf("# Send to server: %s\n", buffer);	//output2打印较多
-				}
-				else 
-				{
-					printf(" clientfd:%d, unknown events:%d\n", clientfd, events[i].events);
-				}
-			}
-			
-            //计算响应时间			
-            gettimeofday(&loopEnd, NULL);
-            int tempMs = TIME_MS_USED(loopEnd, loopBegin);
-            printf("########%d client time_used:%d\n", nready, tempMs);	//output3（可关闭output1、output2查看较为清晰）
+    for(i = w->nconns - 1; i >= 0; i--)
+    {
+        w->conns[i].state = CONN_CLOSED;
+        w->conns[i].fd = -1;
+        w->conns[i].next_idle = w->free_conns;
+        w->free_conns = &w->conns[i];
+    }
+
+    w->start = now_ns();
+    uint64_t end = w->start + (uint64_t)w->opt->duration * 1000000000;
+    while(1)
+    {
+        uint64_t now = now_ns();
+        if(now >= end)
+            break;
+
+        //到了计划时间的新连接占用空闲槽位发起connect；没有空闲槽位则推迟
+        uint64_t wait = end - now;
+        uint64_t due = w->start + (uint64_t)(sched * w->conn_interval_ns);
+        while(w->free_conns && due <= now)
+        {
+            struct conn* c = w->free_conns;
+            w->free_conns = c->next_idle;
+            sched++;
+            conn_start(w, c, addr);
+            due = w->start + (uint64_t)(sched * w->conn_interval_ns);
         }
+        if(w->free_conns && due < end)
+            wait = due > now ? due - now : 0;
+        poll_events(w, wait);
     }
+}
 
-    return 0;
+/******************************************
+*name：		ramp_loop
+*brief:		ramp模式：每批新增step个连接（各线程分摊），每个新连接收到第一个响应后算完成，
+            一批完成后与主线程同步，由主线程汇总这一批的耗时和服务端内存；建满后保持duration秒再关闭
+*input:		w：线程；addr：服务端地址
+*output:	无
+*return:	无
+******************************************/
+static void ramp_loop(struct worker* w, struct sockaddr_in* addr)
+{
+    const struct options* opt = w->opt;
+    int started = 0;
+    int k;
+
+    for(k = 1; ; k++)
+    {
+        int total = k * opt->step < opt->connections ? k * opt->step : opt->connections;
+        int mine = total / opt->threads + (w->id < total % opt->threads);
+
+        while(started < mine)
+            conn_start(w, &w->conns[started++], addr);
+        while(w->settled < started)
+            poll_events(w, 1000000000);
+
+        pthread_barrier_wait(w->barrier);   // 本批完成
+        pthread_barrier_wait(w->barrier);   // 主线程已汇总
+        if(total == opt->connections)
+            break;
+    }
+
+    //保持连接，期间继续处理事件（服务端空闲超时关闭等）
+    uint64_t end = now_ns() + (uint64_t)opt->duration * 1000000000;
+    uint64_t now;
+    while((now = now_ns()) < end)
+        poll_events(w, end - now);
+    close_all(w);
+    pthread_barrier_wait(w->barrier);       // 所有连接已关闭
+}
+
+/******************************************
+*name：		worker_loop
+*brief:		压测线程
+*input:		arg：worker
+*output:	无
+*return:	NULL
+******************************************/
+static void* worker_loop(void* arg)
+{
+    struct worker* w = arg;
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(w->opt->ip);
 
-errExit:
-	printf("error : %s\n", strerror(errno));
-	return 0;
-}
\ No newline at end of file
+    switch(w->opt->mode)
+    {
+    case MODE_LOAD:
+        load_loop(w, &addr);
+        break;
+    case MODE_CHURN:
+        churn_loop(w, &addr);
+        break;
+    case MODE_RAMP:
+        ramp_loop(w, &addr);
+        break;
+    }
+
+    close_all(w);
+    __atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/******************************************
+*name：		merge_hist
+*brief:		合并所有线程的某个直方图
+*input:		workers：线程数组；n：线程数；offset：直方图在worker中的偏移
+*output:	dst：合并结果
+*return:	无
+******************************************/
+static void merge_hist(LAT_HIST* dst, struct worker* workers, int n, size_t offset)
+{
+    int i;
+    lh_init(dst);
+    for(i = 0; i < n; i++)
+        lh_merge(dst, (LAT_HIST*)((char*)&workers[i] + offset));
+}
+
+/******************************************
+*name：		ramp_report
+*brief:		ramp模式主线程：逐批等待各线程完成，汇总这一批的建连耗时和服务端内存
+*input:		opt：参数；workers：线程数组；barrier：同步用
+*output:	无
+*return:	无
+******************************************/
+static void ramp_report(const struct options* opt, struct worker* workers, pthread_barrier_t* barrier)
+{
+    LAT_HIST* connect = (LAT_HIST*)malloc(sizeof(LAT_HIST));
+    LAT_HIST* setup = (LAT_HIST*)malloc(sizeof(LAT_HIST));
+    char con[512], set[512];
+    uint64_t last = now_ns();
+    int k, i;
+
+    printf("{\"mode\":\"ramp\",\"threads\":%d,\"connections\":%d,\"step\":%d,\"payload\":%d,\"steps\":[",
+        opt->threads, opt->connections, opt->step, opt->payload);
+    for(k = 1; ; k++)
+    {
+        int total = k * opt->step < opt->connections ? k * opt->step : opt->connections;
+        uint64_t errors = 0;
+
+        pthread_barrier_wait(barrier);  // 等各线程完成本批
+        uint64_t now = now_ns();
+        merge_hist(connect, workers, opt->threads, offsetof(struct worker, connect));
+        merge_hist(setup, workers, opt->threads, offsetof(struct worker, setup));
+        for(i = 0; i < opt->threads; i++)
+        {
+            errors += workers[i].errors;
+            lh_init(&workers[i].connect);
+            lh_init(&workers[i].setup);
+        }
+        long rss = read_rss_kb(opt->server_pid);
+        lh_format_json(connect, 1000.0, con, sizeof(con));
+        lh_format_json(setup, 1000.0, set, sizeof(set));
+        printf("%s{\"connections\":%d,\"errors\":%lu,\"elapsed_ms\":%.1f,\"server_rss_kb\":%ld,\"connect_us\":%s,\"setup_us\":%s}",
+            k > 1 ? "," : "", total, (unsigned long)errors, (now - last) / 1e6, rss, con, set);
+        fprintf(stderr, "# %d connections, step %.1f ms, setup p99 %.1f us, server rss %ld KB\n",
+            total, (now - last) / 1e6, lh_percentile(setup, 99) / 1000.0, rss);
+        last = now_ns();
+        pthread_barrier_wait(barrier);  // 开始下一批
+        if(total == opt->connections)
+            break;
+    }
+
+    pthread_barrier_wait(barrier);      // 各线程已关闭所有连接
+    sleep(1);                           // 等服务端处理完断连
+    printf("],\"server_rss_kb_after_close\":%ld}\n", read_rss_kb(opt->server_pid));
+    free(connect);
+    free(setup);
+}
+
+/******************************************
+*name：		usage
+*brief:		输出用法
+*input:		prog：程序名
+*output:	无
+*return:	无
+******************************************/
+static void usage(const char* prog)
+{
+    printf("Usage: %s [-m load|churn|ramp] [-t threads] [-c connections] [-r rate] [-s payload] [-d seconds] [-P ports]\n"
+        "          [-n msgs] [-R conn_rate] [-S step] [-p server_pid] <ip> <port>\n"
+        "  -m  模式，默认load\n"
+        "  -t  线程数，默认1\n"
+        "  -c  总连接数（churn模式下为同时存在的最大连接数），默认100\n"
+        "  -r  load：总请求速率（请求/秒），默认0即闭环\n"
+        "  -s  请求长度（字节，含换行），%d ~ %d，默认64\n"
+        "  -d  压测时长（秒），ramp模式下为建满连接后保持的时长，默认10\n"
+        "  -P  服务端端口数，连接均匀地分布在 port ~ port+P-1 上，默认%d\n"
+        "  -n  churn：每个连接收发的请求数，默认1\n"
+        "  -R  churn：总建连速率（连接/秒），默认0即有空闲槽位就建连\n"
+        "  -S  ramp：每批新增的连接数，默认1000\n"
+        "  -p  服务端进程号，指定时记录服务端内存（VmRSS）\n",
+        prog, MIN_PAYLOAD, MAX_PAYLOAD, MAX_PORT);
+}
+
+int main(int argc, char *argv[])
+{
+    struct options opt = { NULL, 0, MAX_PORT, 1, 100, 0, 64, 10, MODE_LOAD, 1, 0, 1000, 0 };
+    pthread_barrier_t barrier;
+    int ch, i, k;
+
+    while((ch = getopt(argc, argv, "m:t:c:r:s:d:P:n:R:S:p:")) != -1)
+    {
+        switch(ch)
+        {
+        case 'm':
+            if(strcmp(optarg, "churn") == 0)
+                opt.mode = MODE_CHURN;
+            else if(strcmp(optarg, "ramp") == 0)
+                opt.mode = MODE_RAMP;
+            break;
+        case 't': opt.threads = atoi(optarg); break;
+        case 'c': opt.connections = atoi(optarg); break;
+        case 'r': opt.rate = atof(optarg); break;
+        case 's': opt.payload = atoi(optarg); break;
+        case 'd': opt.duration = atoi(optarg); break;
+        case 'P': opt.nports = atoi(optarg); break;
+        case 'n': opt.msgs = atoi(optarg); break;
+        case 'R': opt.conn_rate = atof(optarg); break;
+        case 'S': opt.step = atoi(optarg); break;
+        case 'p': opt.server_pid = atoi(optarg); break;
+        default: usage(argv[0]); return 0;
+        }
+    }
+    if(argc - optind < 2)
+    {
+        usage(argv[0]);
+        return 0;
+    }
+    opt.ip = argv[optind];
+    opt.port = atoi(argv[optind + 1]);
+
+    if(opt.threads < 1 || opt.threads > MAX_THREAD)
+        opt.threads = 1;
+    if(opt.connections < opt.threads)
+        opt.connections = opt.threads;
+    if(opt.connections > MAX_CONNECTION)
+        opt.connections = MAX_CONNECTION;   // 受 ulimit -n 限制时可以调小
+    if(opt.payload < MIN_PAYLOAD)
+        opt.payload = MIN_PAYLOAD;
+    if(opt.payload > MAX_PAYLOAD)
+        opt.payload = MAX_PAYLOAD;
+    if(opt.nports < 1)
+        opt.nports = 1;
+    if(opt.msgs < 1)
+        opt.msgs = 1;
+    if(opt.step < 1)
+        opt.step = 1000;
+
+    struct worker* workers = (struct worker*)calloc(opt.threads, sizeof(struct worker));
+    if(workers == NULL)
+        return -1;
+    if(opt.mode == MODE_RAMP)
+        pthread_barrier_init(&barrier, NULL, opt.threads + 1);
+
+    uint64_t begin = now_ns();
+    for(i = 0; i < opt.threads; i++)
+    {
+        struct worker* w = &workers[i];
+        w->id = i;
+        w->opt = &opt;
+        w->barrier = &barrier;
+        w->epfd = epoll_create1(EPOLL_CLOEXEC);
+        w->nconns = opt.connections / opt.threads + (i < opt.connections % opt.threads);
+        w->conns = (struct conn*)calloc(w->nconns, sizeof(struct conn));
+        w->interval_ns = opt.rate > 0 ? 1e9 * opt.threads / opt.rate : 0;
+        w->conn_interval_ns = opt.conn_rate > 0 ? 1e9 * opt.threads / opt.conn_rate : 0;
+        lh_init(&w->latency);
+        lh_init(&w->service);
+        lh_init(&w->connect);
+        lh_init(&w->setup);
+        lh_init(&w->session);
+        for(k = 0; k < w->nconns; k++)
+        {
+            struct conn* c = &w->conns[k];
+            c->rbuf = (char*)malloc(2 * opt.payload);
+            c->wbuf = (char*)malloc(opt.payload);
+            c->port = opt.port + (i + k * opt.threads) % opt.nports;   // 均匀地使用各个端口
+            if(c->rbuf == NULL || c->wbuf == NULL)
+                return -1;
+        }
+        pthread_create(&w->tid, NULL, worker_loop, w);
+    }
+
+    if(opt.mode == MODE_RAMP)
+    {
+        ramp_report(&opt, workers, &barrier);
+        for(i = 0; i < opt.threads; i++)
+            pthread_join(workers[i].tid, NULL);
+        return 0;
+    }
+
+    //每秒输出一次进度，churn模式下同时记录服务端内存
+    static long rss[MAX_RSS_SAMPLES];
+    int nrss = 0;
+    uint64_t last = 0, last_sessions = 0;
+    for(k = 1; ; k++)
+    {
+        sleep(1);
+        uint64_t total = 0, sessions = 0;
+        int running = 0;
+        for(i = 0; i < opt.threads; i++)
+        {
+            total += __atomic_load_n(&workers[i].requests, __ATOMIC_RELAXED);
+            sessions += __atomic_load_n(&workers[i].sessions, __ATOMIC_RELAXED);
+            running += !__atomic_load_n(&workers[i].done, __ATOMIC_ACQUIRE);
+        }
+        long r = read_rss_kb(opt.server_pid);
+        if(opt.mode == MODE_CHURN)
+        {
+            fprintf(stderr, "# %ds: %lu conn/s, %lu req/s, server rss %ld KB\n", k,
+                (unsigned long)(sessions - last_sessions), (unsigned long)(total - last), r);
+            if(nrss < MAX_RSS_SAMPLES && running)
+                rss[nrss++] = r;
+        }
+        else
+            fprintf(stderr, "# %ds: %lu req/s\n", k, (unsigned long)(total - last));
+        last = total;
+        last_sessions = sessions;
+        if(running == 0)
+            break;
+    }
+
+    LAT_HIST* latency = (LAT_HIST*)malloc(sizeof(LAT_HIST));
+    LAT_HIST* service = (LAT_HIST*)malloc(sizeof(LAT_HIST));
+    LAT_HIST* connect = (LAT_HIST*)malloc(sizeof(LAT_HIST));
+    LAT_HIST* setup = (LAT_HIST*)malloc(sizeof(LAT_HIST));
+    LAT_HIST* session = (LAT_HIST*)malloc(sizeof(LAT_HIST));
+    uint64_t requests = 0, sessions = 0, errors = 0, mismatches = 0, connect_ns = 0;
+    for(i = 0; i < opt.threads; i++)
+    {
+        struct worker* w = &workers[i];
+        pthread_join(w->tid, NULL);
+        requests += w->requests;
+        sessions += w->sessions;
+        errors += w->errors;
+        mismatches += w->mismatches;
+        if(w->connect_done - begin > connect_ns)
+            connect_ns = w->connect_done - begin;
+    }
+    merge_hist(latency, workers, opt.threads, offsetof(struct worker, latency));
+    merge_hist(service, workers, opt.threads, offsetof(struct worker, service));
+    merge_hist(connect, workers, opt.threads, offsetof(struct worker, connect));
+    merge_hist(setup, workers, opt.threads, offsetof(struct worker, setup));
+    merge_hist(session, workers, opt.threads, offsetof(struct worker, session));
+
+    //结果输出为JSON，延迟单位为微秒
+    char lat[512], svc[512], con[512], set[512], ses[512];
+    lh_format_json(latency, 1000.0, lat, sizeof(lat));
+    lh_format_json(service, 1000.0, svc, sizeof(svc));
+    lh_format_json(connect, 1000.0, con, sizeof(con));
+    lh_format_json(setup, 1000.0, set, sizeof(set));
+    lh_format_json(session, 1000.0, ses, sizeof(ses));
+    if(opt.mode == MODE_CHURN)
+    {
+        printf("{\"mode\":\"churn\",\"threads\":%d,\"concurrency\":%d,\"conn_rate\":%.0f,\"msgs\":%d,\"payload\":%d,"
+            "\"duration_s\":%d,\"sessions\":%lu,\"session_rate\":%.0f,\"requests\":%lu,\"errors\":%lu,\"mismatches\":%lu,"
+            "\"connect_us\":%s,\"setup_us\":%s,\"session_us\":%s,\"latency_us\":%s,\"server_rss_kb\":[",
+            opt.threads, opt.connections, opt.conn_rate, opt.msgs, opt.payload, opt.duration,
+            (unsigned long)sessions, (double)sessions / opt.duration, (unsigned long)requests,
+            (unsigned long)errors, (unsigned long)mismatches, con, set, ses, lat);
+        for(i = 0; i < nrss; i++)
+            printf("%s%ld", i ? "," : "", rss[i]);
+        printf("]}\n");
+        return 0;
+    }
+
+    printf("{\"mode\":\"%s\",\"threads\":%d,\"connections\":%d,\"connected\":%lu,\"rate\":%.0f,\"payload\":%d,"
+        "\"duration_s\":%d,\"requests\":%lu,\"throughput_rps\":%.0f,\"errors\":%lu,\"mismatches\":%lu,"
+        "\"connect_rate\":%.0f,\"latency_us\":%s,\"service_us\":%s,\"connect_us\":%s}\n",
+        opt.rate > 0 ? "open" : "closed", opt.threads, opt.connections, (unsigned long)connect->count, opt.rate,
+        opt.payload, opt.duration, (unsigned long)requests, (double)requests / opt.duration,
+        (unsigned long)errors, (unsigned long)mismatches,
+        connect_ns ? connect->count * 1e9 / connect_ns : 0.0, lat, svc, con);
+    return 0;
+}
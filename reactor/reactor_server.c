@@ -3,297 +3,243 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
-#include <errno.h>
-#include <sys/epoll.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/tcp.h>
-#include <arpa/inet.h>
+#include <signal.h>
+#include <time.h>
 #include <fcntl.h>
-
+#include <sys/stat.h>
+#include "reactor.h"
+
+/*
+ * 回显服务：在 MAX_PORT 个端口上监听，每行请求原样返回，以"heavy"开头的请求先做一段CPU密集计算。
+ * 同时在 UDP 的 <port> 上回显报文（recvmmsg/sendmmsg 成批收发）。
+ * "file <name>"请求返回"OK <长度>\n"加 FILE_ROOT 下该文件的内容（由reactor用sendfile零拷贝发送），失败返回"ERR ..."。
+ * 可以启动多个事件循环（每个一个线程），各循环用 SO_REUSEPORT 监听同样的端口，由内核分摊连接，
+ * 每个循环有独立的统计和管理端口。
+ * 编译时定义 REACTOR_USE_THREADPOOL 则请求交给工作线程池处理，所有循环共用一个线程池。
+ */
 
 #define MAX_PORT		10
-#define MAX_BUFFER_SIZE 1024
-#define MAX_EVENTS_NUM (1024*1024)  // 100W个事件同时监听
-
-static int client_cnt = 0;  // 统计连接数
-
-struct sockitem
-{
-	int sockfd;
-	int (*callback)(void *arg);	//回调函数
-    int epfd;	// sockitem 中增加一个epfd成员以便回调函数中使用
-
-    char recvbuffer[MAX_BUFFER_SIZE]; // 接收缓冲
-	char sendbuffer[MAX_BUFFER_SIZE]; // 发送缓冲
-    int recvlength; // 接收缓冲区中的数据长度
-    int sendlength; // 发送缓冲区中的数据长度
-};
-
-struct reactor
-{
-    int epfd;
-    struct epoll_event events[MAX_EVENTS_NUM];
-};
-struct reactor ra;  // 放到全局变量，避免大内存进入栈中
-
-int recv_cb(void *arg);
+#define MAX_LOOP        64          // 最多事件循环数
+#define HEAVY_WORK_MS   20          // "heavy"请求模拟的CPU耗时
+#define FILE_ROOT       "./files"   // "file"请求的文件目录
+#define FILE_COPY       0           // 1：文件用pread+send发送，与sendfile对比
+#define UDP_RECV_BATCH  64          // UDP一次recvmmsg的报文数，1为每次事件一个recvfrom（对比基准）
+#define UDP_USE_GRO     0           // 1：UDP socket开启GRO
+
+#define LISTEN_SHARDS           1       // 每个循环在每个端口上创建几个listen fd，>1时用SO_REUSEPORT由内核把连接分摊到各个accept队列
+#define TCP_DEFER_ACCEPT_SEC    0       // >0时开启TCP_DEFER_ACCEPT，客户端发来数据后才唤醒accept
+#define TCP_FASTOPEN_QLEN       0       // >0时开启TCP_FASTOPEN，值为未完成TFO请求的队列长度
+#define ADMIN_SOCK_PATH         "/tmp/reactor_%d.sock"      // 管理端口（unix socket）路径，%d为第一个listen端口
+#define ADMIN_SOCK_PATH_N       "/tmp/reactor_%d_%d.sock"   // 多个循环时各循环的管理端口，第二个%d为循环编号
+
+#ifdef REACTOR_USE_THREADPOOL
+#define MAX_WORKER_NUM      8       // 工作线程池最大线程数
+#endif
+
+static REACTOR* loops[MAX_LOOP];
+static int nloops;
 
 /******************************************
-*name：		fdSetNonBlock
-*brief:		设置fd为非阻塞
-*input:		fd：需要设置的fd
+*name：		busy_work
+*brief:		空转消耗指定的CPU时间，模拟CPU密集型业务
+*input:		ms：消耗的CPU毫秒数
 *output:	无
-*return:	0：成功；-1：失败；
+*return:	无
 ******************************************/
-static int fdSetNonBlock(int fd)
+static void busy_work(int ms)
 {
-    int flags;
+    struct timespec begin, now;
+    volatile unsigned long x = 0;
 
-    flags = fcntl(fd, F_GETFL);
-    if(flags < 0) return flags;
-
-    flags |= O_NONBLOCK;
-    if(fcntl(fd, F_SETFL, flags) < 0) return -1;
-
-    return 0;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+    do
+    {
+        int k;
+        for(k = 0; k < 1000; k++)
+            x += k * k;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    } while((now.tv_sec - begin.tv_sec) * 1000 + (now.tv_nsec - begin.tv_nsec) / 1000000 < ms);
 }
 
 /******************************************
-*name：		sockSetReuseAddr
-*brief:		设置socket SO_REUSEADDR
-*input:		sockfd：需要设置的fd
-*output:	无
-*return:	0：成功
+*name：		handle_file
+*brief:		"file <name>"请求：打开 FILE_ROOT 下的文件，头部写入响应，文件区间交给reactor发送
+*input:		name：文件名；namelen：长度；resp：响应缓冲；respmax：响应缓冲大小
+*output:	resp：响应头；file：文件区间
+*return:	响应长度
 ******************************************/
-static int sockSetReuseAddr(int sockfd)
+static int handle_file(const char* name, int namelen, char* resp, int respmax, REACTOR_FILE* file)
 {
-    int reuse = 1;
-    return setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    char path[256];
+    struct stat st;
+
+    while(namelen > 0 && (name[namelen - 1] == '\n' || name[namelen - 1] == '\r'))
+        namelen--;
+    //只允许FILE_ROOT下的文件名，不允许路径
+    if(namelen <= 0 || memchr(name, '/', namelen) || (namelen == 2 && memcmp(name, "..", 2) == 0)
+       || snprintf(path, sizeof(path), "%s/%.*s", FILE_ROOT, namelen, name) >= (int)sizeof(path))
+        return snprintf(resp, respmax, "ERR bad name\n");
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return snprintf(resp, respmax, "ERR not found\n");
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return snprintf(resp, respmax, "ERR not found\n");
+    }
+
+    file->fd = fd;
+    file->offset = 0;
+    file->length = st.st_size;
+    return snprintf(resp, respmax, "OK %ld\n", (long)st.st_size);
 }
 
 /******************************************
-*name：		send_cb
-*brief:		发送给客户端数据。配置客户端fd的sockitem回调为recv_cb、epoll监听EPOLLIN
-*input:		arg：sockitem；
-*output:	无
-*return:	返回写入长度
+*name：		handle_request
+*brief:		业务处理：一帧请求生成一帧响应。当前为回显，以"heavy"开头的请求先做一段CPU密集计算，
+            "file"请求回复文件
+*input:		req：请求帧；reqlen：请求长度；resp：响应缓冲；respmax：响应缓冲大小
+*output:	resp：响应内容；file：需要回复的文件
+*return:	响应长度
 ******************************************/
-int send_cb(void *arg)
+static int handle_request(const char* req, int reqlen, char* resp, int respmax, REACTOR_FILE* file)
 {
-    struct sockitem *si = arg;
-    struct epoll_event ev;
-
-    int clientfd = si->sockfd;
-    
-    //写回的数据此处先简单处理 
-    int ret = send(clientfd, si->sendbuffer, si->sendlength, 0);
-
-	//配置sockitem
-    si->callback = recv_cb;	//发送完数据切回接收
+    if(reqlen >= 5 && memcmp(req, "file ", 5) == 0)
+        return handle_file(req + 5, reqlen - 5, resp, respmax, file);
 
-	//配置epoll监听
-    ev.events = EPOLLIN;
-    ev.data.ptr = si;
-    epoll_ctl(si->epfd, EPOLL_CTL_MOD, si->sockfd, &ev);
+    if(reqlen >= 5 && memcmp(req, "heavy", 5) == 0)
+        busy_work(HEAVY_WORK_MS);
 
-    return ret;
+    int len = reqlen < respmax ? reqlen : respmax;
+    memcpy(resp, req, len);
+    return len;
 }
 
 /******************************************
-*name：		recv_cb
-*brief:		接收客户端的数据。配置客户端fd的sockitem回调为send_cb、epoll监听EPOLLOUT
-*input:		arg：sockitem；
-*output:	无
-*return:	返回接收长度
+*name：		handle_udp
+*brief:		UDP业务处理：报文原样回复
+*input:		req：报文；reqlen：长度；peer：来源地址；resp：回复缓冲；respmax：回复缓冲大小
+*output:	resp：回复内容
+*return:	回复长度
 ******************************************/
-int recv_cb(void *arg)
+static int handle_udp(const char* req, int reqlen, const struct sockaddr_in* peer, char* resp, int respmax)
 {
-    struct sockitem *si = arg;
-    struct epoll_event ev;
-
-    int clientfd = si->sockfd;
-    int ret = recv(clientfd, si->recvbuffer, MAX_BUFFER_SIZE, 0);
-
-	//1、recv失败
-	if(ret <= 0)
-    {
-        if(ret < 0)
-        {
-            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)	//被打断直接返回的情况
-            {
-                return ret;
-            }
-			printf("# client err... [%d]\n", --client_cnt);
-        }
-        else
-        {
-            printf("# client disconn... [%d]\n", --client_cnt);
-        }
-        
-        //将当前客户端socket从epoll中删除
-        ev.events = EPOLLIN;
-        ev.data.ptr = si;
-        epoll_ctl(si->epfd, EPOLL_CTL_DEL, clientfd, &ev);  
-		close(clientfd);
-        free(si);
-    }
-    else	//2、recv成功
-    {
-        //配置sockitem
-        si->recvlength = ret;
-        memcpy(si->sendbuffer, si->recvbuffer, si->recvlength);	//将接收到的数据拷贝的发送缓冲区，或其他操作
-        si->sendlength = si->recvlength;
-        si->callback = send_cb;	//接收完的下一步是发送数据
-
-		//配置epoll监听
-		struct epoll_event ev;
-        ev.events = EPOLLOUT | EPOLLET;	//写的时候最好还是用ET
-        ev.data.ptr = si;
-        epoll_ctl(si->epfd, EPOLL_CTL_MOD, si->sockfd, &ev);
-    }
-
-    return ret;
+    int len = reqlen < respmax ? reqlen : respmax;
+    memcpy(resp, req, len);
+    return len;
 }
 
 /******************************************
-*name：		accept_cb
-*brief:		接收客户端的连接。配置客户端fd的sockitem回调为recv_cb、epoll监听EPOLLIN（accept也属于读IO操作的回调）
-*input:		arg：sockitem；
+*name：		on_signal
+*brief:		SIGINT/SIGTERM：停止所有事件循环，正常退出以便清理管理端口文件
+*input:		sig：信号
 *output:	无
-*return:	返回接收的客户端 fd；失败返回       <0
+*return:	无
 ******************************************/
-int accept_cb(void *arg)
+static void on_signal(int sig)
 {
-    struct sockitem *si = arg;
-    struct epoll_event ev;
-
-    struct sockaddr_in client;
-    memset(&client, 0, sizeof(struct sockaddr_in));
-    socklen_t caddr_len = sizeof(struct sockaddr_in);
-
-    int clientfd = accept(si->sockfd, (struct sockaddr*)&client, &caddr_len);
-    if(clientfd < 0)
-    {
-        printf("# accept error\n");
-        return clientfd;
-    }
-
-	fdSetNonBlock(clientfd);
-    sockSetReuseAddr(clientfd);
-
-    char str[INET_ADDRSTRLEN] = {0};
-    printf("Accept from %s:%d [%d]\n", inet_ntop(AF_INET, &client.sin_addr, str, sizeof(str)),
-        ntohs(client.sin_port), ++client_cnt);
-
-	//配置sockitem
-    struct sockitem *client_si = (struct sockitem*)malloc(sizeof(struct sockitem));
-    client_si->sockfd = clientfd;
-    client_si->callback = recv_cb;  // accept完的下一步就是接收客户端数据
-    client_si->epfd = si->epfd;
-
-	//配置epoll监听
-    memset(&ev, 0, sizeof(struct epoll_event));
-    ev.events = EPOLLIN;
-    ev.data.ptr = client_si;
-    epoll_ctl(si->epfd, EPOLL_CTL_ADD, clientfd, &ev);
-
-    return clientfd;
+    int i;
+    for(i = 0; i < nloops; i++)
+        reactor_stop(loops[i]);
 }
 
 /******************************************
-*name：		init_port_and_listen
-*brief:		初始化listen fd。配置listen fd的sockitem回调为accept_cb、epoll监听EPOLLIN
-*input:		port：绑定的端口；epfd：需要加入的epoll fd；
+*name：		loop_thread
+*brief:		事件循环线程
+*input:		arg：REACTOR
 *output:	无
-*return:	返回建立的listen fd；失败返回       <0
+*return:	NULL
 ******************************************/
-int init_port_and_listen(int port, int epfd)
+static void* loop_thread(void* arg)
 {
-	//创建对应port的listen fd
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0)
-		return -1;
-
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(struct sockaddr_in));
-
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(port);
-
-    if(bind(sockfd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0)
-        return -2;
-
-    if(listen(sockfd, 5) < 0)
-        return -3;
-
-    //配置sockitem
-    struct sockitem *si = (struct sockitem*)malloc(sizeof(struct sockitem));    // 自定义数据，用于传递给回调函数
-    si->sockfd = sockfd;
-    si->callback = accept_cb;	//回调
-    si->epfd = epfd; 
-
-	//配置epoll监听
-    struct epoll_event ev;
-    memset(&ev, 0, sizeof(struct epoll_event));
-    ev.events = EPOLLIN;
-    ev.data.ptr = si;
-    epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev);
-
-    return sockfd;
+    reactor_run((REACTOR*)arg);
+    return NULL;
 }
 
 int main(int argc, char* argv[])
 {
     if(argc < 2)
     {
-        printf("Usage: %s <port>\n", argv[0]);
+        printf("Usage: %s <port> [loops]\n", argv[0]);
         return 0;
     }
 
     int port = atoi(argv[1]);	//server端口
-    int listenfds[MAX_PORT] = {0};	//所有端口的fd
-	struct sockitem *si;
-
-    ra.epfd = epoll_create(1);	//创建epoll fd
-
-	//1、创建10个端口listen，并且加入epoll监听
-	int i;
-    for(i = 0; i < MAX_PORT; i++)
+    int n = argc > 2 ? atoi(argv[2]) : 1;   //事件循环数
+    if(n < 1 || n > MAX_LOOP)
+        n = 1;
+
+    REACTOR_CONFIG cfg;
+    reactor_config_init(&cfg);
+    cfg.reuseport = (n > 1 || LISTEN_SHARDS > 1);
+    cfg.defer_accept_sec = TCP_DEFER_ACCEPT_SEC;
+    cfg.fastopen_qlen = TCP_FASTOPEN_QLEN;
+    cfg.file_copy = FILE_COPY;
+    cfg.udp_batch = UDP_RECV_BATCH;
+    cfg.udp_gro = UDP_USE_GRO;
+#ifdef REACTOR_USE_THREADPOOL
+    cfg.workers = tp_create_pool(MAX_WORKER_NUM);
+    if(cfg.workers == NULL)
     {
-        listenfds[i] = init_port_and_listen(port + i, ra.epfd);
+        printf("create thread pool error.\n");
+        return -1;
     }
+#endif
 
-    while(1)
+    int i, k;
+    for(i = 0; i < n; i++)
     {
-    	//2、wait事件
-        int nready = epoll_wait(ra.epfd, ra.events, MAX_EVENTS_NUM, -1);
-        if(nready < 0)
+        char path[108];
+
+        cfg.id = i;
+        loops[i] = reactor_create(&cfg);
+        if(loops[i] == NULL)
         {
-            printf("epoll_wait error.\n");
-            break;
+            printf("reactor_create error.\n");
+            return -1;
         }
+        nloops++;
 
-		//3、响应事件
-        int i;
-        for(i = 0; i < nready; i++)
+        //1、每个循环都在10个端口上listen（每个端口LISTEN_SHARDS个）
+        for(k = 0; k < MAX_PORT * LISTEN_SHARDS; k++)
         {
-            si = ra.events[i].data.ptr;	//事件对应的sockitem
-            if(ra.events[i].events & (EPOLLIN | EPOLLOUT))
-            {
-                if(si->callback != NULL)
-                    si->callback(si);  // 调用回调函数
-            }
+            int fd = reactor_add_listener(loops[i], port + k % MAX_PORT, handle_request);
+            if(fd < 0)
+                printf("listen on port %d error[%d].\n", port + k % MAX_PORT, fd);
         }
+        int ufd = reactor_add_udp(loops[i], port, handle_udp);
+        if(ufd < 0)
+            printf("udp on port %d error[%d].\n", port, ufd);
+
+        if(n == 1)
+            snprintf(path, sizeof(path), ADMIN_SOCK_PATH, port);
+        else
+            snprintf(path, sizeof(path), ADMIN_SOCK_PATH_N, port, i);
+        int fd = reactor_enable_admin(loops[i], path);
+        if(fd < 0)
+            printf("admin socket %s error[%d].\n", path, fd);
     }
 
-	//close所有fd
-    for(i = 0; i < MAX_PORT; i++)
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    //2、第一个循环在主线程中运行，其余各起一个线程
+    pthread_t tids[MAX_LOOP];
+    for(i = 1; i < n; i++)
+        pthread_create(&tids[i], NULL, loop_thread, loops[i]);
+    reactor_run(loops[0]);
+
+    //3、停止后销毁所有循环
+    for(i = 1; i < n; i++)
     {
-        if(listenfds[i] > 0)
-        {
-            close(listenfds[i]);
-        }
+        reactor_stop(loops[i]);
+        pthread_join(tids[i], NULL);
     }
+    for(i = 0; i < n; i++)
+        reactor_destroy(loops[i]);
+#ifdef REACTOR_USE_THREADPOOL
+    tp_destroy_pool(cfg.workers);
+#endif
+    return 0;
 }
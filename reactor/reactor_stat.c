@@ -0,0 +1,101 @@
+#include "reactor_stat.h"
+#include <stdio.h>
+
+/******************************************
+*name：		hist_percentile
+*brief:		估算直方图的分位数，返回所在桶的上界
+*input:		hist：直方图；total：总数；pct：分位（如99.9）
+*output:	无
+*return:	分位数所在桶的上界，没有数据返回0
+******************************************/
+static unsigned long hist_percentile(unsigned long* hist, unsigned long total, double pct)
+{
+    if(total == 0)
+        return 0;
+
+    unsigned long target = (unsigned long)(total * pct / 100.0);
+    unsigned long sum = 0;
+    int i;
+    for(i = 0; i < STAT_HIST_BUCKETS; i++)
+    {
+        sum += STAT_GET(hist[i]);
+        if(sum > target)
+            break;
+    }
+    if(i == STAT_HIST_BUCKETS)
+        i--;
+    return 2UL << i;
+}
+
+/******************************************
+*name：		format_hist
+*brief:		输出直方图的总数、分位数和非空桶
+*input:		name：名字；hist：直方图；buf/len：输出缓冲
+*output:	buf：文本
+*return:	写入的长度
+******************************************/
+static int format_hist(const char* name, unsigned long* hist, char* buf, int len)
+{
+    unsigned long total = 0;
+    int i, n;
+    for(i = 0; i < STAT_HIST_BUCKETS; i++)
+        total += STAT_GET(hist[i]);
+
+    n = snprintf(buf, len, "%s count:%lu p50<%lu p99<%lu p999<%lu\n", name, total,
+        hist_percentile(hist, total, 50), hist_percentile(hist, total, 99), hist_percentile(hist, total, 99.9));
+
+    for(i = 0; i < STAT_HIST_BUCKETS && n < len; i++)
+    {
+        unsigned long cnt = STAT_GET(hist[i]);
+        if(cnt)
+            n += snprintf(buf + n, len - n, "  [%lu,%lu) %lu\n", 1UL << i, 2UL << i, cnt);
+    }
+    return n < len ? n : len;
+}
+
+/******************************************
+*name：		reactor_stat_format
+*brief:		把统计输出为文本，每行一项，供管理端口或周期输出使用
+*input:		st：统计；buf：输出缓冲；len：缓冲大小
+*output:	buf：文本
+*return:	写入的长度（不含结尾的'\0'）
+******************************************/
+int reactor_stat_format(struct reactor_stat* st, char* buf, int len)
+{
+    unsigned long wakeups = STAT_GET(st->wakeups);
+    unsigned long events = STAT_GET(st->events);
+    unsigned long active = 0;
+    int i, n;
+
+    for(i = 0; i < st->nports; i++)
+        active += STAT_GET(st->active[i]);
+
+    n = snprintf(buf, len,
+        "accepts %lu\naccept_errors %lu\naccept_dropped %lu\naccept_max_batch %lu\n"
+        "closes %lu\ntimeouts %lu\nactive %lu\nbytes_in %lu\nbytes_out %lu\nfile_bytes %lu\n"
+        "throttles %lu\nthrottled %lu\nglobal_throttles %lu\nbacklog %lu\n"
+        "wakeups %lu\nevents %lu\nevents_per_wakeup %.1f\n",
+        STAT_GET(st->accepts), STAT_GET(st->accept_errors), STAT_GET(st->accept_dropped),
+        STAT_GET(st->accept_max_batch), STAT_GET(st->closes), STAT_GET(st->timeouts), active,
+        STAT_GET(st->bytes_in), STAT_GET(st->bytes_out), STAT_GET(st->file_bytes),
+        STAT_GET(st->throttles), STAT_GET(st->throttled), STAT_GET(st->global_throttles), STAT_GET(st->backlog), wakeups, events,
+        wakeups ? (double)events / wakeups : 0.0);
+
+    unsigned long udp_calls = STAT_GET(st->udp_recv_calls);
+    if(udp_calls && n < len)
+        n += snprintf(buf + n, len - n, "udp_in %lu\nudp_out %lu\nudp_send_dropped %lu\nudp_recv_calls %lu\nudp_per_call %.1f\n",
+            STAT_GET(st->udp_in), STAT_GET(st->udp_out), STAT_GET(st->udp_send_dropped), udp_calls,
+            (double)STAT_GET(st->udp_in) / udp_calls);
+
+    for(i = 0; i < st->nports && n < len; i++)
+        n += snprintf(buf + n, len - n, "active_port %d %lu\n", st->ports[i], STAT_GET(st->active[i]));
+
+    if(n < len)
+        n += format_hist("events_per_wakeup_hist", st->events_hist, buf + n, len - n);
+    if(n < len)
+        n += format_hist("epoll_wait_ns", st->epoll_wait_hist, buf + n, len - n);
+    if(n < len)
+        n += format_hist("callback_ns", st->callback_hist, buf + n, len - n);
+
+    return n < len ? n : len - 1;
+}
@@ -0,0 +1,64 @@
+#ifndef __REACTOR_STAT_H__
+#define __REACTOR_STAT_H__
+
+/*
+ * reactor运行统计。
+ * 计数只由事件循环线程写（单写者），用relaxed原子读写代替加锁或带lock前缀的原子加，
+ * 写入开销和普通加法相同，其他线程可以随时无锁读取（各计数之间不保证是同一时刻的快照）。
+ */
+#include <stdint.h>
+
+#define STAT_HIST_BUCKETS   32      // 直方图桶数，第i个桶统计[2^i, 2^(i+1))范围的值
+#define STAT_MAX_PORT       64      // 最多统计多少个listen端口的活跃连接数
+
+#define STAT_ADD(field, n)  __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED)
+#define STAT_SUB(field, n)  __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) - (n), __ATOMIC_RELAXED)
+#define STAT_GET(field)     __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+struct reactor_stat
+{
+    unsigned long accepts;              // 累计accept的连接数
+    unsigned long accept_errors;        // 累计accept失败次数（不含EAGAIN）
+    unsigned long accept_dropped;       // 累计因fd耗尽而直接关闭的连接数
+    unsigned long accept_max_batch;     // 一次可读事件accept的最大连接数
+    unsigned long closes;               // 累计关闭的连接数（含超时）
+    unsigned long timeouts;             // 累计超时关闭的连接数
+    unsigned long bytes_in;             // 累计接收字节数
+    unsigned long bytes_out;            // 累计发送字节数
+    unsigned long file_bytes;           // 其中文件响应的字节数
+    unsigned long udp_in;               // 累计收到的UDP报文数（GRO合并的按拆开后计）
+    unsigned long udp_out;              // 累计发出的UDP回复数
+    unsigned long udp_send_dropped;     // 发送缓冲满等原因丢弃的UDP回复数
+    unsigned long udp_recv_calls;       // 收UDP报文的系统调用次数
+    unsigned long throttles;            // 累计因积压停止读的次数
+    unsigned long throttled;            // 当前停止读的连接数
+    unsigned long global_throttles;     // 累计全局积压超过高水位的次数
+    unsigned long backlog;              // 当前所有连接积压的输出字节数
+    unsigned long wakeups;              // epoll_wait返回且有事件的次数
+    unsigned long events;               // 累计处理的事件数
+    unsigned long events_hist[STAT_HIST_BUCKETS];       // 每次唤醒的事件数分布
+    unsigned long epoll_wait_hist[STAT_HIST_BUCKETS];   // epoll_wait耗时分布（纳秒）
+    unsigned long callback_hist[STAT_HIST_BUCKETS];     // 回调耗时分布（纳秒）
+    int ports[STAT_MAX_PORT];           // 各listen端口号
+    int nports;                         // listen端口数
+    unsigned long active[STAT_MAX_PORT];    // 每个端口当前的活跃连接数
+};
+
+/******************************************
+*name：		stat_hist_add
+*brief:		值计入直方图，按最高位所在的位置分桶
+*input:		hist：直方图；v：值
+*output:	无
+*return:	无
+******************************************/
+static inline void stat_hist_add(unsigned long* hist, uint64_t v)
+{
+    int idx = 63 - __builtin_clzll(v | 1);
+    if(idx >= STAT_HIST_BUCKETS)
+        idx = STAT_HIST_BUCKETS - 1;
+    STAT_ADD(hist[idx], 1);
+}
+
+int reactor_stat_format(struct reactor_stat* st, char* buf, int len);
+
+#endif
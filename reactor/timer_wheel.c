@@ -0,0 +1,173 @@
+#include "timer_wheel.h"
+
+#define TW_MASK (TW_SLOTS - 1)
+
+/******************************************
+*name：		list_insert
+*brief:		把定时器插入到某个链表（哨兵）的尾部
+*input:		head：链表哨兵；t：定时器
+*output:	无
+*return:	无
+******************************************/
+static inline void list_insert(TW_TIMER* head, TW_TIMER* t)
+{
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+/******************************************
+*name：		list_remove
+*brief:		把定时器从所在链表中摘除
+*input:		t：定时器
+*output:	无
+*return:	无
+******************************************/
+static inline void list_remove(TW_TIMER* t)
+{
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = NULL;
+}
+
+/******************************************
+*name：		tw_init
+*brief:		初始化时间轮
+*input:		tw：时间轮；now_ms：当前时间
+*output:	无
+*return:	无
+******************************************/
+void tw_init(TW_WHEEL* tw, uint64_t now_ms)
+{
+    int i;
+    tw->base_ms = now_ms;
+    tw->current = 0;
+    tw->count = 0;
+    for(i = 0; i < TW_SLOTS; i++)
+        tw->slots[i].prev = tw->slots[i].next = &tw->slots[i];
+}
+
+/******************************************
+*name：		tw_timer_init
+*brief:		初始化定时器
+*input:		t：定时器；cb：到期回调；arg：回调参数
+*output:	无
+*return:	无
+******************************************/
+void tw_timer_init(TW_TIMER* t, TW_CALLBACK cb, void* arg)
+{
+    t->prev = t->next = NULL;
+    t->expire = 0;
+    t->callback = cb;
+    t->arg = arg;
+}
+
+/******************************************
+*name：		tw_add
+*brief:		添加定时器，已在时间轮中的先删除再按新的到期时间加入
+*input:		tw：时间轮；t：定时器；expire_ms：到期的绝对时间
+*output:	无
+*return:	无
+******************************************/
+void tw_add(TW_WHEEL* tw, TW_TIMER* t, uint64_t expire_ms)
+{
+    if(tw_pending(t))
+        tw_del(tw, t);
+
+    //向上取整到 tick，已经过期的放到下一个要处理的 tick
+    uint64_t expire = expire_ms > tw->base_ms ? (expire_ms - tw->base_ms + TW_TICK_MS - 1) / TW_TICK_MS : 0;
+    if(expire < tw->current)
+        expire = tw->current;
+
+    t->expire = expire;
+    list_insert(&tw->slots[expire & TW_MASK], t);
+    tw->count++;
+}
+
+/******************************************
+*name：		tw_del
+*brief:		删除定时器，不在时间轮中则什么也不做
+*input:		tw：时间轮；t：定时器
+*output:	无
+*return:	无
+******************************************/
+void tw_del(TW_WHEEL* tw, TW_TIMER* t)
+{
+    if(!tw_pending(t))
+        return;
+    list_remove(t);
+    tw->count--;
+}
+
+/******************************************
+*name：		tw_advance
+*brief:		推进时间轮到当前时间，触发所有到期的定时器
+*input:		tw：时间轮；now_ms：当前时间
+*output:	无
+*return:	触发的定时器个数
+******************************************/
+int tw_advance(TW_WHEEL* tw, uint64_t now_ms)
+{
+    if(now_ms < tw->base_ms)
+        return 0;
+
+    uint64_t target = (now_ms - tw->base_ms) / TW_TICK_MS;
+    if(target < tw->current)
+        return 0;
+
+    //1、把到期的定时器先摘到临时链表，避免回调中增删定时器影响遍历
+    TW_TIMER expired;
+    expired.prev = expired.next = &expired;
+
+    uint64_t ticks = target - tw->current + 1;
+    if(ticks > TW_SLOTS)
+        ticks = TW_SLOTS;   // 落后超过一圈时每个槽看一遍就够了
+
+    uint64_t tick;
+    for(tick = tw->current; tick < tw->current + ticks; tick++)
+    {
+        TW_TIMER* head = &tw->slots[tick & TW_MASK];
+        TW_TIMER* t = head->next;
+        while(t != head)
+        {
+            TW_TIMER* next = t->next;
+            if(t->expire <= target)
+            {
+                list_remove(t);
+                list_insert(&expired, t);
+            }
+            t = next;
+        }
+    }
+    tw->current = target + 1;
+
+    //2、逐个触发。仍挂在 expired 上的定时器可以被其他回调 tw_del，因此 count 在这里才减
+    int fired = 0;
+    while(expired.next != &expired)
+    {
+        TW_TIMER* t = expired.next;
+        list_remove(t);
+        tw->count--;
+        fired++;
+        t->callback(t->arg);
+    }
+
+    return fired;
+}
+
+/******************************************
+*name：		tw_next_timeout
+*brief:		计算 epoll_wait 的超时时间：有定时器时等到下一个 tick，没有则一直等
+*input:		tw：时间轮；now_ms：当前时间
+*output:	无
+*return:	毫秒数，-1 表示没有定时器
+******************************************/
+int tw_next_timeout(TW_WHEEL* tw, uint64_t now_ms)
+{
+    if(tw->count == 0)
+        return -1;
+
+    uint64_t next_ms = tw->base_ms + tw->current * TW_TICK_MS;
+    return next_ms > now_ms ? (int)(next_ms - now_ms) : 0;
+}
@@ -0,0 +1,45 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+/*
+ * 哈希时间轮：按 tick 把定时器散列到 TW_SLOTS 个槽中，增删都是 O(1)。
+ * 超时时间超过一圈的定时器留在槽里，每转一圈比较一次到期 tick，到了才触发。
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define TW_SLOTS    512     // 槽数，必须是2的幂
+#define TW_TICK_MS  100     // 一个 tick 的毫秒数，也是定时精度
+
+typedef void (*TW_CALLBACK)(void* arg);
+
+struct _TW_TIMER {
+    struct _TW_TIMER* prev;
+    struct _TW_TIMER* next;     // 为 NULL 表示当前不在时间轮中
+    uint64_t expire;            // 到期 tick
+    TW_CALLBACK callback;       // 到期回调
+    void* arg;                  // 回调参数
+};
+typedef struct _TW_TIMER TW_TIMER;
+
+struct _TW_WHEEL {
+    uint64_t base_ms;           // 时间轮创建时的时间，tick 从这里开始计
+    uint64_t current;           // 下一个需要处理的 tick
+    int count;                  // 时间轮中的定时器个数
+    TW_TIMER slots[TW_SLOTS];   // 每个槽是一个带哨兵的双向循环链表
+};
+typedef struct _TW_WHEEL TW_WHEEL;
+
+void tw_init(TW_WHEEL* tw, uint64_t now_ms);
+void tw_timer_init(TW_TIMER* t, TW_CALLBACK cb, void* arg);
+void tw_add(TW_WHEEL* tw, TW_TIMER* t, uint64_t expire_ms);
+void tw_del(TW_WHEEL* tw, TW_TIMER* t);
+int tw_advance(TW_WHEEL* tw, uint64_t now_ms);
+int tw_next_timeout(TW_WHEEL* tw, uint64_t now_ms);
+
+static inline int tw_pending(TW_TIMER* t)
+{
+    return t->next != NULL;
+}
+
+#endif
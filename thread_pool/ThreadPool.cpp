@@ -2,9 +2,15 @@
 #include "ThreadPool.h"
 
 using namespace std;
+#ifndef _NO_PRINT
 #define log_error printf
 #define log_warn printf
 #define log_info printf
+#else
+#define log_error(...)
+#define log_warn(...)
+#define log_info(...)
+#endif
 
 Task::Task(TaskCallback cb, void *args, string& name)
 {
@@ -146,6 +152,35 @@ int ThreadPool::acceptATask(TaskCallback cb, void* args, string& taskName)
     return 0;
 }
 
+/******************************************
+*name：		acceptTasks
+*brief:		批量接收任务至pool中的任务链表，整批只加一次锁，适合事件循环一次唤醒后集中派发
+*input:		cb：			任务回调（整批共用）
+			args：		每个任务的参数数组
+			num：		任务个数
+			taskName：	任务名
+*output:	无
+*return:	成功返回放入的任务数
+******************************************/
+int ThreadPool::acceptTasks(TaskCallback cb, void** args, int num, string& taskName)
+{
+    if(num <= 0)
+        return 0;
+
+    list<Task*> tasks;  // 先在锁外创建好任务，缩短持锁时间
+    for(int i = 0; i < num; i++)
+        tasks.emplace_back(new Task(cb, args[i], taskName));
+
+    lock_guard<mutex> lock(m_mutex);
+    m_task_list.splice(m_task_list.end(), tasks);
+    if(num == 1)
+        m_cond.notify_one();
+    else
+        m_cond.notify_all();    // 多个任务，唤醒所有空闲线程来争取
+    log_info("ACCEPT %d task[%s] . now[%lu]\n", num, taskName.c_str(), m_task_list.size());
+    return num;
+}
+
 /******************************************
 *name：		waitForAllRuningTaskDone
 *brief:		等待所有任务执行完
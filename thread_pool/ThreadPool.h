@@ -67,6 +67,7 @@ public:
 
     virtual bool init();
     virtual int acceptATask(TaskCallback cb, void* args, std::string& taskName);
+    virtual int acceptTasks(TaskCallback cb, void** args, int num, std::string& taskName); // 批量提交，一次加锁放入多个任务
     virtual bool waitForAllRuningTaskDone();    // 提供给用户用于阻塞等待当前任务队列中的所有任务都被取走
 };
 
@@ -0,0 +1,60 @@
+#include "ThreadPool.h"
+#include "ThreadPoolC.h"
+
+using namespace std;
+
+static string c_task_name = "c_task";   // C 接口提交的任务统一使用这个任务名
+
+/******************************************
+*name：		tp_create_pool
+*brief:		创建并初始化线程池
+*input:		max_thread_num：最大允许线程数
+*output:	无
+*return:	线程池对象，失败返回NULL
+******************************************/
+TP_POOL* tp_create_pool(int max_thread_num)
+{
+    ThreadPool* pool = new ThreadPool(max_thread_num);
+    if(!pool->init())
+    {
+        delete pool;
+        return NULL;
+    }
+    return (TP_POOL*)pool;
+}
+
+/******************************************
+*name：		tp_destroy_pool
+*brief:		销毁线程池，等待所有线程退出
+*input:		tp：线程池对象
+*output:	无
+*return:	无
+******************************************/
+void tp_destroy_pool(TP_POOL* tp)
+{
+    delete (ThreadPool*)tp;
+}
+
+/******************************************
+*name：		tp_submit
+*brief:		提交一个任务
+*input:		tp：线程池对象；cb：任务回调；args：任务参数
+*output:	无
+*return:	成功返回0
+******************************************/
+int tp_submit(TP_POOL* tp, TP_TASK_CB cb, void* args)
+{
+    return ((ThreadPool*)tp)->acceptATask(cb, args, c_task_name);
+}
+
+/******************************************
+*name：		tp_submit_batch
+*brief:		批量提交任务，整批只加一次锁
+*input:		tp：线程池对象；cb：任务回调；args：参数数组；num：任务个数
+*output:	无
+*return:	成功返回提交的任务数
+******************************************/
+int tp_submit_batch(TP_POOL* tp, TP_TASK_CB cb, void** args, int num)
+{
+    return ((ThreadPool*)tp)->acceptTasks(cb, args, num, c_task_name);
+}
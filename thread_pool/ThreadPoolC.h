@@ -0,0 +1,21 @@
+#ifndef __THREAD_POOL_C_H_
+#define __THREAD_POOL_C_H_
+
+/* ThreadPool 的 C 接口，供 reactor 等 C 模块使用 */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _TP_POOL TP_POOL;    // 不透明类型，实际为 ThreadPool
+typedef void* (*TP_TASK_CB)(void* args);
+
+TP_POOL* tp_create_pool(int max_thread_num);
+void tp_destroy_pool(TP_POOL* tp);
+int tp_submit(TP_POOL* tp, TP_TASK_CB cb, void* args);
+int tp_submit_batch(TP_POOL* tp, TP_TASK_CB cb, void** args, int num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif